@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "Affinity.h"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using std::string;
+using std::vector;
+
+bool parseCpuList(const string& text, vector<int>& cpus)
+{
+    cpus.clear();
+    std::stringstream in(text);
+    string item;
+    while (std::getline(in, item, ',')) {
+        item.erase(std::remove_if(item.begin(), item.end(), ::isspace), item.end());
+        if (item.empty()) continue;
+        size_t dash = item.find('-');
+        try {
+            int first = std::stoi(item.substr(0, dash));
+            int last = dash == string::npos ? first : std::stoi(item.substr(dash + 1));
+            if (first < 0 || last < first) return false;
+            for (int c = first; c <= last; c++)
+                cpus.push_back(c);
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    return !cpus.empty();
+}
+
+/**
+ * @brief
+ * Reads the node directories of sysfs; nodes are numbered densely on the hosts we run on,
+ * so the scan stops at the first missing one.
+ */
+static CpuTopology detectTopology()
+{
+    CpuTopology topo;
+#ifdef __linux__
+    for (int node = 0;; node++) {
+        std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!in) break;
+        string line;
+        vector<int> cpus;
+        if (std::getline(in, line) && parseCpuList(line, cpus))
+            topo.nodes.push_back(cpus);     // memory only nodes have an empty list and are skipped
+    }
+#endif
+    if (topo.nodes.empty()) {
+        unsigned n = std::max(1u, std::thread::hardware_concurrency());
+        topo.nodes.emplace_back();
+        for (unsigned c = 0; c < n; c++)
+            topo.nodes[0].push_back((int)c);
+    }
+    return topo;
+}
+
+const CpuTopology& cpuTopology()
+{
+    static const CpuTopology topo = detectTopology();
+    return topo;
+}
+
+string CpuTopology::describe() const
+{
+    std::ostringstream out;
+    for (size_t n = 0; n < nodes.size(); n++) {
+        out << "node " << n << ":";
+        const vector<int>& c = nodes[n];
+        // print runs of consecutive ids as ranges
+        for (size_t i = 0; i < c.size();) {
+            size_t j = i;
+            while (j + 1 < c.size() && c[j + 1] == c[j] + 1) j++;
+            out << (i ? "," : " ") << c[i];
+            if (j > i) out << "-" << c[j];
+            i = j + 1;
+        }
+        out << "\n";
+    }
+    return out.str();
+}
+
+bool affinitySupported()
+{
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool pinCurrentThread(int cpu)
+{
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
@@ -3,10 +3,29 @@
 #include <opencv2/opencv.hpp>
 #include <filesystem>
 #include <iomanip>
+#include <chrono>
+#include <sstream>
+#include <deque>
+#include <functional>
 #include "FaceSegmentation.h"
 #include "EyeSegmentation.h"
 #include "BIoU.h"
 #include "PupilSegment.h"
+#include "FaceAnalysis.h"
+#include "VideoAnalysis.h"
+#include "SequentialTest.h"
+#include "Sharding.h"
+#include "CropArchive.h"
+#include "ParameterSweep.h"
+#include "Prefetcher.h"
+#include "LandmarkModel.h"
+#include "TaskPool.h"
+#include "Affinity.h"
+#include "Presets.h"
+#include "SyntheticData.h"
+#include "Pipeline.h"
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 using namespace cv;
@@ -51,16 +70,11 @@ bool isVideoFile(const string& p)
  * @param outPath The full file path and name where the resulting image should be saved.
  * @param biou The Bounding Box IoU score to be included as text annotation on the saved image.
  */
-void saveResultImage(const Mat& eye, const Mat& mask, const string& outPath, double biou)
+void saveResultImage(const Mat& eye, const PupilMask& mask, const string& outPath, double biou)
 {
-    Mat maskR, maskColor, combined;
+    Mat maskColor, combined;
 
-    if (mask.size() != eye.size())
-        resize(mask, maskR, eye.size(), 0, 0, INTER_NEAREST);
-    else
-        maskR = mask.clone();
-
-    cvtColor(maskR, maskColor, COLOR_GRAY2BGR);
+    renderPupilMask(mask.size != eye.size() ? mask.resized(eye.size()) : mask, maskColor);
 
     string label = "BIoU = " + to_string(biou).substr(0,6);
     putText(maskColor, label, Point(10,25),
@@ -79,13 +93,13 @@ void saveResultImage(const Mat& eye, const Mat& mask, const string& outPath, dou
  * @param outDir The path to the directory where the resulting image files should be stored.
  * @param baseName The base filename used for both the eye image and the mask image (For example used to create baseName_eye.png and baseName_mask.png).
  */
-void saveEyeAndMaskSeparately(const Mat& eye, const Mat& mask, const string& outDir, const string& baseName)
+void saveEyeAndMaskSeparately(const Mat& eye, const PupilMask& mask, const string& outDir, const string& baseName)
 {
     string eyePath  = outDir + "/" + baseName + "_eye.jpg";
     string maskPath = outDir + "/" + baseName + "_mask.jpg";
 
     imwrite(eyePath, eye);
-    imwrite(maskPath, mask);
+    imwrite(maskPath, mask.full());
 }
 
 /**
@@ -109,7 +123,7 @@ void drawLandmarks(Mat& img, const std::vector<Point>& pts)
  * @param outPath The full file path and name where the resulting annotated image should be saved.
  * @param biou The Bounding Box IoU score to be included as text annotation on the saved image.
  */
-void saveFaceAnnotatedResult(const Mat& eye, const Mat& mask, const std::vector<Point>& landmarks,
+void saveFaceAnnotatedResult(const Mat& eye, const PupilMask& mask, const std::vector<Point>& landmarks,
                             const std::string& outPath, double biou)
 {
     Mat annotated = eye.clone();
@@ -123,14 +137,8 @@ void saveFaceAnnotatedResult(const Mat& eye, const Mat& mask, const std::vector<
                 Scalar(0,255,0), 2);
 
 
-    Mat maskResized, maskColor;
-
-    if (mask.size() != annotated.size())
-        resize(mask, maskResized, annotated.size(), 0, 0, INTER_NEAREST);
-    else
-        maskResized = mask.clone();
-
-    cvtColor(maskResized, maskColor, COLOR_GRAY2BGR);
+    Mat maskColor;
+    renderPupilMask(mask.size != annotated.size() ? mask.resized(annotated.size()) : mask, maskColor);
 
     Mat combined;
     hconcat(annotated, maskColor, combined);
@@ -141,158 +149,1146 @@ void saveFaceAnnotatedResult(const Mat& eye, const Mat& mask, const std::vector<
 /**
  * @brief 
  * Serves as the main pipeline for processing a single eye image file, typically involving pupil detection, score calculation, and result saving.
- * @param path The file path to the input eye image to be analyzed.
+ * @param file The input eye image, its content already read by the prefetcher or only its path.
  * @param biou Output parameter: The calculated BIoU score resulting from the pupil detection, returned by reference.
- * @param outDir The directory path where the resulting annotated and/or separated images will be saved.
+ * @param outDir The directory path where the resulting annotated and/or separated images will be saved, empty to write none.
+ * @param pipeline Hough parameters and ellipse fit method (eye crops carry no landmarks).
  * @return true 
  * @return false 
  */
-bool processEyeImage(const string& path, double& biou, const string& outDir)
+bool processEyeImage(const PrefetchedFile& file, double& biou, const string& outDir,
+                     const Pipeline& pipeline)
 {
-    Mat eye = imread(path);
-    if (eye.empty()) return false;
-
-    Mat norm = normalizeEyeCrop(eye);
-    Mat gray; cvtColor(norm, gray, COLOR_BGR2GRAY);
-
-    Mat mask;
-    Point center; int radius;
-
-    if (!findPupilMask(gray, mask, center, radius))
+    EyeResult eye;
+    if (!pipeline.processEye(decodeImage(file), eye))
         return false;
 
-    vector<vector<Point>> contours;
-    findContours(mask, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-    if (contours.empty()) return false;
-
-    biou = computeBIoU(mask, contours[0]);
+    biou = eye.biou;
 
-    string base = fs::path(path).stem().string();
+    string base = fs::path(file.path).stem().string();
 
-    saveEyeAndMaskSeparately(norm, mask, outDir, base);
+    if (!outDir.empty())
+        saveEyeAndMaskSeparately(eye.eye, eye.mask, outDir, base);
 
     return true;
 }
 
+/**
+ * @brief 
+ * Builds the output path of a secondary face by inserting the face index before the extension.
+ * @param outPath The output path used for the best scoring face.
+ * @param face Rank of the face by detection score.
+ * @return string 
+ */
+string faceOutputPath(const string& outPath, int face)
+{
+    if (face == 0) return outPath;
+    fs::path p(outPath);
+    return (p.parent_path() / (p.stem().string() + "_face" + to_string(face) + p.extension().string())).string();
+}
+
 /**
  * @brief 
  * Executes the full processing pipeline for a single face image, encompassing eye extraction, pupil detection, scoring, and saving the annotated results.
- * @param path The file path to the input image containing the face to be analyzed.
+ * Every detected face (or the top maxFaces of them) is analysed in parallel; the file score is the mean of the face scores.
+ * @param file The input image containing the face to be analyzed, its content already read by the prefetcher or only its path.
  * @param biou Output parameter: The calculated BIoU score resulting from pupil detection in the face, returned by reference.
- * @param outPath The directory path where the resulting annotated image of the processed face will be saved.
+ * @param outPath The directory path where the resulting annotated image of the processed face will be saved, empty to write none.
+ * @param faces Output parameter: the per face results, ordered by detection score.
+ * @param pipeline Face selection (top maxFaces faces, 0 for all faces) and pupil search options.
  * @return true 
  * @return false 
  */
 
-bool processFaceImage(const string& path, double& biou, const string& outPath)
+bool processFaceImage(const PrefetchedFile& file, double& biou, const string& outPath,
+                      vector<FaceResult>& faces, const Pipeline& pipeline)
 {
-    Mat left, right;
-    std::vector<Point> leftPts, rightPts;
-    if (!extractEyesFromFace(path, left, right, leftPts, rightPts))
+    // dlib::load_image ignores EXIF orientation, keep that behaviour
+    Mat img = decodeImage(file, IMREAD_COLOR | IMREAD_IGNORE_ORIENTATION);
+    if (!pipeline.processImage(img, faces))
         return false;
 
-    double L = -1, R = -1;
-    Mat mL, mR;
+    double sum = 0;
+    int scored = 0;
+
+    for (const auto& f : faces) {
+        double v = f.biou();
+        if (v < 0) continue;
+        sum += v;
+        scored++;
+
+        const EyeResult& chosen = (f.left.found && (!f.right.found || f.left.biou >= f.right.biou))
+                                      ? f.left : f.right;
+
+        if (!outPath.empty())
+            saveFaceAnnotatedResult(chosen.eye,
+                                    chosen.mask,
+                                    chosen.landmarks,
+                                    faceOutputPath(outPath, f.index),
+                                    v);
+    }
+
+    if (scored == 0) return false;
 
-    // LEFT
-    Mat gL; cvtColor(left, gL, COLOR_BGR2GRAY);
-    Point cL; int rL;
-    if (findPupilMask(gL, mL, cL, rL)) {
-        vector<vector<Point>> cnt;
-        findContours(mL, cnt, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-        if (!cnt.empty())
-            L = computeBIoU(mL, cnt[0]);
+    biou = sum / scored;
+    return true;
+}
+
+/**
+ * @brief 
+ * Runs the full processing pipeline over a video stream, performing per-frame face/eye analysis, pupil detection, and score accumulation.
+ * The score is the mean over the sampled frames of each frame's score, the mean of its found eyes. With
+ * sequential testing enabled it is the running mean of the same frame scores and decoding stops as soon as
+ * its confidence interval clears the threshold.
+ * @param path The file path to the input video file or the camera device index to be processed.
+ * @param biou Output parameter: The accumulated or averaged BIoU score calculated across all analyzed frames, returned by reference.
+ * @param outPath The directory path where resulting output will be saved only one of the most recently processed frame will be saved, empty to write none.
+ * @param pipeline Frame sampling options (strategy, number of frames, stride); coarse to fine
+ * and capped at seq.maxFrames when sequential testing is enabled.
+ * @param seq Sequential test options.
+ * @param frames Output parameter: number of frames that contributed to the score.
+ * @param stop Output parameter: why processing stopped (StopReason::None without sequential testing).
+ * @return true 
+ * @return false 
+ */
+bool processVideo(const string& path, double& biou, string outPath, const Pipeline& pipeline,
+                  const SequentialOptions& seq, int& frames, StopReason& stop)
+{
+    Mat lastEye;
+    PupilMask lastMask;
+    double sum = 0;
+    int valid = 0;
+    SequentialVerdict verdict(seq);
+    frames = 0;
+
+    bool warned = false;
+    bool opened = pipeline.processVideo(path, [&](const FrameResult& fr) {
+        if (!warned && pipeline.videoOptions().sampling == SampleMode::Keyframe && fr.sampling != SampleMode::Keyframe) {
+            cerr << path << ": key frame index unavailable, sampling " << sampleModeName(fr.sampling) << " instead.\n";
+            warned = true;
+        }
+        for (const EyeResult* eye : {&fr.face.left, &fr.face.right}) {
+            if (!eye->found) continue;
+            lastEye = eye->eye;
+            lastMask = eye->mask;
+        }
+        // a frame scores the mean of its eyes, whichever flags are on
+        double v = fr.biou();
+        if (v < 0) return true;
+        sum += v;
+        valid++;
+        frames++;
+        return !(seq.enabled && verdict.add(v));
+    });
+
+    if (!opened || valid == 0) return false;
+
+    if (seq.enabled) {
+        verdict.finish();
+        biou = verdict.mean();
+        stop = verdict.reason();
+    } else {
+        biou = sum / valid;
+        stop = StopReason::None;
     }
+    if (!outPath.empty())
+        saveResultImage(lastEye, lastMask, outPath, biou);
+
+    return true;
+}
+/**
+ * @brief 
+ * Outcome of one dataset file, as reported by processDataset.
+ */
+struct FileOutcome
+{
+    bool ok = false;                    // the file was scored
+    double biou = -1;
+    vector<FaceResult> faces;           // face images only
+    int frames = 0;                     // videos only: frames that contributed to the score
+    StopReason stop = StopReason::None;
+};
 
-    // RIGHT
-    Mat gR; cvtColor(right, gR, COLOR_BGR2GRAY);
-    Point cR; int rR;
-    if (findPupilMask(gR, mR, cR, rR)) {
-        vector<vector<Point>> cnt;
-        findContours(mR, cnt, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-        if (!cnt.empty())
-            R = computeBIoU(mR, cnt[0]);
+/**
+ * @brief 
+ * How processDataset reads the files and where it writes the result images.
+ */
+struct DatasetRun
+{
+    string outRoot = "results";         // result images go to outRoot/type/mode, empty = none
+    size_t prefetchFiles = 8;           // files read ahead of the workers, 0 = none
+    size_t prefetchMb = 256;            // cap on the bytes read ahead
+    size_t maxInFlight = 0;             // files processed ahead of the one reported, 0 = twice the pool size
+    const map<string, pair<double, int>>* archiveScores = nullptr;  // --crops archive: file scores by relPath
+};
+
+/**
+ * @brief 
+ * The main loop of batchProcess. Every file, decode included, is a task of the shared pool,
+ * so several files are in flight while their faces, eyes and video segments fan out on the
+ * same pool. A pinned pool gets the files node by node in turn; at most run.maxInFlight files are ahead of the one being reported. onFile is
+ * called on the calling thread, in file order, so outputs read the same as a sequential run.
+ * @param files The dataset files.
+ * @param pipeline Options of the eye, face and video modes.
+ * @param seq Sequential test options for videos.
+ * @param run Read ahead, output directory and in-flight bound.
+ * @param onFile Called for every file with its outcome, whether it was scored or not.
+ * @return seconds spent waiting for the read-ahead thread
+ */
+static double processDataset(const vector<DatasetFile>& files, const Pipeline& pipeline,
+                           const SequentialOptions& seq, const DatasetRun& run,
+                           const std::function<void(const DatasetFile&, const FileOutcome&)>& onFile)
+{
+    // images are read whole ahead of the workers, videos are only pulled into the page cache
+    vector<Prefetcher::Request> requests;
+    for (const DatasetFile& file : files) {
+        Prefetcher::Request r;
+        r.path = file.path;
+        r.load = file.mode != "video";
+        requests.push_back(r);
     }
+    Prefetcher prefetcher(std::move(requests), run.archiveScores ? 0 : run.prefetchFiles, run.prefetchMb << 20);
+
+    TaskPool& pool = TaskPool::shared();
+    const size_t limit = run.maxInFlight > 0 ? run.maxInFlight : 2 * (size_t)max(1u, pool.size());
+    const int nodes = pool.nodeCount();
+    deque<future<FileOutcome>> pending;
+    size_t reported = 0;
+    auto report = [&]() {
+        FileOutcome outcome = pool.wait(pending.front());
+        pending.pop_front();
+        onFile(files[reported++], outcome);
+    };
+
+    try {
+        for (size_t i = 0; i < files.size(); i++) {
+            const DatasetFile& file = files[i];
+            PrefetchedFile input;
+            prefetcher.next(input);
+
+            string outDir, outPath;
+            if (!run.outRoot.empty() && !run.archiveScores) {
+                outDir = run.outRoot + "/" + file.type + "/" + file.mode;
+                fs::create_directories(outDir);
+                outPath = outDir + "/" + fs::path(file.path).stem().string() + "_result.jpg";
+            }
 
-    if (L < 0 && R < 0) return false;
+            while (pending.size() >= limit)
+                report();
+            // with --pin on files are queued on the nodes in turn; the worker that takes one
+            // decodes it and queues its faces and eyes on its own node
+            TaskPool::NodeScope onNode((int)(i % nodes));
+            pending.push_back(pool.submit([&, i, outDir, outPath, input = std::move(input)]() {
+                const DatasetFile& file = files[i];
+                FileOutcome r;
+                if (run.archiveScores) {
+                    auto it = run.archiveScores->find(file.relPath);
+                    r.ok = it != run.archiveScores->end();
+                    if (r.ok) {
+                        r.biou = it->second.first;
+                        r.frames = it->second.second;
+                    }
+                } else if (file.mode == "eye" && isImageFile(file.path)) {
+                    r.ok = processEyeImage(input, r.biou, outDir, pipeline);
+                } else if (file.mode == "face" && isImageFile(file.path)) {
+                    r.ok = processFaceImage(input, r.biou, outPath, r.faces, pipeline);
+                } else if (file.mode == "video" && isVideoFile(file.path)) {
+                    r.ok = processVideo(file.path, r.biou, outPath, pipeline, seq, r.frames, r.stop);
+                }
+                return r;
+            }));
+            while (!pending.empty() && pending.front().wait_for(chrono::seconds(0)) == future_status::ready)
+                report();
+        }
+        while (!pending.empty())
+            report();
+        return prefetcher.stalledSeconds();
+    } catch (...) {
+        // the queued files refer to files, run and pipeline: they must finish first
+        try {
+            pool.waitAll(pending);
+        } catch (...) {
+        }
+        throw;
+    }
+}
 
-    Mat chosenEye, chosenMask;
-    vector<Point> chosenLandmarks;
+/**
+ * @brief 
+ * Subcommand "export-crops": runs the face level stages once and packs every eye crop, its
+ * landmarks and its source into an archive that "--crops archive" and "sweep" read back.
+ * Usage: ./batchProcess export-crops <imageDataset_file_path> <crops.bin> [--gray] [--frames numFrames]
+ * @return int 
+ */
+int runExportCrops(int argc, char** argv)
+{
+    if (argc < 4) {
+        cerr << "Usage: ./batchProcess export-crops <imageDataset_file_path> <crops.bin> [--gray] [--frames numFrames]\n";
+        return 1;
+    }
 
-    if (L >= R) {
-        biou = L;
-        chosenEye = left;
-        chosenMask = mL;
-        chosenLandmarks = leftPts;
+    bool gray = false;
+    VideoOptions videoOpts;
+    videoOpts.maxFrames = 5;
+    videoOpts.track = false;
+    for (int i = 4; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--gray")
+            gray = true;
+        else if (arg == "--frames" && i + 1 < argc)
+            videoOpts.maxFrames = stoi(argv[++i]);
     }
-    else {
-        biou = R;
-        chosenEye = right;
-        chosenMask = mR;
-        chosenLandmarks = rightPts;
+
+    vector<DatasetFile> files;
+    for (const auto& f : discoverDataset(argv[2]))
+        if (f.mode == "video" ? isVideoFile(f.path) : isImageFile(f.path))
+            files.push_back(f);
+
+    vector<string> sources;
+    for (const auto& f : files)
+        sources.push_back(f.relPath);
+
+    vector<CropRecord> crops = extractCrops(files, videoOpts);
+    if (!writeCropArchive(argv[3], sources, crops, gray)) {
+        cerr << "Cannot write crop archive " << argv[3] << "\n";
+        return 1;
     }
+    cout << "Exported " << crops.size() << " eye crops from " << files.size() << " files to " << argv[3] << endl;
+    return 0;
+}
 
-    saveFaceAnnotatedResult(chosenEye,
-                            chosenMask,
-                            chosenLandmarks,
-                            outPath,
-                            biou);
+/**
+ * @brief 
+ * Subcommand "merge": combines per shard result files and prints the global accuracy.
+ * Usage: ./batchProcess merge <merged.csv> <shard.csv>...
+ * @return int 
+ */
+int runMerge(int argc, char** argv)
+{
+    if (argc < 4) {
+        cerr << "Usage: ./batchProcess merge <merged.csv> <shard.csv>...\n";
+        return 1;
+    }
 
-    return true;
+    vector<string> inputs(argv + 3, argv + argc);
+    int total = 0, correct = 0;
+    if (!mergeResults(inputs, argv[2], total, correct))
+        return 1;
+
+    double accuracy = total ? (double)correct / total : 0;
+
+    cout << "\n========================================\n";
+    cout << "MERGED SHARDS: " << inputs.size() << endl;
+    cout << "TOTAL FILES  : " << total << endl;
+    cout << "CORRECT      : " << correct << endl;
+    cout << "FINAL ACCURACY = " << accuracy << endl;
+    cout << "========================================\n";
+    return 0;
 }
 
 /**
  * @brief 
- * Runs the full processing pipeline over a video stream, performing per-frame face/eye analysis, pupil detection, and score accumulation.
- * @param path The file path to the input video file or the camera device index to be processed.
- * @param biou Output parameter: The accumulated or averaged BIoU score calculated across all analyzed frames, returned by reference.
- * @param outPath The directory path where resulting output will be saved only one of the most recently processed frame will be saved.
- * @return true 
- * @return false 
+ * Subcommand "manifest": writes the per file cost manifest used by --shard-manifest.
+ * Usage: ./batchProcess manifest <imageDataset_file_path> <manifest.csv> [--cost size|length]
+ * @return int 
  */
-bool processVideo(const string& path, double& biou, string outPath)
+int runManifest(int argc, char** argv)
 {
-    VideoCapture cap(path);
-    if (!cap.isOpened()) return false;
+    if (argc < 4) {
+        cerr << "Usage: ./batchProcess manifest <imageDataset_file_path> <manifest.csv> [--cost size|length]\n";
+        return 1;
+    }
 
-    Mat frame, lastEye, lastMask;
-    double sum = 0;
-    int valid = 0;
+    bool byLength = false;
+    for (int i = 4; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--cost" && i + 1 < argc)
+            byLength = (string(argv[++i]) == "length");
+    }
+
+    if (!writeManifest(argv[2], argv[3], byLength)) {
+        cerr << "Cannot write manifest " << argv[3] << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 
+ * Subcommand "sweep": evaluates many findPupilMask parameter sets on the dataset. Faces are
+ * detected and landmarked once per file and the preprocessed eye crops are cached, so each
+ * parameter set only pays for the edge map and the Hough search.
+ * With "--crops archive" the first argument is a crop archive written by export-crops and
+ * no face level work is done at all.
+ * Usage: ./batchProcess sweep <imageDataset_file_path> (--grid "name=v1,v2;..." | --random N [--seed S])
+ *        [--frames numFrames] [--crops dataset|archive] [--landmark-bounds on/off] [--out sweep_results.csv]
+ * @return int 
+ */
+int runSweepCommand(int argc, char** argv)
+{
+    const char* usage = "Usage: ./batchProcess sweep <imageDataset_file_path> (--grid \"name=v1,v2;...\" | --random N [--seed S]) [--frames numFrames] [--crops dataset|archive] [--landmark-bounds on/off] [--out sweep_results.csv]\n";
+    if (argc < 3) {
+        cerr << usage;
+        return 1;
+    }
+
+    vector<PupilParams> sets;
+    int randomCount = 0;
+    unsigned seed = 1;
+    string outCsv = "sweep_results.csv";
+    bool fromArchive = false;
+    bool landmarkBounds = false;
+    VideoOptions videoOpts;
+    videoOpts.maxFrames = 5;
+    videoOpts.track = false;
+
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--grid" && i + 1 < argc) {
+            if (!parseSweepGrid(argv[++i], sets)) {
+                cerr << "Invalid grid specification.\n";
+                return 1;
+            }
+        }
+        else if (arg == "--random" && i + 1 < argc)
+            randomCount = stoi(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = (unsigned)stoul(argv[++i]);
+        else if (arg == "--frames" && i + 1 < argc)
+            videoOpts.maxFrames = stoi(argv[++i]);
+        else if (arg == "--out" && i + 1 < argc)
+            outCsv = argv[++i];
+        else if (arg == "--crops" && i + 1 < argc)
+            fromArchive = (string(argv[++i]) == "archive");
+        else if (arg == "--landmark-bounds" && i + 1 < argc)
+            landmarkBounds = (string(argv[++i]) == "on");
+    }
+    if (randomCount > 0)
+        sets = randomSweep(randomCount, seed);
+    if (sets.empty()) {
+        cerr << usage;
+        return 1;
+    }
+
+    vector<DatasetFile> files;
+    vector<CachedCrop> crops;
+    CropArchive archive;
+    auto t0 = chrono::steady_clock::now();
+    if (fromArchive) {
+        if (!archive.open(argv[2])) {
+            cerr << "Cannot open crop archive " << argv[2] << "\n";
+            return 1;
+        }
+        files = archive.sources();
+        crops = collectCrops(archive);
+    } else {
+        for (const auto& f : discoverDataset(argv[2]))
+            if (f.mode == "video" ? isVideoFile(f.path) : isImageFile(f.path))
+                files.push_back(f);
+        crops = collectCrops(files, videoOpts);
+    }
+    double collectSecs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    cout << "Cached " << crops.size() << " eye crops from " << files.size() << " files in "
+         << collectSecs << " s\n";
+
+    vector<SweepResult> results = runSweep(files, crops, sets, landmarkBounds);
+
+    ofstream csv(outCsv);
+    csv << "Set,CannyLow,CannyHigh,HoughMinR,HoughMaxR,Dp,MinDist,HoughParam1,HoughParam2,"
+           "Files,Correct,Accuracy,CropsFound,Seconds\n";
+
+    cout << left << setw(6) << "Set" << setw(44) << "Params"
+         << setw(10) << "Accuracy" << setw(10) << "Found" << setw(12) << "Crops/s" << endl;
+    cout << string(82, '-') << endl;
+
+    size_t best = 0;
+    for (size_t s = 0; s < results.size(); s++) {
+        const SweepResult& r = results[s];
+        const PupilParams& p = r.params;
+        if (r.accuracy() > results[best].accuracy()) best = s;
+
+        stringstream params;
+        params << p.cannyLow << "/" << p.cannyHigh << " r" << p.houghMinR << "-" << p.houghMaxR
+               << " dp" << p.dp << " d" << p.minDist << " p" << p.houghParam1 << "/" << p.houghParam2;
+
+        cout << left << setw(6) << s << setw(44) << params.str()
+             << setw(10) << r.accuracy()
+             << setw(10) << r.found
+             << setw(12) << (r.seconds > 0 ? crops.size() / r.seconds : 0) << endl;
+
+        csv << s << "," << p.cannyLow << "," << p.cannyHigh << "," << p.houghMinR << "," << p.houghMaxR
+            << "," << p.dp << "," << p.minDist << "," << p.houghParam1 << "," << p.houghParam2
+            << "," << r.files << "," << r.correct << "," << r.accuracy() << "," << r.found
+            << "," << r.seconds << "\n";
+    }
+
+    cout << "\n========================================\n";
+    cout << "PARAMETER SETS: " << results.size() << endl;
+    cout << "BEST SET      : " << best << " (accuracy " << results[best].accuracy() << ")" << endl;
+    cout << "========================================\n";
+    return 0;
+}
+
+/**
+ * @brief 
+ * Subcommand "convert-model": writes the flat, memory mappable copy of the dlib landmark model
+ * that the landmark stage loads instead of the dlib model when it is present.
+ * Usage: ./batchProcess convert-model [shape_predictor_68_face_landmarks.dat] [shape_predictor_68_face_landmarks.flat]
+ * @return int 
+ */
+int runConvertModel(int argc, char** argv)
+{
+    string datPath = argc > 2 ? argv[2] : "shape_predictor_68_face_landmarks.dat";
+    string flatPath = argc > 3 ? argv[3] : "shape_predictor_68_face_landmarks.flat";
+    if (!convertLandmarkModel(datPath, flatPath)) {
+        cerr << "Cannot convert " << datPath << " to " << flatPath << "\n";
+        return 1;
+    }
+    cout << "Wrote " << flatPath << " (" << fs::file_size(flatPath) / (1 << 20) << " MiB)" << endl;
+    return 0;
+}
+
+/**
+ * @brief 
+ * Reads a "<field>: <n> kB" line of /proc/self/status.
+ * @return the value in kB, -1 if unavailable (always outside Linux)
+ */
+static long procStatusKb(const string& field)
+{
+#ifdef __linux__
+    ifstream in("/proc/self/status");
+    string line;
+    while (getline(in, line)) {
+        if (line.compare(0, field.size() + 1, field + ":") == 0)
+            return stol(line.substr(field.size() + 1));
+    }
+#else
+    (void)field;
+#endif
+    return -1;
+}
+
+/**
+ * @brief 
+ * A size in kB as MiB, "n/a" when it could not be read.
+ */
+static string mibOrNa(long kb)
+{
+    if (kb < 0) return "n/a";
+    stringstream text;
+    text << fixed << setprecision(1) << kb / 1024.0;
+    return text.str();
+}
+
+// Whether evictFromPageCache can drop pages: posix_fadvise is Linux only.
+#ifdef __linux__
+static const bool kCanEvict = true;
+#else
+static const bool kCanEvict = false;
+#endif
+
+/**
+ * @brief 
+ * Drops the cached pages of a file so that the next read comes from storage.
+ * Only pages that no process has mapped can be dropped. Does nothing outside Linux.
+ */
+static void evictFromPageCache(const string& path)
+{
+#ifdef __linux__
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+#else
+    (void)path;
+#endif
+}
+
+/**
+ * @brief 
+ * One measured load of a landmark model: time to load, time of the first prediction
+ * (where a mapped model pages its trees in) and the resident memory the process gained.
+ */
+struct ModelLoadSample
+{
+    double loadMs = 0, firstMs = 0;
+    long anonKb = 0, fileKb = 0;        // -1 where /proc/self/status is unavailable
+};
+
+template <typename Load, typename Predict>
+static ModelLoadSample measureModelLoad(Load load, Predict predict)
+{
+    Mat img(480, 640, CV_8UC3, Scalar(128, 128, 128));
+    dlib::cv_image<dlib::bgr_pixel> dimg(img);
+    dlib::rectangle face(200, 120, 439, 359);
+
+    ModelLoadSample s;
+    long anon0 = procStatusKb("RssAnon"), file0 = procStatusKb("RssFile");
+    auto t0 = chrono::steady_clock::now();
+    load();
+    auto t1 = chrono::steady_clock::now();
+    predict(dimg, face);
+    auto t2 = chrono::steady_clock::now();
+    s.loadMs = chrono::duration<double, milli>(t1 - t0).count();
+    s.firstMs = chrono::duration<double, milli>(t2 - t1).count();
+    s.anonKb = anon0 < 0 ? -1 : procStatusKb("RssAnon") - anon0;
+    s.fileKb = file0 < 0 ? -1 : procStatusKb("RssFile") - file0;
+    return s;
+}
 
-    for (int i = 0; i < 5; i++) {
-        if (!cap.read(frame)) break;
+/**
+ * @brief 
+ * Subcommand "model-bench": cold (page cache dropped) and warm load times of the dlib and
+ * the flat landmark model, and the resident memory each adds to the process. RssAnon is
+ * private to the process; RssFile pages are shared with every process mapping the file.
+ * Then checks that both models place every landmark of every face of an image at the same
+ * point, and fails if one differs.
+ * Usage: ./batchProcess model-bench [shape_predictor_68_face_landmarks.dat] [shape_predictor_68_face_landmarks.flat] [--image path]
+ * @return int 
+ */
+int runModelBench(int argc, char** argv)
+{
+    vector<string> paths;
+    string imagePath = "./imageDataset/real/face/rface8.jpeg";
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--image" && i + 1 < argc)
+            imagePath = argv[++i];
+        else
+            paths.push_back(arg);
+    }
+    string datPath = paths.size() > 0 ? paths[0] : "shape_predictor_68_face_landmarks.dat";
+    string flatPath = paths.size() > 1 ? paths[1] : "shape_predictor_68_face_landmarks.flat";
+
+    // outside Linux the page cache cannot be dropped and the Rss columns read n/a
+    if (!kCanEvict)
+        cout << "The page cache cannot be dropped on this platform; cold rows are skipped\n";
+
+    cout << left << setw(8) << "Model" << setw(8) << "Cache"
+         << setw(12) << "Load ms" << setw(14) << "1st pred ms"
+         << setw(14) << "RssAnon MiB" << setw(14) << "RssFile MiB" << endl;
+    auto report = [](const string& model, const string& cache, const ModelLoadSample& s) {
+        cout << left << setw(8) << model << setw(8) << cache << fixed << setprecision(1)
+             << setw(12) << s.loadMs << setw(14) << s.firstMs
+             << setw(14) << mibOrNa(s.anonKb) << setw(14) << mibOrNa(s.fileKb) << endl;
+    };
+
+    for (const char* cache : {"cold", "warm"}) {
+        if (string(cache) == "cold") {
+            if (!kCanEvict) continue;
+            evictFromPageCache(flatPath);
+        }
+        FlatShapePredictor flat;
+        bool ok = true;
+        ModelLoadSample s = measureModelLoad(
+            [&]() { ok = flat.open(flatPath); },
+            [&](const dlib::cv_image<dlib::bgr_pixel>& img, const dlib::rectangle& r) { if (ok) flat(img, r); });
+        if (!ok) {
+            cerr << "Cannot open " << flatPath << ", run convert-model first.\n";
+            return 1;
+        }
+        report("flat", cache, s);
+    }
 
-        imwrite("__tmp.jpg", frame);
+    for (const char* cache : {"cold", "warm"}) {
+        if (string(cache) == "cold") {
+            if (!kCanEvict) continue;
+            evictFromPageCache(datPath);
+        }
+        dlib::shape_predictor sp;
+        ModelLoadSample s = measureModelLoad(
+            [&]() { dlib::deserialize(datPath) >> sp; },
+            [&](const dlib::cv_image<dlib::bgr_pixel>& img, const dlib::rectangle& r) { sp(img, r); });
+        report("dat", cache, s);
+    }
 
-        Mat left, right;
-        std::vector<Point> leftPts, rightPts;
-        if (!extractEyesFromFace("__tmp.jpg", left, right, leftPts, rightPts))
+    // the flat model must predict exactly what dlib does
+    Mat img = imread(imagePath, IMREAD_COLOR | IMREAD_IGNORE_ORIENTATION);
+    vector<DetectedFace> faces = img.empty() ? vector<DetectedFace>() : detectFaces(img);
+    if (faces.empty()) {
+        cerr << "No face to compare the models on in " << imagePath << ", use --image.\n";
+        return 1;
+    }
+    FlatShapePredictor flat(flatPath);
+    dlib::shape_predictor sp;
+    dlib::deserialize(datPath) >> sp;
+    dlib::cv_image<dlib::bgr_pixel> dimg(img);
+    size_t mismatches = 0, points = 0;
+    for (size_t f = 0; f < faces.size(); f++) {
+        const Rect& b = faces[f].box;
+        dlib::rectangle rect(b.x, b.y, b.x + b.width - 1, b.y + b.height - 1);
+        dlib::full_object_detection a = flat(dimg, rect), e = sp(dimg, rect);
+        if (a.num_parts() != e.num_parts()) {
+            cerr << "Face " << f << ": " << a.num_parts() << " landmarks, dlib has " << e.num_parts() << "\n";
+            mismatches++;
             continue;
+        }
+        for (unsigned long k = 0; k < e.num_parts(); k++, points++) {
+            if (a.part(k).x() == e.part(k).x() && a.part(k).y() == e.part(k).y()) continue;
+            cerr << "Face " << f << " landmark " << k << ": (" << a.part(k).x() << "," << a.part(k).y()
+                 << "), dlib has (" << e.part(k).x() << "," << e.part(k).y() << ")\n";
+            mismatches++;
+        }
+    }
+    cout << "Landmarks compared: " << points << " in " << faces.size() << " face(s) of " << imagePath
+         << ", mismatches: " << mismatches << endl;
+    return mismatches ? 1 : 0;
+}
+
+/**
+ * @brief 
+ * Subcommand "scaling": runs the main loop over the dataset (files, faces, eyes and video
+ * segments as pool tasks, no result images) with a thread budget of 1, 2, 4 ... up to N threads and reports wall time, throughput, speedup and
+ * parallel efficiency. A first untimed pass warms the page cache and the models.
+ * With --pin compare every budget is run unpinned and pinned (workers pinned to CPUs node by
+ * node, one queue and one landmark model replica per NUMA node); the Stolen column counts
+ * the tasks that ran on another node than the one they were queued on.
+ * Usage: ./batchProcess scaling <imageDataset_file_path> [--max-threads N] [--frames numFrames] [--pin off|on|compare]
+ * @return int 
+ */
+int runScaling(int argc, char** argv)
+{
+    if (argc < 3) {
+        cerr << "Usage: ./batchProcess scaling <imageDataset_file_path> [--max-threads N] [--frames numFrames] [--pin off|on|compare]\n";
+        return 1;
+    }
 
-        Mat g; cvtColor(left, g, COLOR_BGR2GRAY);
-        Mat m; Point c; int r;
+    unsigned maxThreads = max(1u, thread::hardware_concurrency());
+    VideoOptions videoOpts;
+    videoOpts.maxFrames = 5;
+    videoOpts.track = false;
+    vector<bool> pinModes = {false};
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--max-threads" && i + 1 < argc)
+            maxThreads = (unsigned)stoul(argv[++i]);
+        else if (arg == "--frames" && i + 1 < argc)
+            videoOpts.maxFrames = stoi(argv[++i]);
+        else if (arg == "--pin" && i + 1 < argc) {
+            string v = argv[++i];
+            pinModes = v == "compare" ? vector<bool>{false, true} : vector<bool>{v == "on"};
+        }
+    }
 
-        if (findPupilMask(g, m, c, r)) {
-            vector<vector<Point>> cnt;
-            findContours(m, cnt, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-            if (!cnt.empty()) {
-                double v = computeBIoU(m, cnt[0]);
-                sum += v;
-                valid++;
+    const CpuTopology& topo = cpuTopology();
+    cout << topo.nodeCount() << " NUMA node(s)\n" << topo.describe();
+    if (!affinitySupported() && pinModes.back())
+        cout << "Threads cannot be pinned on this platform; pinned runs use a single queue\n";
+
+    vector<DatasetFile> files;
+    for (const auto& f : discoverDataset(argv[2]))
+        if (f.mode == "video" ? isVideoFile(f.path) : isImageFile(f.path))
+            files.push_back(f);
+
+    // the main loop, without result images
+    const Pipeline pipeline(FaceAnalysisOptions(), videoOpts);
+    DatasetRun run;
+    run.outRoot.clear();
+    auto workload = [&]() {
+        processDataset(files, pipeline, SequentialOptions(), run, [](const DatasetFile&, const FileOutcome&) {});
+    };
+
+    vector<unsigned> budgets;
+    for (unsigned t = 1; t < maxThreads; t *= 2)
+        budgets.push_back(t);
+    budgets.push_back(maxThreads);
+
+    // the pinned warm up also loads the replica of every node
+    TaskPool::setThreadBudget(maxThreads);
+    for (bool pin : pinModes) {
+        TaskPool::setPinning(pin);
+        workload();
+    }
 
-                lastEye = left.clone();
-                lastMask = m.clone();
-            }
+    cout << left << setw(10) << "Threads" << setw(8) << "Pinned" << setw(12) << "Seconds" << setw(12) << "Files/s"
+         << setw(10) << "Speedup" << setw(12) << "Efficiency" << setw(10) << "Stolen" << endl;
+    double base = 0;
+    for (unsigned t : budgets) {
+        for (bool pin : pinModes) {
+            TaskPool::setThreadBudget(t);
+            TaskPool::setPinning(pin);
+            TaskPool& pool = TaskPool::shared();
+            auto start = chrono::steady_clock::now();
+            workload();
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            // speedups are relative to the first run, one unpinned thread unless only pinned runs
+            if (base == 0) base = seconds;
+
+            double speedup = seconds > 0 ? base / seconds : 0;
+            cout << left << setw(10) << t << setw(8) << (pool.pinned() ? "yes" : "no") << fixed << setprecision(3)
+                 << setw(12) << seconds << setw(12) << (seconds > 0 ? files.size() / seconds : 0)
+                 << setw(10) << speedup << setw(12) << speedup / t
+                 << setw(10) << pool.stolenCount() << endl;
         }
     }
+    TaskPool::setPinning(false);
+    return 0;
+}
 
-    if (valid == 0) return false;
+/**
+ * @brief 
+ * Subcommand "presets": scores the dataset with the default options and with every preset
+ * and reports accuracy, throughput and wall time side by side. No result image is written.
+ * A first untimed pass with the default options warms the page cache and the models.
+ * Usage: ./batchProcess presets <imageDataset_file_path> [--threads N]
+ * @return int 
+ */
+int runPresets(int argc, char** argv)
+{
+    if (argc < 3) {
+        cerr << "Usage: ./batchProcess presets <imageDataset_file_path> [--threads N]\n";
+        return 1;
+    }
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+            TaskPool::setThreadBudget((unsigned)stoul(argv[++i]));
+    }
+
+    // files/s counts the files that are processed, not those skipped for their extension
+    vector<DatasetFile> files;
+    for (const auto& f : discoverDataset(argv[2]))
+        if (f.mode == "video" ? isVideoFile(f.path) : isImageFile(f.path))
+            files.push_back(f);
+
+    struct Config { string name; Pipeline pipeline; };
+    vector<Config> configs;
+    {
+        FaceAnalysisOptions face;
+        VideoOptions video;
+        video.maxFrames = 5;
+        configs.push_back({"default", Pipeline(face, video)});
+    }
+    for (const string& name : presetNames()) {
+        FaceAnalysisOptions face;
+        VideoOptions video;
+        applyPreset(name, face, video);
+        configs.push_back({name, Pipeline(face, video)});
+    }
+
+    // accuracy follows the main loop: real files should score above 0.5, synthetic ones below
+    DatasetRun run;
+    run.outRoot.clear();
+    auto pass = [&](const Config& c, int& scored, int& correct) {
+        scored = correct = 0;
+        processDataset(files, c.pipeline, SequentialOptions(), run, [&](const DatasetFile& f, const FileOutcome& r) {
+            if (!r.ok) return;
+            scored++;
+            if ((f.type == "real" && r.biou > 0.5) || (f.type == "synthetic" && r.biou < 0.5))
+                correct++;
+        });
+    };
+
+    int scored, correct;
+    pass(configs[0], scored, correct);
+
+    cout << left << setw(12) << "Preset" << setw(10) << "Scored" << setw(12) << "Accuracy"
+         << setw(12) << "Files/s" << setw(12) << "Seconds" << endl;
+    for (const Config& c : configs) {
+        auto start = chrono::steady_clock::now();
+        pass(c, scored, correct);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << left << setw(12) << c.name << setw(10) << scored << fixed << setprecision(3)
+             << setw(12) << (scored ? 100.0 * correct / scored : 0.0)
+             << setw(12) << (seconds > 0 ? files.size() / seconds : 0)
+             << setw(12) << seconds << endl;
+    }
+    return 0;
+}
 
-    biou = sum / valid;
-    saveResultImage(lastEye, lastMask, outPath, biou);
+/**
+ * @brief 
+ * Parses a comma separated list of positive integers ("64,160,640").
+ * @return false if an entry is not a positive integer
+ */
+static bool parseSizeList(const string& text, vector<int>& values)
+{
+    values.clear();
+    stringstream ss(text);
+    string item;
+    while (getline(ss, item, ',')) {
+        try {
+            int v = stoi(item);
+            if (v <= 0) return false;
+            values.push_back(v);
+        } catch (const exception&) {
+            return false;
+        }
+    }
+    return !values.empty();
+}
 
+/**
+ * @brief 
+ * Parses the appearance flags shared by "synth" and "synth-bench".
+ * @return true if argv[i] was one of them (i then points at its value)
+ */
+static bool parseSyntheticFlag(int argc, char** argv, int& i, SyntheticOptions& opts)
+{
+    string arg = argv[i];
+    if (i + 1 >= argc) return false;
+    if (arg == "--noise")           opts.noise = stod(argv[++i]);
+    else if (arg == "--highlights") opts.highlights = stoi(argv[++i]);
+    else if (arg == "--eyelid")     opts.eyelid = stod(argv[++i]);
+    else return false;
     return true;
 }
+
+/**
+ * @brief 
+ * Subcommand "synth": renders synthetic eye crops (crop height 0.6 x width) and, optionally,
+ * face sized canvases (height 3/4 x width) and videos with known pupils, and writes their
+ * ground truth to ground_truth.csv (File, Frame, Eye, CenterX, CenterY, Radius, LidY).
+ * Eye i is drawn from seed + i, so it is the same eye at every size.
+ * Usage: ./batchProcess synth <out_dir> [--eye-sizes 64,160,640] [--count N] [--face-sizes 640,1920] [--faces N] [--videos N] [--video-size W] [--video-frames F] [--fps F] [--noise sigma] [--highlights N] [--eyelid f] [--seed S]
+ * @return int 
+ */
+int runSynth(int argc, char** argv)
+{
+    const char* usage = "Usage: ./batchProcess synth <out_dir> [--eye-sizes 64,160,640] [--count N] [--face-sizes 640,1920] [--faces N] [--videos N] [--video-size W] [--video-frames F] [--fps F] [--noise sigma] [--highlights N] [--eyelid f] [--seed S]\n";
+    if (argc < 3) {
+        cerr << usage;
+        return 1;
+    }
+
+    vector<int> eyeSizes = {64, 160, 640}, faceSizes = {640, 1920};
+    int count = 20, faces = 0, videos = 0, videoWidth = 640, videoFrames = 90;
+    double fps = 30;
+    uint64_t seed = 1;
+    SyntheticOptions opts;
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        if (parseSyntheticFlag(argc, argv, i, opts))
+            continue;
+        if (arg == "--eye-sizes" && i + 1 < argc) {
+            if (!parseSizeList(argv[++i], eyeSizes)) { cerr << usage; return 1; }
+        }
+        else if (arg == "--face-sizes" && i + 1 < argc) {
+            if (!parseSizeList(argv[++i], faceSizes)) { cerr << usage; return 1; }
+        }
+        else if (arg == "--count" && i + 1 < argc)
+            count = stoi(argv[++i]);
+        else if (arg == "--faces" && i + 1 < argc)
+            faces = stoi(argv[++i]);
+        else if (arg == "--videos" && i + 1 < argc)
+            videos = stoi(argv[++i]);
+        else if (arg == "--video-size" && i + 1 < argc)
+            videoWidth = stoi(argv[++i]);
+        else if (arg == "--video-frames" && i + 1 < argc)
+            videoFrames = stoi(argv[++i]);
+        else if (arg == "--fps" && i + 1 < argc)
+            fps = stod(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = stoull(argv[++i]);
+    }
+
+    fs::path out = argv[2];
+    vector<SyntheticTruth> truth;
+    auto addTruth = [&](const string& file, const char* eye, const SyntheticEye& e, Point offset) {
+        SyntheticTruth row;
+        row.file = file;
+        row.eye = eye;
+        row.center = e.center + Point2f(offset);
+        row.radius = e.radius;
+        row.lidY = e.lidY + offset.y;
+        truth.push_back(row);
+    };
+
+    if (count > 0) fs::create_directories(out / "eye");
+    for (int w : eyeSizes) {
+        Size size(w, max(1, cvRound(w * 0.6)));
+        for (int i = 0; i < count; i++) {
+            RNG rng(seed + i);
+            SyntheticEye eye = randomSyntheticEye(size, rng, opts);
+            string file = (out / "eye" / ("eye_" + to_string(size.width) + "x" + to_string(size.height) +
+                                          "_" + to_string(i) + ".png")).string();
+            if (!imwrite(file, renderSyntheticEye(eye, rng))) {
+                cerr << "Cannot write " << file << "\n";
+                return 1;
+            }
+            addTruth(file, "crop", eye, Point());
+        }
+    }
+
+    if (faces > 0) fs::create_directories(out / "face");
+    for (int w : faceSizes) {
+        Size size(w, max(1, cvRound(w * 0.75)));
+        Size eyeSize = syntheticFaceEyeSize(size);
+        for (int i = 0; i < faces; i++) {
+            RNG rng(seed + i);
+            SyntheticEye left = randomSyntheticEye(eyeSize, rng, opts);
+            SyntheticEye right = randomSyntheticEye(eyeSize, rng, opts);
+            Rect leftRect, rightRect;
+            Mat canvas = renderSyntheticFace(size, left, right, leftRect, rightRect, rng);
+            string file = (out / "face" / ("face_" + to_string(size.width) + "x" + to_string(size.height) +
+                                           "_" + to_string(i) + ".png")).string();
+            if (!imwrite(file, canvas)) {
+                cerr << "Cannot write " << file << "\n";
+                return 1;
+            }
+            addTruth(file, "left", left, leftRect.tl());
+            addTruth(file, "right", right, rightRect.tl());
+        }
+    }
+
+    if (videos > 0) fs::create_directories(out / "video");
+    for (int i = 0; i < videos; i++) {
+        RNG rng(seed + i);
+        string file = (out / "video" / ("video_" + to_string(i) + ".mp4")).string();
+        Size size(videoWidth, max(1, cvRound(videoWidth * 0.75)));
+        if (!writeSyntheticVideo(file, size, videoFrames, fps, rng, opts, truth)) {
+            cerr << "Cannot write " << file << "\n";
+            return 1;
+        }
+    }
+
+    ofstream csv((out / "ground_truth.csv").string());
+    csv << "File,Frame,Eye,CenterX,CenterY,Radius,LidY\n";
+    csv << fixed << setprecision(2);
+    for (const SyntheticTruth& t : truth)
+        csv << t.file << "," << t.frame << "," << t.eye << "," << t.center.x << "," << t.center.y << ","
+            << t.radius << "," << t.lidY << "\n";
+
+    cout << "Wrote " << truth.size() << " ground truth rows to " << (out / "ground_truth.csv").string() << endl;
+    return 0;
+}
+
+/**
+ * @brief 
+ * Subcommand "synth-bench": renders the same synthetic eyes at every crop width and times
+ * each pupil stage at each size (grayscale conversion, preprocessing, edges, candidate search
+ * and selection, contour and BIoU), in milliseconds per eye on one thread. With
+ * --detector compare every size is run with the Hough and the Ransac detector on the same eyes. With
+ * --faces on the face detector also runs on a face canvas five times the eye width.
+ * Against the known pupils it reports how many were found, how many match (center within
+ * a quarter radius, radius within a quarter), and the mean center error in radii; memory
+ * is the bytes of the per-eye images and the process' peak resident set so far. The pupil
+ * search is the pipeline's default unless --landmark-bounds says otherwise.
+ * Usage: ./batchProcess synth-bench [--sizes 64,128,256,512,1024] [--count N] [--faces on/off] [--landmark-bounds on/off] [--detector hough|ransac|compare] [--noise sigma] [--highlights N] [--eyelid f] [--seed S]
+ * @return int 
+ */
+int runSynthBench(int argc, char** argv)
+{
+    vector<int> sizes = {64, 128, 256, 512, 1024};
+    int count = 50;
+    // the pipeline's default search, so the default run times what the tools run
+    bool withFaces = false, landmarkBounds = PupilSearchOptions().landmarkBounds;
+    uint64_t seed = 1;
+    SyntheticOptions opts;
+    vector<PupilDetector> detectors = {PupilDetector::Hough};
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (parseSyntheticFlag(argc, argv, i, opts))
+            continue;
+        if (arg == "--sizes" && i + 1 < argc) {
+            if (!parseSizeList(argv[++i], sizes)) {
+                cerr << "Usage: ./batchProcess synth-bench [--sizes 64,128,256,512,1024] [--count N] [--faces on/off] [--landmark-bounds on/off] [--detector hough|ransac|compare] [--noise sigma] [--highlights N] [--eyelid f] [--seed S]\n";
+                return 1;
+            }
+        }
+        else if (arg == "--detector" && i + 1 < argc) {
+            string v = argv[++i];
+            PupilDetector d;
+            if (v == "compare")
+                detectors = {PupilDetector::Hough, PupilDetector::Ransac};
+            else if (parsePupilDetector(v, d))
+                detectors = {d};
+        }
+        else if (arg == "--count" && i + 1 < argc)
+            count = max(1, stoi(argv[++i]));
+        else if (arg == "--faces" && i + 1 < argc)
+            withFaces = (string(argv[++i]) == "on");
+        else if (arg == "--landmark-bounds" && i + 1 < argc)
+            landmarkBounds = (string(argv[++i]) == "on");
+        else if (arg == "--seed" && i + 1 < argc)
+            seed = stoull(argv[++i]);
+    }
+
+    enum { Gray, Preprocess, Edges, Search, Score, Detect, Stages };
+    const char* names[Stages] = {"Gray", "Prep", "Edges", "Search", "BIoU", "Detect"};
+
+    cout << left << setw(11) << "Size" << setw(9) << "Detector";
+    for (const char* n : names) cout << setw(9) << n;
+    cout << setw(8) << "Found%" << setw(8) << "Match%" << setw(10) << "CenterErr"
+         << setw(9) << "WorkKB" << setw(10) << "PeakRssMB" << endl;
+
+    for (int w : sizes) {
+        for (PupilDetector detector : detectors) {
+            Size size(w, max(1, cvRound(w * 0.6)));
+            double ms[Stages] = {};
+            int found = 0, matched = 0;
+            double centerErr = 0;
+            size_t workBytes = 0;
+
+            for (int i = 0; i < count; i++) {
+                RNG rng(seed + i);
+                SyntheticEye truth = randomSyntheticEye(size, rng, opts);
+                Mat crop = renderSyntheticEye(truth, rng);
+                PupilParams params = landmarkBounds ? pupilParamsFromLandmarks(truth.landmarks()) : PupilParams();
+                params.detector = detector;
+
+                Mat gray, I, edges;
+                PupilMask mask;
+                Point center;
+                int radius = 0;
+                bool ok = false;
+                double biou = -1;
+                auto timed = [&](int stage, const function<void()>& fn) {
+                    auto start = chrono::steady_clock::now();
+                    fn();
+                    ms[stage] += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                };
+                timed(Gray, [&]() { cvtColor(crop, gray, COLOR_BGR2GRAY); });
+                timed(Preprocess, [&]() { preprocessForPupil(gray, I); });
+                timed(Edges, [&]() { pupilEdgeMap(I, edges, params); });
+                timed(Search, [&]() { ok = findPupilMaskPrepared(I, edges, mask, center, radius, params); });
+                if (ok) {
+                    timed(Score, [&]() {
+                        vector<vector<Point>> contours;
+                        pupilContours(mask, contours);
+                        if (!contours.empty()) biou = computeBIoU(mask, contours[0]);
+                    });
+                }
+                if (withFaces) {
+                    Size canvasSize(5 * size.width, cvRound(3.75 * size.width));
+                    RNG faceRng(seed + i);
+                    SyntheticEye left = randomSyntheticEye(syntheticFaceEyeSize(canvasSize), faceRng, opts);
+                    SyntheticEye right = randomSyntheticEye(syntheticFaceEyeSize(canvasSize), faceRng, opts);
+                    Rect lr, rr;
+                    Mat canvas = renderSyntheticFace(canvasSize, left, right, lr, rr, faceRng);
+                    timed(Detect, [&]() { detectFaces(canvas); });
+                    if (i == 0) workBytes += canvas.total() * canvas.elemSize();
+                }
+                if (i == 0) {
+                    for (const Mat* m : {&crop, &gray, &I, &edges, &mask.local})
+                        workBytes += m->total() * m->elemSize();
+                }
+
+                if (!ok) continue;
+                found++;
+                double err = norm(Point2f(center) - truth.center) / truth.radius;
+                centerErr += err;
+                if (err <= 0.25 && abs(radius - truth.radius) <= 0.25 * truth.radius)
+                    matched++;
+            }
+
+            cout << left << setw(11) << (to_string(size.width) + "x" + to_string(size.height))
+                 << setw(9) << pupilDetectorName(detector) << fixed << setprecision(3);
+            for (int s = 0; s < Stages; s++) {
+                if (s == Detect && !withFaces) cout << setw(9) << "-";
+                else cout << setw(9) << ms[s] / count;
+            }
+            long hwm = procStatusKb("VmHWM");
+            cout << setprecision(1) << setw(8) << 100.0 * found / count << setw(8) << 100.0 * matched / count
+                 << setprecision(3) << setw(10) << (found ? centerErr / found : 0.0)
+                 << setw(9) << (workBytes >> 10) << setw(10) << mibOrNa(hwm)
+                 << endl;
+        }
+    }
+    return 0;
+}
+
 /**
  * @brief 
  * The main function of the command line argument batch process which takes one input argument.
@@ -306,16 +1302,180 @@ bool processVideo(const string& path, double& biou, string outPath)
  */
 int main(int argc, char** argv)
 {
+    if (argc >= 2 && string(argv[1]) == "merge")
+        return runMerge(argc, argv);
+    if (argc >= 2 && string(argv[1]) == "manifest")
+        return runManifest(argc, argv);
+    if (argc >= 2 && string(argv[1]) == "sweep")
+        return runSweepCommand(argc, argv);
+    if (argc >= 2 && string(argv[1]) == "export-crops")
+        return runExportCrops(argc, argv);
+    if (argc >= 2 && string(argv[1]) == "convert-model")
+        return runConvertModel(argc, argv);
+    if (argc >= 2 && string(argv[1]) == "model-bench")
+        return runModelBench(argc, argv);
+    if (argc >= 2 && string(argv[1]) == "scaling")
+        return runScaling(argc, argv);
+    if (argc >= 2 && string(argv[1]) == "presets")
+        return runPresets(argc, argv);
+    if (argc >= 2 && string(argv[1]) == "synth")
+        return runSynth(argc, argv);
+    if (argc >= 2 && string(argv[1]) == "synth-bench")
+        return runSynthBench(argc, argv);
+
     if (argc < 2) {
-        cerr << "Usage: ./batchProcess <imageDataset_file_path>\n";
+        cerr << "Usage: ./batchProcess <imageDataset_file_path> [--preset fast|balanced|accurate] [--shard i/N] [--shard-manifest manifest.csv] [--faces maxFaces] [--detect serial|parallel] [--pyramid-downscale r] [--upsample N] [--frames numFrames] [--sample first|stride|uniform|keyframe] [--stride N] [--track on/off] [--segments K] [--sequential on/off] [--max-frames N] [--confidence p] [--landmark-bounds on/off] [--eye-width N] [--detector hough|ransac] [--crops dataset|archive] [--prefetch N] [--prefetch-mb M] [--quality-gate off|frames|eyes|on] [--min-sharpness v] [--eye-min-sharpness v] [--min-luma v] [--max-luma v] [--max-clipped f] [--threads N] [--pin on/off] [--stats on/off]\n";
         return 1;
     }
 
     string root = argv[1];
     string outRoot = "results";
+    FaceAnalysisOptions faceOpts;
+    VideoOptions videoOpts;
+    videoOpts.maxFrames = 5;
+    SequentialOptions seqOpts;
+    int shardIndex = 0, shardCount = 1;
+    string shardManifest;
+    bool fromArchive = false;
+    bool printStats = false;
+    size_t prefetchFiles = 8, prefetchMb = 256;
+
+    // the preset is applied first so that the individual flags override it
+    for (int i = 2; i + 1 < argc; ++i) {
+        if (string(argv[i]) == "--preset" && !applyPreset(argv[i + 1], faceOpts, videoOpts)) {
+            cerr << "Unknown preset.\n";
+            return 1;
+        }
+    }
+
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--preset" && i + 1 < argc)
+            ++i;
+        else if (arg == "--shard" && i + 1 < argc) {
+            if (!parseShard(argv[++i], shardIndex, shardCount)) {
+                cerr << "Invalid shard, expected i/N with 0 <= i < N.\n";
+                return 1;
+            }
+        }
+        else if (arg == "--shard-manifest" && i + 1 < argc)
+            shardManifest = argv[++i];
+        else if (arg == "--faces" && i + 1 < argc)
+            faceOpts.maxFaces = stoi(argv[++i]);
+        else if (arg == "--landmark-bounds" && i + 1 < argc)
+            faceOpts.pupil.landmarkBounds = (string(argv[++i]) == "on");
+        else if (arg == "--eye-width" && i + 1 < argc)
+            faceOpts.pupil.canonicalWidth = stoi(argv[++i]);
+        else if (arg == "--detector" && i + 1 < argc) {
+            if (!parsePupilDetector(argv[++i], faceOpts.pupil.params.detector)) {
+                cerr << "Unknown pupil detector.\n";
+                return 1;
+            }
+        }
+        else if (arg == "--detect" && i + 1 < argc)
+            faceOpts.detect.parallel = (string(argv[++i]) == "parallel");
+        else if (arg == "--pyramid-downscale" && i + 1 < argc)
+            faceOpts.detect.downscale = stod(argv[++i]);
+        else if (arg == "--upsample" && i + 1 < argc)
+            faceOpts.detect.upsample = stoi(argv[++i]);
+        else if (arg == "--frames" && i + 1 < argc)
+            videoOpts.maxFrames = stoi(argv[++i]);
+        else if (arg == "--stride" && i + 1 < argc)
+            videoOpts.stride = stoi(argv[++i]);
+        else if (arg == "--track" && i + 1 < argc)
+            videoOpts.track = (string(argv[++i]) == "on");
+        else if (arg == "--segments" && i + 1 < argc)
+            videoOpts.segments = stoi(argv[++i]);
+        else if (arg == "--sequential" && i + 1 < argc)
+            seqOpts.enabled = (string(argv[++i]) == "on");
+        else if (arg == "--max-frames" && i + 1 < argc)
+            seqOpts.maxFrames = stoi(argv[++i]);
+        else if (arg == "--confidence" && i + 1 < argc)
+            seqOpts.confidence = stod(argv[++i]);
+        else if (arg == "--sample" && i + 1 < argc) {
+            if (!parseSampleMode(argv[++i], videoOpts.sampling)) {
+                cerr << "Unknown sampling mode.\n";
+                return 1;
+            }
+        }
+        else if (arg == "--crops" && i + 1 < argc)
+            fromArchive = (string(argv[++i]) == "archive");
+        else if (arg == "--quality-gate" && i + 1 < argc) {
+            string v = argv[++i];
+            faceOpts.detect.quality.enabled = (v == "on" || v == "frames");
+            faceOpts.pupil.quality.enabled = (v == "on" || v == "eyes");
+        }
+        else if (arg == "--min-sharpness" && i + 1 < argc)
+            faceOpts.detect.quality.minSharpness = stod(argv[++i]);
+        else if (arg == "--eye-min-sharpness" && i + 1 < argc)
+            faceOpts.pupil.quality.minSharpness = stod(argv[++i]);
+        else if (arg == "--min-luma" && i + 1 < argc)
+            faceOpts.detect.quality.minLuma = stod(argv[++i]);
+        else if (arg == "--max-luma" && i + 1 < argc)
+            faceOpts.detect.quality.maxLuma = stod(argv[++i]);
+        else if (arg == "--max-clipped" && i + 1 < argc)
+            faceOpts.detect.quality.maxClipped = stod(argv[++i]);
+        else if (arg == "--stats" && i + 1 < argc)
+            printStats = (string(argv[++i]) == "on");
+        else if (arg == "--prefetch" && i + 1 < argc)
+            prefetchFiles = (size_t)stoul(argv[++i]);
+        else if (arg == "--prefetch-mb" && i + 1 < argc)
+            prefetchMb = (size_t)stoul(argv[++i]);
+        else if (arg == "--threads" && i + 1 < argc)
+            TaskPool::setThreadBudget((unsigned)stoul(argv[++i]));
+        else if (arg == "--pin" && i + 1 < argc)
+            TaskPool::setPinning(string(argv[++i]) == "on");
+    }
+
+    if (seqOpts.enabled) {
+        // stop as soon as the verdict is clear; visit frames so every prefix covers the clip
+        videoOpts.maxFrames = seqOpts.maxFrames;
+        videoOpts.coarseToFine = true;
+    }
+    const Pipeline pipeline(faceOpts, videoOpts);
+    printEffectiveConfig(cout, pipeline.faceOptions(), pipeline.videoOptions());
+
+    // with --crops archive the input is a crop archive: only the pupil stage is rerun
+    CropArchive archive;
+    map<string, pair<double, int>> archiveScores;
+    vector<DatasetFile> files;
+    if (fromArchive) {
+        if (!archive.open(root)) {
+            cerr << "Cannot open crop archive " << root << "\n";
+            return 1;
+        }
+        files = archive.sources();
+    } else {
+        files = discoverDataset(root);
+    }
+    if (shardCount > 1) {
+        map<string, double> costs;
+        if (!shardManifest.empty() && !loadManifest(shardManifest, costs)) {
+            cerr << "Cannot read shard manifest " << shardManifest << "\n";
+            return 1;
+        }
+        files = shardManifest.empty() ? selectShard(files, shardIndex, shardCount)
+                                      : selectShardByCost(files, costs, shardIndex, shardCount);
+        cout << "Shard " << shardIndex << "/" << shardCount << ": " << files.size() << " files\n";
+    }
+    if (fromArchive) {
+        // only the crops of this shard's files are scored
+        set<string> shardSources;
+        for (const DatasetFile& f : files)
+            shardSources.insert(f.relPath);
+        vector<double> cropBiou;
+        scoreArchive(archive, cropBiou, archiveScores, faceOpts.pupil, &shardSources);
+    }
+
+    // one result file per shard so shards can share a working directory
+    string suffix = shardCount > 1
+        ? ".shard" + to_string(shardIndex) + "of" + to_string(shardCount) : "";
 
-    ofstream csv("biou_results.csv");
-    csv << "Filename,Type,BIoU\n";
+    ofstream csv("biou_results" + suffix + ".csv");
+    csv << "Filename,Type,Mode,BIoU,Frames,Stop\n";
+
+    ofstream faceCsv("biou_faces" + suffix + ".csv");
+    faceCsv << "Filename,Type,Face,DetectionScore,LeftBIoU,RightBIoU\n";
 
     int total = 0, correct = 0;
 
@@ -325,53 +1485,60 @@ int main(int argc, char** argv)
          << setw(12) << "Correct\n";
     cout << string(64, '-') << endl;
 
-    for (string type : {"real", "synthetic"}) {
-        for (string mode : {"eye", "face", "video"}) {
-
-            string inDir  = root + "/" + type + "/" + mode;
-            string outDir = outRoot + "/" + type + "/" + mode;
-            fs::create_directories(outDir);
-
-            if (!fs::exists(inDir)) continue;
-
-            for (auto& f : fs::directory_iterator(inDir)) {
-
-                string path = f.path().string();
-                string name = f.path().stem().string();
-                string outPath = outDir + "/" + name + "_result.jpg";
-
-                double biou = -1;
-                bool ok = false;
-
-                if (mode == "eye" && isImageFile(path)){
-                    ok = processEyeImage(path, biou, outDir);
-                }else if (mode == "face" && isImageFile(path)){
-                    ok = processFaceImage(path, biou, outPath);
-                }else if (mode == "video" && isVideoFile(path)){
-                    ok = processVideo(path, biou, outPath);
-                }
-                if (!ok) continue;
-
-                bool isCorrect =
-                    (type == "real"      && biou > 0.5) ||
-                    (type == "synthetic" && biou < 0.5);
-
-                total++;
-                if (isCorrect) correct++;
-
-                csv << f.path().filename().string() << ","
+    DatasetRun run;
+    run.prefetchFiles = prefetchFiles;
+    run.prefetchMb = prefetchMb;
+    if (fromArchive) run.archiveScores = &archiveScores;
+
+    double stalled = processDataset(files, pipeline, seqOpts, run, [&](const DatasetFile& file, const FileOutcome& r) {
+        if (!r.ok) return;
+
+        const string& type = file.type;
+        const string& mode = file.mode;
+        fs::path f(file.path);
+        const double biou = r.biou;
+
+        bool isCorrect =
+            (type == "real"      && biou > 0.5) ||
+            (type == "synthetic" && biou < 0.5);
+
+        total++;
+        if (isCorrect) correct++;
+
+        string stopName = (r.stop == StopReason::None) ? "" : stopReasonName(r.stop);
+
+        csv << f.filename().string() << ","
+            << type << ","
+            << mode << ","
+            << biou << ","
+            << (mode == "video" ? to_string(r.frames) : "") << ","
+            << stopName << "\n";
+
+        cout << setw(30) << f.filename().string()
+             << setw(17) << type+"|"+mode
+             << setw(10) << fixed << setprecision(3) << biou
+             << setw(12) << (isCorrect ? "YES" : "NO");
+        if (mode == "video")
+            cout << "  frames=" << r.frames << (stopName.empty() ? "" : "  stop=" + stopName);
+        cout << endl;
+
+        for (const auto& fr : r.faces) {
+            faceCsv << f.filename().string() << ","
                     << type << ","
-                    << biou << "\n";
-
-                cout << setw(30) << f.path().filename().string()
-                     << setw(17) << type+"|"+mode
-                     << setw(10) << fixed << setprecision(3) << biou
-                     << setw(12) << (isCorrect ? "YES" : "NO") << endl;
-            }
+                    << fr.index << ","
+                    << fr.detectionScore << ","
+                    << fr.left.biou << ","
+                    << fr.right.biou << "\n";
+
+            cout << setw(30) << ("  face " + to_string(fr.index))
+                 << setw(17) << ("L " + (fr.left.found ? to_string(fr.left.biou).substr(0,5) : string("-")))
+                 << setw(10) << ("R " + (fr.right.found ? to_string(fr.right.biou).substr(0,5) : string("-")))
+                 << endl;
         }
-    }
+    });
 
     csv.close();
+    faceCsv.close();
 
     double accuracy = total ? (double)correct / total : 0;
 
@@ -381,5 +1548,11 @@ int main(int argc, char** argv)
     cout << "FINAL ACCURACY = " << accuracy << endl;
     cout << "========================================\n";
 
+    if (printStats) {
+        printEllipseFitStats(cout);
+        printQualityGateStats(cout);
+        cout << "Prefetch stall time: " << fixed << setprecision(3) << stalled << " s\n";
+    }
+
     return 0;
 }
@@ -1,58 +1,139 @@
+#include <atomic>
 #include "BIoU.h"
 #include "Ellipse.h"
 using namespace cv;
 /**
- * @brief 
- * Computes the Bounding Box Intersection over Union metric between a detected circular mask and the ground truth eye contour landmarks.
- * @param mask The binary image mask representing the detected pupil region.
- * @param contour A vector of points defining the ground truth contour
- * @return the value of the BIou Score 
+ * @brief
+ * IoU of a mask and a filled ellipse, rasterized only over the region either of them can
+ * cover (inside the crop) instead of over the whole crop.
+ * @param mask The mask pixels of the box roi.
+ * @param roi Position of mask in the crop.
+ * @param size Size of the crop.
+ * @param ellipseBox The fitted ellipse in crop coordinates.
  */
-double computeBIoU(const Mat& mask, const std::vector<Point>& contour)
+static double maskEllipseIoU(const Mat& mask, Rect roi, Size size, const RotatedRect& ellipseBox)
+{
+    Rect frame = roi;
+    if (ellipseBox.size.width > 0 && ellipseBox.size.height > 0 &&
+        std::isfinite(ellipseBox.center.x) && std::isfinite(ellipseBox.center.y)) {
+        // anti aliasing may touch one pixel past the bounding box
+        Rect e = ellipseBox.boundingRect();
+        frame |= Rect(e.x - 2, e.y - 2, e.width + 4, e.height + 4);
+    }
+    frame &= Rect(Point(0, 0), size);
+    if (frame.area() == 0) return 0.0;
+
+    Mat m = Mat::zeros(frame.size(), CV_8UC1);
+    Rect common = roi & frame;
+    if (common.area() > 0)
+        mask(common - roi.tl()).copyTo(m(common - frame.tl()));
+
+    RotatedRect shifted = ellipseBox;
+    shifted.center -= Point2f((float)frame.x, (float)frame.y);
+    Mat ellipseMask = Mat::zeros(frame.size(), CV_8UC1);
+    ellipse(ellipseMask, shifted, Scalar(255), -1, LINE_AA);
+
+    Mat inter, uni;
+    bitwise_and(m, ellipseMask, inter);
+    bitwise_or(m, ellipseMask, uni);
+
+    double I = countNonZero(inter);
+    double U = countNonZero(uni);
+
+    return (U == 0.0 ? 0.0 : I / U);
+}
+
+// one counter per EllipseFitStatus, plus the fitEllipse fallback outcomes
+static std::atomic<uint64_t> fitCounts[(int)EllipseFitStatus::Count];
+static std::atomic<uint64_t> fallbackCount(0);
+static std::atomic<uint64_t> fallbackInvalidCount(0);
+
+static bool validEllipse(const RotatedRect& box)
+{
+    return std::isfinite(box.center.x) && std::isfinite(box.center.y) &&
+           std::isfinite(box.size.width) && std::isfinite(box.size.height) &&
+           box.size.width > 0 && box.size.height > 0;
+}
+
+/**
+ * @brief
+ * Fits the ellipse to the contour and compares it with the mask of the box roi of a crop of
+ * the given size. The custom fitter reports failures as a status; only then OpenCV's
+ * fitEllipse is used, and every outcome is counted instead of logged.
+ */
+static double biouInCrop(const Mat& mask, Rect roi, Size size, const std::vector<Point>& contour,
+                         BIoUMethod method = BIoUMethod::Custom)
 {
     if (contour.size() < 5) return 0.0;
+    if (method == BIoUMethod::OpenCV) {
+        RotatedRect box = fitEllipse(contour);
+        return validEllipse(box) ? maskEllipseIoU(mask, roi, size, box) : 0.0;
+    }
     //Computes ellipse fitting and the BIoU score based on the custom ellipse fitting implemented in
     //this project
-    try{
-        CustomEllipseFitter fitter;
-        RotatedRect ellipseBox = fitter.fit(contour);
-        if (ellipseBox.size.width <= 0.0 || ellipseBox.size.height <= 0.0) {
-            std::cerr << "Warning: Custom ellipse fit produced invalid geometry (non-positive axes)." << std::endl;
-            if (std::isnan(ellipseBox.size.width) || std::isnan(ellipseBox.size.height)) {
-                std::cerr << "Severe Warning: Ellipse axes are NaN (numerical error)." << std::endl;
-            }
-        }
-        Mat ellipseMask = Mat::zeros(mask.size(), CV_8UC1);
-        ellipse(ellipseMask, ellipseBox, Scalar(255), -1, LINE_AA);
-
-        Mat inter, uni;
-        bitwise_and(mask, ellipseMask, inter);
-        bitwise_or(mask, ellipseMask, uni);
-
-        double I = countNonZero(inter);
-        double U = countNonZero(uni);
-
-        return (U == 0.0 ? 0.0 : I / U);
-    }catch(...){
-        //If the custom ellipse fitting failed due to any errors then the OpenCV's own
-        //fit ellipse function is used as a fallback. 
-        RotatedRect ellipseBox = fitEllipse(contour);
-        if (ellipseBox.size.width <= 0.0 || ellipseBox.size.height <= 0.0) {
-            std::cerr << "Warning: Custom ellipse fit produced invalid geometry (non-positive axes)." << std::endl;
-            if (std::isnan(ellipseBox.size.width) || std::isnan(ellipseBox.size.height)) {
-                std::cerr << "Severe Warning: Ellipse axes are NaN (numerical error)." << std::endl;
-            }
+    CustomEllipseFitter fitter;
+    RotatedRect ellipseBox;
+    EllipseFitStatus status = fitter.tryFit(contour, ellipseBox);
+    fitCounts[(int)status].fetch_add(1, std::memory_order_relaxed);
+
+    if (status != EllipseFitStatus::Ok) {
+        //If the custom ellipse fitting failed then the OpenCV's own
+        //fit ellipse function is used as a fallback.
+        fallbackCount.fetch_add(1, std::memory_order_relaxed);
+        ellipseBox = fitEllipse(contour);
+        if (!validEllipse(ellipseBox)) {
+            fallbackInvalidCount.fetch_add(1, std::memory_order_relaxed);
+            return 0.0;
         }
-        Mat ellipseMask = Mat::zeros(mask.size(), CV_8UC1);
-        ellipse(ellipseMask, ellipseBox, Scalar(255), -1, LINE_AA);
+    }
+    return maskEllipseIoU(mask, roi, size, ellipseBox);
+}
+
+EllipseFitStats ellipseFitStats()
+{
+    EllipseFitStats stats;
+    for (int i = 0; i < (int)EllipseFitStatus::Count; i++)
+        stats.byStatus[i] = fitCounts[i].load(std::memory_order_relaxed);
+    stats.fallbacks = fallbackCount.load(std::memory_order_relaxed);
+    stats.fallbackInvalid = fallbackInvalidCount.load(std::memory_order_relaxed);
+    return stats;
+}
 
-        Mat inter, uni;
-        bitwise_and(mask, ellipseMask, inter);
-        bitwise_or(mask, ellipseMask, uni);
+void printEllipseFitStats(std::ostream& out)
+{
+    EllipseFitStats stats = ellipseFitStats();
+    uint64_t total = 0;
+    for (uint64_t n : stats.byStatus) total += n;
 
-        double I = countNonZero(inter);
-        double U = countNonZero(uni);
+    out << "ELLIPSE FITS : " << total << "\n";
+    for (int i = 0; i < (int)EllipseFitStatus::Count; i++)
+        if (stats.byStatus[i] > 0)
+            out << "  " << ellipseFitStatusName((EllipseFitStatus)i) << ": " << stats.byStatus[i] << "\n";
+    out << "  fitEllipse fallback: " << stats.fallbacks
+        << " (invalid: " << stats.fallbackInvalid << ")\n";
+}
 
-        return (U == 0.0 ? 0.0 : I / U);
-    }
+/**
+ * @brief 
+ * Computes the Bounding Box Intersection over Union metric between a detected circular mask and the ground truth eye contour landmarks.
+ * @param mask The binary image mask representing the detected pupil region.
+ * @param contour A vector of points defining the ground truth contour
+ * @return the value of the BIou Score 
+ */
+double computeBIoU(const Mat& mask, const std::vector<Point>& contour)
+{
+    return biouInCrop(mask, Rect(0, 0, mask.cols, mask.rows), mask.size(), contour);
+}
+
+/**
+ * @brief
+ * computeBIoU on a compact mask; only the pupil box and the ellipse box are rasterized.
+ * @param mask The compact pupil mask.
+ * @param contour A vector of points defining the ground truth contour, in crop coordinates
+ * @param method How the ellipse is fitted.
+ * @return the value of the BIou Score
+ */
+double computeBIoU(const PupilMask& mask, const std::vector<Point>& contour, BIoUMethod method)
+{
+    return biouInCrop(mask.local, mask.roi, mask.size, contour, method);
 }
@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <tuple>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "CropArchive.h"
+#include "EyeSegmentation.h"
+#include "FaceAnalysis.h"
+#include "FaceSegmentation.h"
+#include "TaskPool.h"
+
+using namespace cv;
+using namespace std;
+
+static const char kArchiveMagic[8] = {'I', 'F', 'C', 'R', 'O', 'P', 'S', '\0'};
+static const uint32_t kArchiveVersion = 1;
+static const uint64_t kPlaneAlign = 64;
+
+// on disk layout, host byte order
+struct ArchiveHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t cropCount;
+    uint32_t sourceCount;
+    uint32_t reserved;
+    uint64_t indexOffset;       // cropCount ArchiveEntry records
+    uint64_t sourcesOffset;     // sourceCount (uint32 length, bytes) records
+};
+
+struct ArchiveEntry
+{
+    uint64_t pixelOffset;       // height * width * channels bytes, rows packed
+    uint64_t landmarkOffset;    // landmarkCount (int32 x, int32 y) pairs
+    int32_t width, height, channels, landmarkCount;
+    int32_t source, frame, face, eye;
+    int32_t cropX, cropY, cropW, cropH;
+};
+
+/**
+ * @brief
+ * Appends the crops of both eyes of the faces of an image, face by face in detection order.
+ * @param maxFaces Top faces by detection score, 0 for every face (as analyzeFaces), 1 for
+ * video frames (as FrameAnalyzer).
+ */
+static void extractFaceCrops(const Mat& img, int source, int frame, int maxFaces,
+                             const FaceDetectOptions& detect, vector<CropRecord>& out)
+{
+    vector<DetectedFace> dets = detectFaces(img, maxFaces, detect);
+    for (size_t i = 0; i < dets.size(); i++) {
+        EyePair eyes;
+        if (!extractEyesForFace(img, dets[i], eyes)) continue;
+
+        CropRecord left;
+        left.image = eyes.left;
+        left.landmarks = eyes.leftLandmarks;
+        left.cropRect = eyes.leftRect;
+        left.source = source;
+        left.frame = frame;
+        left.face = (int)i;
+        left.eye = 0;
+        out.push_back(left);
+
+        CropRecord right = left;
+        right.image = eyes.right;
+        right.landmarks = eyes.rightLandmarks;
+        right.cropRect = eyes.rightRect;
+        right.eye = 1;
+        out.push_back(right);
+    }
+}
+
+vector<CropRecord> extractCrops(const vector<DatasetFile>& files, const VideoOptions& videoOpts)
+{
+    vector<vector<CropRecord>> perFile(files.size());
+    vector<std::future<void>> tasks;
+    TaskPool& pool = TaskPool::shared();
+
+    for (size_t i = 0; i < files.size(); i++) {
+        tasks.push_back(pool.submit([&, i]() {
+            const DatasetFile& f = files[i];
+            vector<CropRecord>& out = perFile[i];
+
+            if (f.mode == "eye") {
+                Mat eye = imread(f.path);
+                if (eye.empty()) return;
+                CropRecord c;
+                c.image = normalizeEyeCrop(eye);
+                c.cropRect = Rect(0, 0, c.image.cols, c.image.rows);
+                c.source = (int)i;
+                out.push_back(c);
+            } else if (f.mode == "face") {
+                Mat img = imread(f.path, IMREAD_COLOR | IMREAD_IGNORE_ORIENTATION);
+                if (!img.empty())
+                    extractFaceCrops(img, (int)i, -1, 0, videoOpts.detect, out);
+            } else if (f.mode == "video") {
+                VideoCapture cap(f.path);
+                if (!cap.isOpened()) return;
+                FrameSampler sampler(cap, f.path, videoOpts);
+                Mat frame;
+                int index;
+                while (sampler.next(frame, index))
+                    extractFaceCrops(frame, (int)i, index, 1, videoOpts.detect, out);
+            }
+        }));
+    }
+    pool.waitAll(tasks);
+
+    vector<CropRecord> crops;
+    for (auto& v : perFile)
+        for (auto& c : v)
+            crops.push_back(std::move(c));
+    return crops;
+}
+
+static void padTo(ofstream& out, uint64_t& pos, uint64_t align)
+{
+    static const char zeros[kPlaneAlign] = {};
+    uint64_t pad = (align - pos % align) % align;
+    out.write(zeros, (streamsize)pad);
+    pos += pad;
+}
+
+bool writeCropArchive(const string& path, const vector<string>& sources,
+                      const vector<CropRecord>& crops, bool gray)
+{
+    ofstream out(path, ios::binary);
+    if (!out) return false;
+
+    ArchiveHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kArchiveMagic, sizeof(header.magic));
+    header.version = kArchiveVersion;
+    header.cropCount = (uint32_t)crops.size();
+    header.sourceCount = (uint32_t)sources.size();
+    out.write((const char*)&header, sizeof(header));
+    uint64_t pos = sizeof(header);
+
+    vector<ArchiveEntry> entries(crops.size());
+    for (size_t i = 0; i < crops.size(); i++) {
+        const CropRecord& c = crops[i];
+        Mat plane;
+        if (gray && c.image.channels() == 3) cvtColor(c.image, plane, COLOR_BGR2GRAY);
+        else if (!gray && c.image.channels() == 1) cvtColor(c.image, plane, COLOR_GRAY2BGR);
+        else plane = c.image;
+        if (!plane.isContinuous()) plane = plane.clone();
+
+        ArchiveEntry& e = entries[i];
+        memset(&e, 0, sizeof(e));
+        padTo(out, pos, kPlaneAlign);
+        e.pixelOffset = pos;
+        e.width = plane.cols;
+        e.height = plane.rows;
+        e.channels = plane.channels();
+        size_t bytes = plane.total() * plane.elemSize();
+        out.write((const char*)plane.data, (streamsize)bytes);
+        pos += bytes;
+
+        padTo(out, pos, sizeof(int32_t));
+        e.landmarkOffset = pos;
+        e.landmarkCount = (int32_t)c.landmarks.size();
+        for (const Point& p : c.landmarks) {
+            int32_t xy[2] = {p.x, p.y};
+            out.write((const char*)xy, sizeof(xy));
+            pos += sizeof(xy);
+        }
+
+        e.source = c.source;
+        e.frame = c.frame;
+        e.face = c.face;
+        e.eye = c.eye;
+        e.cropX = c.cropRect.x;
+        e.cropY = c.cropRect.y;
+        e.cropW = c.cropRect.width;
+        e.cropH = c.cropRect.height;
+    }
+
+    padTo(out, pos, sizeof(uint64_t));
+    header.indexOffset = pos;
+    out.write((const char*)entries.data(), (streamsize)(entries.size() * sizeof(ArchiveEntry)));
+    pos += entries.size() * sizeof(ArchiveEntry);
+
+    header.sourcesOffset = pos;
+    for (const string& s : sources) {
+        uint32_t len = (uint32_t)s.size();
+        out.write((const char*)&len, sizeof(len));
+        out.write(s.data(), len);
+        pos += sizeof(len) + len;
+    }
+
+    out.seekp(0);
+    out.write((const char*)&header, sizeof(header));
+    return (bool)out;
+}
+
+CropArchive::~CropArchive()
+{
+    close();
+}
+
+void CropArchive::close()
+{
+    if (base)
+        munmap((void*)base, length);
+    base = nullptr;
+    length = 0;
+    count = 0;
+    index = nullptr;
+    files.clear();
+}
+
+bool CropArchive::open(const string& path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ArchiveHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+    base = (const unsigned char*)map;
+    length = (size_t)st.st_size;
+
+    const ArchiveHeader* header = (const ArchiveHeader*)base;
+    uint64_t indexBytes = (uint64_t)header->cropCount * sizeof(ArchiveEntry);
+    if (memcmp(header->magic, kArchiveMagic, sizeof(header->magic)) != 0 ||
+        header->version != kArchiveVersion ||
+        header->indexOffset > length || indexBytes > length - header->indexOffset ||
+        header->sourcesOffset > length) {
+        close();
+        return false;
+    }
+
+    const ArchiveEntry* entries = (const ArchiveEntry*)(base + header->indexOffset);
+    for (uint32_t i = 0; i < header->cropCount; i++) {
+        const ArchiveEntry& e = entries[i];
+        uint64_t pixels = (uint64_t)e.width * e.height * e.channels;
+        uint64_t points = (uint64_t)e.landmarkCount * 2 * sizeof(int32_t);
+        if (e.width <= 0 || e.height <= 0 || (e.channels != 1 && e.channels != 3) || e.landmarkCount < 0 ||
+            e.pixelOffset > length || pixels > length - e.pixelOffset ||
+            e.landmarkOffset > length || points > length - e.landmarkOffset ||
+            e.source < 0 || (uint32_t)e.source >= header->sourceCount) {
+            close();
+            return false;
+        }
+    }
+
+    uint64_t pos = header->sourcesOffset;
+    for (uint32_t s = 0; s < header->sourceCount; s++) {
+        uint32_t len;
+        if (length - pos < sizeof(len)) { close(); return false; }
+        memcpy(&len, base + pos, sizeof(len));
+        pos += sizeof(len);
+        if (length - pos < len) { close(); return false; }
+
+        DatasetFile f;
+        f.relPath.assign((const char*)base + pos, len);
+        f.path = f.relPath;
+        size_t a = f.relPath.find('/');
+        size_t b = a == string::npos ? string::npos : f.relPath.find('/', a + 1);
+        if (b != string::npos) {
+            f.type = f.relPath.substr(0, a);
+            f.mode = f.relPath.substr(a + 1, b - a - 1);
+        }
+        files.push_back(f);
+        pos += len;
+    }
+
+    index = entries;
+    count = header->cropCount;
+    return true;
+}
+
+CropRecord CropArchive::crop(size_t i) const
+{
+    const ArchiveEntry& e = ((const ArchiveEntry*)index)[i];
+
+    CropRecord c;
+    // the mapping is read only; Mat needs a non const pointer but never writes through it here
+    c.image = Mat(e.height, e.width, e.channels == 1 ? CV_8UC1 : CV_8UC3,
+                  (void*)(base + e.pixelOffset));
+
+    const int32_t* xy = (const int32_t*)(base + e.landmarkOffset);
+    for (int32_t k = 0; k < e.landmarkCount; k++)
+        c.landmarks.emplace_back(xy[2 * k], xy[2 * k + 1]);
+
+    c.cropRect = Rect(e.cropX, e.cropY, e.cropW, e.cropH);
+    c.source = e.source;
+    c.frame = e.frame;
+    c.face = e.face;
+    c.eye = e.eye;
+    return c;
+}
+
+map<int, pair<double, int>> aggregateFileScores(const vector<DatasetFile>& sources,
+                                                const vector<tuple<int, int, int>>& groups,
+                                                const vector<double>& cropBiou)
+{
+    // (source, frame, face) -> eye scores
+    map<tuple<int, int, int>, vector<double>> eyes;
+    for (size_t i = 0; i < groups.size(); i++)
+        if (cropBiou[i] >= 0) eyes[groups[i]].push_back(cropBiou[i]);
+
+    map<int, vector<double>> perSource;
+    for (const auto& g : eyes) {
+        int source = get<0>(g.first);
+        const vector<double>& v = g.second;
+        double s = sources[source].mode == "video"
+            ? accumulate(v.begin(), v.end(), 0.0) / v.size()
+            : *max_element(v.begin(), v.end());
+        perSource[source].push_back(s);
+    }
+
+    map<int, pair<double, int>> scores;
+    for (const auto& p : perSource) {
+        const vector<double>& v = p.second;
+        scores[p.first] = make_pair(accumulate(v.begin(), v.end(), 0.0) / v.size(), (int)v.size());
+    }
+    return scores;
+}
+
+void scoreArchive(const CropArchive& archive, vector<double>& cropBiou,
+                  map<string, pair<double, int>>& scores,
+                  const PupilSearchOptions& pupil, const std::set<string>* onlySources,
+                  vector<EyeResult>* cropEyes)
+{
+    cropBiou.assign(archive.size(), -1.0);
+    if (cropEyes) cropEyes->assign(archive.size(), EyeResult());
+    vector<std::future<void>> tasks;
+    TaskPool& pool = TaskPool::shared();
+    for (size_t i = 0; i < archive.size(); i++) {
+        tasks.push_back(pool.submit([&, i]() {
+            CropRecord c = archive.crop(i);
+            if (onlySources && !onlySources->count(archive.sources()[c.source].relPath)) return;
+            EyeResult eye;
+            eye.eye = c.image;
+            eye.landmarks = c.landmarks;
+            if (scoreEye(eye, nullptr, pupil)) cropBiou[i] = eye.biou;
+            if (cropEyes) (*cropEyes)[i] = eye;
+        }));
+    }
+    pool.waitAll(tasks);
+
+    vector<tuple<int, int, int>> groups;
+    for (size_t i = 0; i < archive.size(); i++) {
+        CropRecord c = archive.crop(i);
+        groups.push_back(make_tuple(c.source, c.frame, c.face));
+    }
+
+    scores.clear();
+    for (const auto& p : aggregateFileScores(archive.sources(), groups, cropBiou))
+        scores[archive.sources()[p.first].relPath] = p.second;
+}
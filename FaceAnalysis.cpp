@@ -0,0 +1,229 @@
+#include "FaceAnalysis.h"
+#include "FaceSegmentation.h"
+#include "EyeSegmentation.h"
+#include "PupilSegment.h"
+#include "BIoU.h"
+#include "TaskPool.h"
+
+double FaceResult::biou() const
+{
+    double best = -1.0;
+    if (left.found)  best = std::max(best, left.biou);
+    if (right.found) best = std::max(best, right.biou);
+    return best;
+}
+
+PupilTrack EyeResult::track() const
+{
+    PupilTrack t;
+    t.valid = found;
+    t.center = Point2f((float)(center.x + cropRect.x), (float)(center.y + cropRect.y));
+    t.radius = (float)radius;
+    t.score = score;
+    return t;
+}
+
+/**
+ * @brief
+ * Segments the pupil of an eye crop and scores it with BIoU.
+ * Fills the found, mask, center, radius, score and biou fields of the result.
+ * @param eye The eye result whose eye crop (BGR or grayscale; and crop rectangle when tracking) is already set.
+ * @param prior Optional pupil of the previous video frame in source image coordinates;
+ * when valid the search starts around it (findPupilMaskTracked).
+ * @param opts With landmarkBounds the radius range and center region come from the eye landmarks
+ * (pupilParamsFromLandmarks) instead of the fixed defaults. With canonicalWidth the crop is
+ * resampled so that the eye (landmark extent, or the crop without landmarks) has that width
+ * before the search, which bounds the cost per eye whatever the source resolution; center,
+ * radius and mask are mapped back to the crop, BIoU is measured at the canonical size.
+ * @return true if a pupil contour was found and scored
+ */
+bool scoreEye(EyeResult& eye, const PupilTrack* prior, const PupilSearchOptions& opts)
+{
+    eye.found = false;
+    eye.tracked = false;
+    eye.biou = -1.0;
+    if (eye.eye.empty()) return false;
+    if (checkQuality(eye.eye, opts.quality, QualityStage::Eye) != QualityVerdict::Pass) return false;
+
+    Mat gray;
+    if (eye.eye.channels() == 1) gray = eye.eye;
+    else cvtColor(eye.eye, gray, COLOR_BGR2GRAY);
+
+    // crop -> search image scale
+    double scale = 1.0;
+    vector<Point> landmarks = eye.landmarks;
+    if (opts.canonicalWidth > 0) {
+        int eyeWidth = landmarks.size() >= 6 ? boundingRect(landmarks).width : gray.cols;
+        if (eyeWidth > 0)
+            scale = (double)opts.canonicalWidth / eyeWidth;
+        if (std::abs(scale - 1.0) < 0.02 || cvRound(gray.cols * scale) < 16 || cvRound(gray.rows * scale) < 16)
+            scale = 1.0;
+    }
+    if (scale != 1.0) {
+        resize(gray, gray, Size(cvRound(gray.cols * scale), cvRound(gray.rows * scale)), 0, 0,
+               scale < 1.0 ? INTER_AREA : INTER_LINEAR);
+        for (auto& p : landmarks)
+            p = Point(cvRound(p.x * scale), cvRound(p.y * scale));
+    }
+
+    PupilParams params = opts.landmarkBounds ? pupilParamsFromLandmarks(landmarks, opts.params) : opts.params;
+
+    bool ok;
+    if (prior && prior->valid) {
+        // map the previous pupil into this frame's crop
+        PupilTrack local = *prior;
+        local.center.x = (float)((local.center.x - eye.cropRect.x) * scale);
+        local.center.y = (float)((local.center.y - eye.cropRect.y) * scale);
+        local.radius = (float)(local.radius * scale);
+        ok = findPupilMaskTracked(gray, eye.mask, eye.center, eye.radius, local, params,
+                                  &eye.score, &eye.tracked);
+    } else {
+        ok = findPupilMask(gray, eye.mask, eye.center, eye.radius, params, &eye.score);
+    }
+    if (!ok)
+        return false;
+
+    vector<vector<Point>> contours;
+    pupilContours(eye.mask, contours);
+    if (contours.empty()) return false;
+
+    eye.biou = computeBIoU(eye.mask, contours[0], opts.biou);
+
+    if (scale != 1.0) {
+        eye.center = Point(cvRound(eye.center.x / scale), cvRound(eye.center.y / scale));
+        eye.radius = cvRound(eye.radius / scale);
+        eye.mask = eye.mask.resized(eye.eye.size());
+    }
+    eye.found = true;
+    return true;
+}
+
+bool analyzeEyeCrop(const Mat& eyeImage, EyeResult& eye, const PupilSearchOptions& opts)
+{
+    eye = EyeResult();
+    if (eyeImage.empty()) return false;
+    if (checkQuality(eyeImage, opts.quality, QualityStage::Eye) != QualityVerdict::Pass) return false;
+
+    eye.eye = normalizeEyeCrop(eyeImage);
+    eye.cropRect = Rect(0, 0, eye.eye.cols, eye.eye.rows);
+
+    Mat gray;
+    if (eye.eye.channels() == 1) gray = eye.eye;
+    else cvtColor(eye.eye, gray, COLOR_BGR2GRAY);
+
+    if (!findPupilMask(gray, eye.mask, eye.center, eye.radius, opts.params, &eye.score))
+        return false;
+
+    vector<vector<Point>> contours;
+    pupilContours(eye.mask, contours);
+    if (contours.empty()) return false;
+
+    eye.biou = computeBIoU(eye.mask, contours[0], opts.biou);
+    eye.found = true;
+    return true;
+}
+
+/**
+ * @brief
+ * Predicts the landmarks of one detected face, crops both eyes and segments both pupils,
+ * the two eyes as sibling tasks.
+ * @param imageBgr The image the face was detected in.
+ * @param box The face box.
+ * @param face Output parameter: the face result (index and detection score are left untouched).
+ * @param leftPrior Optional previous left pupil, see scoreEye.
+ * @param rightPrior Optional previous right pupil, see scoreEye.
+ * @param pupil Pupil search options, see scoreEye.
+ * @return false if the eyes could not be cropped
+ */
+bool analyzeFace(const Mat& imageBgr, const Rect& box, FaceResult& face,
+                 const PupilTrack* leftPrior, const PupilTrack* rightPrior,
+                 const PupilSearchOptions& pupil)
+{
+    face.faceBox = box;
+
+    DetectedFace det;
+    det.box = box;
+
+    EyePair eyes;
+    if (!extractEyesForFace(imageBgr, det, eyes)) return false;
+
+    face.left.eye = eyes.left;
+    face.left.cropRect = eyes.leftRect;
+    face.left.landmarks = eyes.leftLandmarks;
+    face.right.eye = eyes.right;
+    face.right.cropRect = eyes.rightRect;
+    face.right.landmarks = eyes.rightLandmarks;
+
+    // the right eye is a sibling task, the left one runs on this thread meanwhile
+    TaskPool& pool = TaskPool::shared();
+    std::future<void> right = pool.submit([&]() { scoreEye(face.right, rightPrior, pupil); });
+    try {
+        scoreEye(face.left, leftPrior, pupil);
+    } catch (...) {
+        // the right eye task writes into face: it must finish before the exception leaves
+        try {
+            pool.wait(right);
+        } catch (...) {
+        }
+        throw;
+    }
+    pool.wait(right);
+    return true;
+}
+
+/**
+ * @brief
+ * Detects every face of an image and, for each of them in parallel, predicts the
+ * landmarks, crops both eyes and segments both pupils.
+ * @param imageBgr The input image.
+ * @param faces Output parameter: one result per face, ordered by detection score.
+ * @param opts Face selection options.
+ * @return false if no face was detected
+ */
+bool analyzeFaces(const Mat& imageBgr, vector<FaceResult>& faces, const FaceAnalysisOptions& opts)
+{
+    faces.clear();
+    if (imageBgr.empty()) return false;
+
+    vector<DetectedFace> dets = detectFaces(imageBgr, opts.maxFaces, opts.detect);
+    if (dets.empty()) return false;
+
+    // one task per face: landmarks, crops and both pupils
+    vector<FaceResult> all(dets.size());
+    vector<char> ok(dets.size(), 0);
+    vector<std::future<void>> tasks;
+
+    TaskPool& pool = TaskPool::shared();
+    for (size_t i = 0; i < dets.size(); i++) {
+        tasks.push_back(pool.submit([&, i]() {
+            FaceResult& r = all[i];
+            r.index = (int)i;
+            r.detectionScore = dets[i].score;
+            ok[i] = analyzeFace(imageBgr, dets[i].box, r, nullptr, nullptr, opts.pupil) ? 1 : 0;
+        }));
+    }
+    pool.waitAll(tasks);
+
+    for (size_t i = 0; i < all.size(); i++)
+        if (ok[i]) faces.push_back(std::move(all[i]));
+
+    return !faces.empty();
+}
+
+/**
+ * @brief
+ * Loads an image file and runs analyzeFaces on it.
+ * @param imagePath Path of the image file.
+ * @param faces Output parameter: one result per face, ordered by detection score.
+ * @param opts Face selection options.
+ * @return false if the image could not be read or no face was detected
+ */
+bool analyzeFaces(const std::string& imagePath, vector<FaceResult>& faces, const FaceAnalysisOptions& opts)
+{
+    faces.clear();
+    // dlib::load_image ignores EXIF orientation, keep that behaviour
+    Mat img = imread(imagePath, IMREAD_COLOR | IMREAD_IGNORE_ORIENTATION);
+    if (img.empty()) return false;
+
+    return analyzeFaces(img, faces, opts);
+}
@@ -1,9 +1,15 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
 #include <opencv2/opencv.hpp>
 #include <dlib/image_processing/frontal_face_detector.h>
 #include <dlib/image_processing/shape_predictor.h>
 #include <dlib/opencv.h>
 #include <dlib/image_io.h>
 #include "FaceSegmentation.h"
+#include "LandmarkModel.h"
+#include "TaskPool.h"
 
 using namespace cv;
 using namespace std;
@@ -52,88 +58,323 @@ static dlib::rectangle expandEyeBox( const dlib::full_object_detection& shape, c
 }
 
 /**
- @brief Extracts the left and right eye regions from a detected face image.
-  dlib library to extract the left and right eyes Which are further send down for pupil extraction
- This function performs facial landmark detection, identifies the eye landmarks,
- and then crops and possibly normalizes the image patches corresponding to the eyes.
- @param imagePath Path to the input image file containing a face.
- @param leftEye Output parameter: The extracted image patch containing the left eye.
- @param rightEye Output parameter: The extracted image patch containing the right eye.
- @param leftLandmarks Output parameter: A vector of specific landmark points (e.g., dlib indices) found for the left eye.
- @param rightLandmarks Output parameter: A vector of specific landmark points (e.g., dlib indices) found for the right eye.
- @return bool Returns true if the eyes were successfully extracted and landmarks were found, false otherwise.
+ @brief Copy of the landmark model owned by one NUMA node, built by the first worker of the
+ node that needs it so that its pages are allocated in the node's memory.
  */
-bool extractEyesFromFace(const string& imagePath, Mat& leftEye, Mat& rightEye, std::vector<Point>& leftLandmarks, std::vector<Point>& rightLandmarks)
+struct LandmarkReplica
 {
-    dlib::array2d<dlib::rgb_pixel> img;
-    try { load_image(img, imagePath); }
-    catch (...) { 
-        cout<<"Image loading failed";
-        return false; 
+    FlatShapePredictor flat;
+    dlib::shape_predictor sp;
+
+    LandmarkReplica()
+    {
+        if (!flat.open("shape_predictor_68_face_landmarks.flat", true))
+            dlib::deserialize("shape_predictor_68_face_landmarks.dat") >> sp;
     }
 
-    dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
-    dlib::shape_predictor sp;
-    dlib::deserialize("shape_predictor_68_face_landmarks.dat") >> sp;
+    dlib::full_object_detection operator()(const dlib::cv_image<dlib::bgr_pixel>& img,
+                                           const dlib::rectangle& box) const
+    {
+        return flat.isOpen() ? flat(img, box) : sp(img, box);
+    }
+};
 
-    auto dets = detector(img);
-    if (dets.empty()) return false;
+static const int kMaxReplicas = 16;
+
+/**
+ @brief Predicts the 68 landmarks of a face with the model shared by every thread, loaded
+ once on first use. The flat model written by "batchProcess convert-model" is memory
+ mapped when it is present, which costs next to nothing and shares the model pages between
+ processes; otherwise the dlib model is deserialized into the heap of this process.
+ Workers of a pool pinned over several NUMA nodes use the replica of their node instead,
+ so the model is never read across sockets.
+ Both predictors are const and may be called concurrently.
+ */
+static dlib::full_object_detection predictLandmarks(const dlib::cv_image<dlib::bgr_pixel>& img,
+                                                    const dlib::rectangle& box)
+{
+    const int node = TaskPool::currentNode();
+    if (node >= 0 && node < kMaxReplicas) {
+        static std::unique_ptr<LandmarkReplica> replicas[kMaxReplicas];
+        static std::once_flag loaded[kMaxReplicas];
+        std::call_once(loaded[node], [node]() { replicas[node].reset(new LandmarkReplica()); });
+        return (*replicas[node])(img, box);
+    }
 
-    dlib::full_object_detection shape = sp(img, dets[0]);
+    static const FlatShapePredictor flat("shape_predictor_68_face_landmarks.flat");
+    if (flat.isOpen())
+        return flat(img, box);
 
-    vector<int> leftIdx  = {36,37,38,39,40,41};
-    vector<int> rightIdx = {42,43,44,45,46,47};
+    static const dlib::shape_predictor sp = []() {
+        dlib::shape_predictor model;
+        dlib::deserialize("shape_predictor_68_face_landmarks.dat") >> model;
+        return model;
+    }();
+    return sp(img, box);
+}
 
-    int W = img.nc(), H = img.nr();
+static Rect toCvRect(const dlib::rectangle& r)
+{
+    return Rect((int)r.left(), (int)r.top(), (int)r.width(), (int)r.height());
+}
 
-    auto Lrect = expandEyeBox(shape, leftIdx,  W, H);
-    auto Rrect = expandEyeBox(shape, rightIdx, W, H);
+static dlib::rectangle toDlibRect(const Rect& r)
+{
+    return dlib::rectangle(r.x, r.y, r.x + r.width - 1, r.y + r.height - 1);
+}
 
-    dlib::array2d<dlib::rgb_pixel> Limg, Rimg;
-    assign_image(Limg, sub_image(img, Lrect));
-    assign_image(Rimg, sub_image(img, Rrect));
+/**
+ @brief Copies the landmarks of one eye into crop coordinates, dropping points that fall outside the crop.
+ @param shape dlib facial landmark detection result.
+ @param idx Landmark indices of the eye.
+ @param crop Location of the eye crop in the source image.
+ @param landmarks Output parameter: the landmarks relative to the crop origin.
+ */
+static void eyeLandmarksInCrop(const dlib::full_object_detection& shape, const vector<int>& idx,
+                               const Rect& crop, vector<Point>& landmarks)
+{
+    landmarks.clear();
+    for (int i : idx) {
+        int x = (int)shape.part(i).x() - crop.x;
+        int y = (int)shape.part(i).y() - crop.y;
 
-    leftEye  = Mat(Limg.nr(), Limg.nc(), CV_8UC3);
-    rightEye = Mat(Rimg.nr(), Rimg.nc(), CV_8UC3);
+        if (x >= 0 && y >= 0 && x < crop.width && y < crop.height)
+            landmarks.emplace_back(x, y);
+    }
+}
 
-    for (long r = 0; r < Limg.nr(); r++)
-        for (long c = 0; c < Limg.nc(); c++)
-            leftEye.at<Vec3b>(r,c) =
-                Vec3b(Limg[r][c].blue, Limg[r][c].green, Limg[r][c].red);
+// A pyramid level larger than this many pixels is scanned as several bands.
+static const int kBandPixels = 640 * 480;
 
-    for (long r = 0; r < Rimg.nr(); r++)
-        for (long c = 0; c < Rimg.nc(); c++)
-            rightEye.at<Vec3b>(r,c) =
-                Vec3b(Rimg[r][c].blue, Rimg[r][c].green, Rimg[r][c].red);
+/**
+ @brief The frontal face detector restricted to the first level of its pyramid, so that
+ each level of a pyramid built outside of dlib can be scanned by a separate task.
+ Same weights and overlap tester as the full detector.
+ */
+static dlib::frontal_face_detector singleLevelDetector()
+{
+    dlib::frontal_face_detector full = dlib::get_frontal_face_detector();
+    auto scanner = full.get_scanner();
+    scanner.set_max_pyramid_levels(1);
+    std::vector<dlib::frontal_face_detector::feature_vector_type> w;
+    for (unsigned long i = 0; i < full.num_detectors(); i++)
+        w.push_back(full.get_w(i));
+    return dlib::frontal_face_detector(scanner, full.get_overlap_tester(), w);
+}
 
-    leftLandmarks.clear();
-    rightLandmarks.clear();
+/**
+ @brief Scale of the image the detector scans first: opts.scale, doubled opts.upsample times.
+ */
+static double detectionScale(const FaceDetectOptions& opts)
+{
+    double scale = opts.scale > 0 ? opts.scale : 1.0;
+    return scale * std::pow(2.0, std::max(0, opts.upsample));
+}
 
-    for (int idx : leftIdx) {
-        Point p(shape.part(idx).x(), shape.part(idx).y());
+/**
+ @brief Maps a detection box found in an image scaled by scale and shifted by offset back
+ to the original image.
+ */
+static dlib::rectangle unscaleRect(const dlib::rectangle& r, double scale, const Point& offset)
+{
+    return dlib::rectangle((long)std::floor((r.left() + offset.x) / scale),
+                           (long)std::floor((r.top() + offset.y) / scale),
+                           (long)std::ceil((r.right() + offset.x) / scale),
+                           (long)std::ceil((r.bottom() + offset.y) / scale));
+}
 
-        int x = p.x - Lrect.left();
-        int y = p.y - Lrect.top();
+/**
+ @brief Parallel pyramid scan: every level, and every band of the large levels, runs as
+ its own task with a single level detector; the detections of all tasks are merged with
+ the detector's own overlap test, best first.
+ @param imageBgr The input image.
+ @param opts Downscale factor and upsampling.
+ @return the detections in original image coordinates, unsorted
+ */
+static std::vector<dlib::rect_detection> detectParallel(const Mat& imageBgr, const FaceDetectOptions& opts)
+{
+    // levels are built up front so that the tasks only read them
+    static const dlib::frontal_face_detector reference = singleLevelDetector();
+    const int winW = (int)reference.get_scanner().get_detection_window_width();
+    const int winH = (int)reference.get_scanner().get_detection_window_height();
+    double ratio = (opts.downscale > 0 && opts.downscale < 1) ? opts.downscale : 5.0 / 6.0;
 
-        if (x >= 0 && y >= 0 &&
-            x < leftEye.cols && y < leftEye.rows)
-        {
-            leftLandmarks.emplace_back(x, y);
+    std::vector<Mat> levels;
+    std::vector<double> scales;
+    double scale = detectionScale(opts);
+    while (imageBgr.cols * scale >= winW && imageBgr.rows * scale >= winH) {
+        Mat level;
+        if (scale == 1.0) level = imageBgr;
+        else resize(imageBgr, level, Size(), scale, scale, scale < 1.0 ? INTER_AREA : INTER_LINEAR);
+        levels.push_back(level);
+        scales.push_back(scale);
+        scale *= ratio;
+    }
+
+    // bands overlap by a detection window plus two HOG cells so that every window lies inside a band
+    struct Job { int level; Rect band; };
+    std::vector<Job> jobs;
+    for (size_t l = 0; l < levels.size(); l++) {
+        const Mat& level = levels[l];
+        int bands = std::min((int)(level.total() / kBandPixels) + 1, std::max(1, level.rows / (2 * winH)));
+        int overlap = winH + 16;
+        for (int b = 0; b < bands; b++) {
+            int y0 = level.rows * b / bands;
+            int y1 = std::min(level.rows, level.rows * (b + 1) / bands + (b + 1 < bands ? overlap : 0));
+            jobs.push_back({(int)l, Rect(0, y0, level.cols, y1 - y0)});
         }
     }
 
-    for (int idx : rightIdx) {
-        Point p(shape.part(idx).x(), shape.part(idx).y());
+    std::vector<std::vector<dlib::rect_detection>> found(jobs.size());
+    std::vector<std::future<void>> tasks;
+    TaskPool& pool = TaskPool::shared();
+    for (size_t j = 0; j < jobs.size(); j++) {
+        tasks.push_back(pool.submit([&, j]() {
+            // the detector keeps scratch buffers between calls, so each thread owns one
+            thread_local dlib::frontal_face_detector detector = singleLevelDetector();
+            const Job& job = jobs[j];
+            Mat band = levels[job.level](job.band);
+            if (!band.isContinuous()) band = band.clone();
+            dlib::cv_image<dlib::bgr_pixel> img(band);
+            detector(img, found[j]);
+            for (auto& d : found[j])
+                d.rect = unscaleRect(d.rect, scales[job.level], job.band.tl());
+        }));
+    }
+    pool.waitAll(tasks);
 
-        int x = p.x - Rrect.left();
-        int y = p.y - Rrect.top();
+    std::vector<dlib::rect_detection> all;
+    for (auto& v : found)
+        all.insert(all.end(), v.begin(), v.end());
+    std::stable_sort(all.begin(), all.end(),
+                     [](const dlib::rect_detection& a, const dlib::rect_detection& b) {
+                         return a.detection_confidence > b.detection_confidence;
+                     });
 
-        if (x >= 0 && y >= 0 &&
-            x < rightEye.cols && y < rightEye.rows)
-        {
-            rightLandmarks.emplace_back(x, y);
-        }
+    const dlib::test_box_overlap& overlaps = reference.get_overlap_tester();
+    std::vector<dlib::rect_detection> kept;
+    for (const auto& d : all) {
+        bool duplicate = false;
+        for (const auto& k : kept)
+            if (overlaps(d.rect, k.rect)) { duplicate = true; break; }
+        if (!duplicate)
+            kept.push_back(d);
+    }
+    return kept;
+}
+
+/**
+ @brief Runs the dlib frontal face detector on a BGR image.
+ @param imageBgr The input image.
+ @param maxFaces Keep only the top-K faces by detection score, 0 keeps every face.
+ @param opts Pyramid scanning options.
+ @return detected faces sorted by decreasing detection score
+ */
+vector<DetectedFace> detectFaces(const Mat& imageBgr, int maxFaces, const FaceDetectOptions& opts)
+{
+    if (checkQuality(imageBgr, opts.quality, QualityStage::Frame) != QualityVerdict::Pass)
+        return {};
+
+    std::vector<dlib::rect_detection> dets;
+    if (opts.parallel) {
+        dets = detectParallel(imageBgr, opts);
+    } else {
+        // The detector keeps scratch buffers between calls, so each thread owns one.
+        thread_local dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
+
+        double scale = detectionScale(opts);
+        Mat scaled = imageBgr;
+        if (scale != 1.0)
+            resize(imageBgr, scaled, Size(), scale, scale, scale < 1.0 ? INTER_AREA : INTER_LINEAR);
+        dlib::cv_image<dlib::bgr_pixel> img(scaled);
+        detector(img, dets);
+        if (scale != 1.0)
+            for (auto& d : dets)
+                d.rect = unscaleRect(d.rect, scale, Point(0, 0));
+    }
+
+    std::stable_sort(dets.begin(), dets.end(),
+                     [](const dlib::rect_detection& a, const dlib::rect_detection& b) {
+                         return a.detection_confidence > b.detection_confidence;
+                     });
+    if (maxFaces > 0 && (int)dets.size() > maxFaces)
+        dets.resize(maxFaces);
+
+    vector<DetectedFace> faces;
+    for (const auto& d : dets) {
+        DetectedFace f;
+        f.box = toCvRect(d.rect);
+        f.score = d.detection_confidence;
+        faces.push_back(f);
     }
+    return faces;
+}
+
+/**
+ @brief Runs the landmark predictor on one detected face and crops both eyes.
+ Safe to call concurrently for different faces of the same image.
+ @param imageBgr The image the face was detected in.
+ @param face The face box returned by detectFaces.
+ @param eyes Output parameter: crops, crop rectangles and eye landmarks.
+ @return bool Returns true if both eye crops are non empty.
+ */
+bool extractEyesForFace(const Mat& imageBgr, const DetectedFace& face, EyePair& eyes)
+{
+    dlib::cv_image<dlib::bgr_pixel> img(imageBgr);
+    dlib::full_object_detection shape = predictLandmarks(img, toDlibRect(face.box));
+
+    static const vector<int> leftIdx  = {36,37,38,39,40,41};
+    static const vector<int> rightIdx = {42,43,44,45,46,47};
+
+    int W = imageBgr.cols, H = imageBgr.rows;
+
+    eyes.leftRect  = toCvRect(expandEyeBox(shape, leftIdx,  W, H));
+    eyes.rightRect = toCvRect(expandEyeBox(shape, rightIdx, W, H));
+
+    // a face cut by the image border can leave an empty eye box
+    if (eyes.leftRect.width <= 0 || eyes.leftRect.height <= 0 ||
+        eyes.rightRect.width <= 0 || eyes.rightRect.height <= 0)
+        return false;
+
+    eyes.left  = imageBgr(eyes.leftRect).clone();
+    eyes.right = imageBgr(eyes.rightRect).clone();
+
+    eyeLandmarksInCrop(shape, leftIdx,  eyes.leftRect,  eyes.leftLandmarks);
+    eyeLandmarksInCrop(shape, rightIdx, eyes.rightRect, eyes.rightLandmarks);
+
+    return true;
+}
+
+/**
+ @brief Extracts the left and right eye regions from a detected face image.
+  dlib library to extract the left and right eyes Which are further send down for pupil extraction
+ This function performs facial landmark detection, identifies the eye landmarks,
+ and then crops and possibly normalizes the image patches corresponding to the eyes.
+ Only the face with the highest detection score is used.
+ @param imagePath Path to the input image file containing a face.
+ @param leftEye Output parameter: The extracted image patch containing the left eye.
+ @param rightEye Output parameter: The extracted image patch containing the right eye.
+ @param leftLandmarks Output parameter: A vector of specific landmark points (e.g., dlib indices) found for the left eye.
+ @param rightLandmarks Output parameter: A vector of specific landmark points (e.g., dlib indices) found for the right eye.
+ @return bool Returns true if the eyes were successfully extracted and landmarks were found, false otherwise.
+ */
+bool extractEyesFromFace(const string& imagePath, Mat& leftEye, Mat& rightEye, std::vector<Point>& leftLandmarks, std::vector<Point>& rightLandmarks)
+{
+    // dlib::load_image ignores EXIF orientation, keep that behaviour
+    Mat img = imread(imagePath, IMREAD_COLOR | IMREAD_IGNORE_ORIENTATION);
+    if (img.empty())
+        return false;
+
+    vector<DetectedFace> dets = detectFaces(img, 1);
+    if (dets.empty()) return false;
+
+    EyePair eyes;
+    if (!extractEyesForFace(img, dets[0], eyes)) return false;
+
+    leftEye = eyes.left;
+    rightEye = eyes.right;
+    leftLandmarks = eyes.leftLandmarks;
+    rightLandmarks = eyes.rightLandmarks;
 
     return true;
 }
@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <sstream>
+#include "JsonLines.h"
+#include "TaskPool.h"
+
+using namespace cv;
+using std::string;
+using std::vector;
+using Clock = std::chrono::steady_clock;
+
+bool parseStreamInput(const string& name, StreamInput& input)
+{
+    if (name == "paths")      input = StreamInput::Paths;
+    else if (name == "blobs") input = StreamInput::Blobs;
+    else return false;
+    return true;
+}
+
+const char* streamInputName(StreamInput input)
+{
+    switch (input) {
+    case StreamInput::Paths: return "paths";
+    case StreamInput::Blobs: return "blobs";
+    }
+    return "?";
+}
+
+bool parseStreamOrder(const string& name, StreamOrder& order)
+{
+    if (name == "input")           order = StreamOrder::Input;
+    else if (name == "completion") order = StreamOrder::Completion;
+    else return false;
+    return true;
+}
+
+const char* streamOrderName(StreamOrder order)
+{
+    switch (order) {
+    case StreamOrder::Input:      return "input";
+    case StreamOrder::Completion: return "completion";
+    }
+    return "?";
+}
+
+string jsonString(const string& s)
+{
+    string out = "\"";
+    for (unsigned char c : s) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += (char)c;
+            }
+        }
+    }
+    return out + "\"";
+}
+
+string eyeResultJson(const EyeResult& eye)
+{
+    if (!eye.found) return "{\"found\":false}";
+    std::ostringstream js;
+    js << "{\"found\":true,\"biou\":" << eye.biou
+       << ",\"center\":[" << eye.center.x + eye.cropRect.x << "," << eye.center.y + eye.cropRect.y << "]"
+       << ",\"radius\":" << eye.radius
+       << ",\"tracked\":" << (eye.tracked ? "true" : "false") << "}";
+    return js.str();
+}
+
+string faceResultsJson(const vector<FaceResult>& faces)
+{
+    std::ostringstream js;
+    js << "[";
+    for (size_t i = 0; i < faces.size(); i++) {
+        const FaceResult& f = faces[i];
+        js << (i ? "," : "")
+           << "{\"index\":" << f.index
+           << ",\"detection_score\":" << f.detectionScore
+           << ",\"box\":[" << f.faceBox.x << "," << f.faceBox.y << "," << f.faceBox.width << "," << f.faceBox.height << "]"
+           << ",\"biou\":" << f.biou()
+           << ",\"left\":" << eyeResultJson(f.left)
+           << ",\"right\":" << eyeResultJson(f.right) << "}";
+    }
+    js << "]";
+    return js.str();
+}
+
+namespace {
+
+/**
+ * @brief
+ * One item read from the input. An item that cannot be analysed (too large) carries its
+ * status so that its line still comes out in its place.
+ */
+struct StreamItem
+{
+    uint64_t seq = 0;
+    string path;                        // Paths input
+    string id;                          // Blobs input, from the header, may be empty
+    vector<unsigned char> bytes;        // Blobs input
+    const char* error = nullptr;
+};
+
+struct StreamReply
+{
+    string line;
+    bool ok = false;
+};
+
+enum class ReadResult { Item, End, BadHeader, Truncated };
+
+}
+
+/**
+ * @brief
+ * Reads the next item: the next non blank line for paths, a header and its payload for blobs.
+ */
+static ReadResult readItem(std::istream& in, const StreamOptions& opts, StreamItem& item)
+{
+    string line;
+    do {
+        if (!std::getline(in, line)) return ReadResult::End;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+    } while (line.empty());
+
+    if (opts.input == StreamInput::Paths) {
+        item.path = line;
+        return ReadResult::Item;
+    }
+
+    // blob header: decimal byte count, optionally followed by an id
+    if (!isdigit((unsigned char)line[0])) return ReadResult::BadHeader;
+    std::istringstream header(line);
+    unsigned long long size = 0;
+    if (!(header >> size)) return ReadResult::BadHeader;
+    header >> item.id;
+
+    if (size > opts.maxBlobBytes) {
+        in.ignore((std::streamsize)size);
+        if ((unsigned long long)in.gcount() < size) return ReadResult::Truncated;
+        item.error = "too_large";
+        return ReadResult::Item;
+    }
+    item.bytes.resize((size_t)size);
+    in.read(reinterpret_cast<char*>(item.bytes.data()), (std::streamsize)size);
+    if ((unsigned long long)in.gcount() < size) return ReadResult::Truncated;
+    return ReadResult::Item;
+}
+
+/**
+ * @brief
+ * Opening fields of a result line, up to and including the status.
+ */
+static string replyHead(const StreamItem& item, const char* status)
+{
+    std::ostringstream js;
+    js << "{\"seq\":" << item.seq;
+    if (!item.path.empty()) js << ",\"path\":" << jsonString(item.path);
+    if (!item.id.empty()) js << ",\"id\":" << jsonString(item.id);
+    js << ",\"status\":\"" << status << "\"";
+    return js.str();
+}
+
+/**
+ * @brief
+ * Decodes and analyses one item and formats its result line. Never throws.
+ */
+static StreamReply analyzeItem(const StreamItem& item, const Pipeline& pipeline, const StreamOptions& opts)
+{
+    StreamReply reply;
+    if (item.error) {
+        reply.line = replyHead(item, item.error) + "}";
+        return reply;
+    }
+
+    auto start = Clock::now();
+    try {
+        // dlib::load_image ignores EXIF orientation, keep that behaviour
+        const int flags = IMREAD_COLOR | IMREAD_IGNORE_ORIENTATION;
+        Mat img = item.bytes.empty() ? imread(item.path, flags) : imdecode(item.bytes, flags);
+        if (img.empty()) {
+            reply.line = replyHead(item, "decode_failed") + "}";
+            return reply;
+        }
+
+        std::ostringstream body;
+        const char* status;
+        if (opts.eyes) {
+            EyeResult eye;
+            reply.ok = pipeline.processEye(img, eye);
+            status = reply.ok ? "ok" : "no_pupil";
+            body << ",\"biou\":" << (reply.ok ? eye.biou : -1.0) << ",\"eye\":" << eyeResultJson(eye);
+        } else {
+            vector<FaceResult> faces;
+            pipeline.processImage(img, faces);
+
+            // the file score of batchProcess: mean over the faces with a scored eye
+            double sum = 0;
+            int scored = 0;
+            for (const FaceResult& f : faces) {
+                if (f.biou() < 0) continue;
+                sum += f.biou();
+                scored++;
+            }
+            reply.ok = scored > 0;
+            status = reply.ok ? "ok" : faces.empty() ? "no_face" : "no_pupil";
+            body << ",\"biou\":" << (reply.ok ? sum / scored : -1.0) << ",\"faces\":" << faceResultsJson(faces);
+        }
+
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        std::ostringstream head;
+        head << replyHead(item, status) << ",\"ms\":" << std::round(ms * 10) / 10;
+        reply.line = head.str() + body.str() + "}";
+    } catch (const std::exception&) {
+        reply.ok = false;
+        reply.line = replyHead(item, "internal_error") + "}";
+    }
+    return reply;
+}
+
+bool serveJsonLines(std::istream& in, std::ostream& out, const Pipeline& pipeline,
+                    const StreamOptions& opts, StreamStats& stats)
+{
+    TaskPool& pool = TaskPool::shared();
+    const size_t limit = opts.maxInFlight > 0 ? opts.maxInFlight : 2 * (size_t)std::max(1u, pool.size());
+    const int nodes = pool.nodeCount();
+    stats = StreamStats();
+    stats.maxInFlight = limit;
+    auto start = Clock::now();
+
+    // lines are flushed one by one so that the next stage of a pipe sees them at once
+    std::mutex outMtx;
+    std::condition_variable drained;
+    size_t inFlight = 0;                                // Completion order
+    std::deque<std::future<void>> running;              // Completion order, pruned as they finish
+    std::deque<std::future<StreamReply>> pending;       // Input order, oldest first
+    auto write = [&](const StreamReply& reply) {
+        out << reply.line << '\n';
+        out.flush();
+        stats.items++;
+        if (reply.ok) stats.ok++;
+    };
+    auto ready = [](const std::future<void>& f) {
+        return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    };
+
+    ReadResult result = ReadResult::End;
+    try {
+        for (uint64_t seq = 0;; seq++) {
+            StreamItem item;
+            item.seq = seq;
+            result = readItem(in, opts, item);
+            if (result != ReadResult::Item) break;
+
+            // with --pin on the tasks of an item stay on one node, items in turn
+            TaskPool::NodeScope onNode((int)(seq % nodes));
+
+            if (opts.order == StreamOrder::Completion) {
+                {
+                    std::unique_lock<std::mutex> lock(outMtx);
+                    drained.wait(lock, [&]() { return inFlight < limit; });
+                    inFlight++;
+                }
+                running.erase(std::remove_if(running.begin(), running.end(), ready), running.end());
+                running.push_back(pool.submit([&, item]() {
+                    StreamReply reply = analyzeItem(item, pipeline, opts);
+                    {
+                        std::lock_guard<std::mutex> lock(outMtx);
+                        write(reply);
+                        inFlight--;
+                    }
+                    drained.notify_all();
+                }));
+                continue;
+            }
+
+            // input order: the oldest item is written first, whatever finishes before it waits
+            while (pending.size() >= limit) {
+                write(pool.wait(pending.front()));
+                pending.pop_front();
+            }
+            pending.push_back(pool.submit([&, item]() { return analyzeItem(item, pipeline, opts); }));
+            while (!pending.empty() && pending.front().wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                write(pending.front().get());
+                pending.pop_front();
+            }
+        }
+
+        while (!pending.empty()) {
+            write(pool.wait(pending.front()));
+            pending.pop_front();
+        }
+        pool.waitAll(running);
+    } catch (...) {
+        // the tasks still queued write through the locals above: they must finish first
+        try {
+            pool.waitAll(pending);
+        } catch (...) {
+        }
+        try {
+            pool.waitAll(running);
+        } catch (...) {
+        }
+        throw;
+    }
+
+    if (result == ReadResult::BadHeader || result == ReadResult::Truncated) {
+        StreamItem last;
+        last.seq = stats.items;
+        StreamReply reply;
+        reply.line = replyHead(last, result == ReadResult::BadHeader ? "bad_header" : "truncated") + "}";
+        write(reply);
+    }
+
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return result == ReadResult::End;
+}
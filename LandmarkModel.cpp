@@ -0,0 +1,286 @@
+#include <cstring>
+#include <initializer_list>
+#include <fstream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "LandmarkModel.h"
+
+using namespace std;
+
+static const char kModelMagic[8] = {'I', 'F', 'S', 'H', 'A', 'P', 'E', '\0'};
+static const uint32_t kModelVersion = 1;
+static const uint64_t kSectionAlign = 64;
+
+// on disk layout, host byte order
+struct ModelHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t parts;             // landmarks; shapes hold 2 * parts floats
+    uint32_t cascades;
+    uint32_t trees;             // per cascade
+    uint32_t splitsPerTree;     // complete trees: splitsPerTree + 1 leaves
+    uint32_t features;          // feature pixels per cascade
+    uint64_t initialShapeOffset;
+    uint64_t anchorsOffset;
+    uint64_t deltasOffset;
+    uint64_t splitsOffset;
+    uint64_t leavesOffset;
+};
+
+struct FlatSplit
+{
+    uint32_t idx1, idx2;
+    float thresh;
+};
+
+static void padTo(ofstream& out, uint64_t& pos)
+{
+    static const char zeros[kSectionAlign] = {};
+    uint64_t pad = (kSectionAlign - pos % kSectionAlign) % kSectionAlign;
+    out.write(zeros, (streamsize)pad);
+    pos += pad;
+}
+
+template <typename T>
+static uint64_t writeSection(ofstream& out, uint64_t& pos, const vector<T>& data)
+{
+    padTo(out, pos);
+    uint64_t offset = pos;
+    out.write((const char*)data.data(), (streamsize)(data.size() * sizeof(T)));
+    pos += data.size() * sizeof(T);
+    return offset;
+}
+
+bool convertLandmarkModel(const string& datPath, const string& flatPath)
+{
+    // the fields of dlib's shape_predictor, read in the order its serialize() writes them
+    int version = 0;
+    dlib::matrix<float, 0, 1> initialShape;
+    vector<vector<dlib::impl::regression_tree>> forests;
+    vector<vector<unsigned long>> anchorIdx;
+    vector<vector<dlib::vector<float, 2>>> pixelDeltas;
+    try {
+        ifstream in(datPath, ios::binary);
+        if (!in) return false;
+        dlib::deserialize(version, in);
+        if (version != 1) return false;
+        dlib::deserialize(initialShape, in);
+        dlib::deserialize(forests, in);
+        dlib::deserialize(anchorIdx, in);
+        dlib::deserialize(pixelDeltas, in);
+    } catch (const dlib::serialization_error&) {
+        return false;
+    }
+
+    ModelHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, kModelMagic, sizeof(h.magic));
+    h.version = kModelVersion;
+    h.parts = (uint32_t)(initialShape.size() / 2);
+    h.cascades = (uint32_t)forests.size();
+    if (h.cascades == 0 || anchorIdx.size() != forests.size() || pixelDeltas.size() != forests.size())
+        return false;
+    h.trees = (uint32_t)forests[0].size();
+    h.splitsPerTree = h.trees ? (uint32_t)forests[0][0].splits.size() : 0;
+    h.features = (uint32_t)anchorIdx[0].size();
+
+    vector<float> shape, deltas, leaves;
+    vector<uint32_t> anchors;
+    vector<FlatSplit> splits;
+    for (long k = 0; k < initialShape.size(); k++)
+        shape.push_back(initialShape(k));
+
+    for (uint32_t c = 0; c < h.cascades; c++) {
+        if (forests[c].size() != h.trees || anchorIdx[c].size() != h.features ||
+            pixelDeltas[c].size() != h.features)
+            return false;
+        for (uint32_t i = 0; i < h.features; i++) {
+            anchors.push_back((uint32_t)anchorIdx[c][i]);
+            deltas.push_back(pixelDeltas[c][i].x());
+            deltas.push_back(pixelDeltas[c][i].y());
+        }
+        for (const dlib::impl::regression_tree& tree : forests[c]) {
+            if (tree.splits.size() != h.splitsPerTree || tree.leaf_values.size() != h.splitsPerTree + 1)
+                return false;
+            for (const auto& s : tree.splits)
+                splits.push_back({(uint32_t)s.idx1, (uint32_t)s.idx2, s.thresh});
+            for (const auto& leaf : tree.leaf_values) {
+                if (leaf.size() != initialShape.size()) return false;
+                for (long k = 0; k < leaf.size(); k++)
+                    leaves.push_back(leaf(k));
+            }
+        }
+    }
+
+    ofstream out(flatPath, ios::binary);
+    if (!out) return false;
+    out.write((const char*)&h, sizeof(h));
+    uint64_t pos = sizeof(h);
+    h.initialShapeOffset = writeSection(out, pos, shape);
+    h.anchorsOffset = writeSection(out, pos, anchors);
+    h.deltasOffset = writeSection(out, pos, deltas);
+    h.splitsOffset = writeSection(out, pos, splits);
+    h.leavesOffset = writeSection(out, pos, leaves);
+
+    out.seekp(0);
+    out.write((const char*)&h, sizeof(h));
+    return (bool)out;
+}
+
+FlatShapePredictor::~FlatShapePredictor()
+{
+    close();
+}
+
+void FlatShapePredictor::close()
+{
+    if (base)
+        munmap((void*)base, length);
+    base = nullptr;
+    length = 0;
+    parts = cascades = trees = splitsPerTree = features = 0;
+    anchors = nullptr;
+    deltas = nullptr;
+    splits = nullptr;
+    leaves = nullptr;
+}
+
+/**
+ * @brief
+ * True if count elements of size bytes starting at offset lie inside a mapping of length bytes.
+ */
+static bool inside(uint64_t offset, uint64_t count, uint64_t size, size_t length)
+{
+    return offset <= length && (size == 0 || count <= (length - offset) / size);
+}
+
+/**
+ * @brief
+ * Product of the factors, false if it overflows 64 bits.
+ */
+static bool product(std::initializer_list<uint64_t> factors, uint64_t& out)
+{
+    out = 1;
+    for (uint64_t f : factors) {
+        if (f != 0 && out > UINT64_MAX / f) return false;
+        out *= f;
+    }
+    return true;
+}
+
+bool FlatShapePredictor::open(const string& path, bool privateCopy)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ModelHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void* map;
+    if (privateCopy) {
+        map = mmap(nullptr, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        size_t done = 0;
+        while (map != MAP_FAILED && done < (size_t)st.st_size) {
+            ssize_t n = ::read(fd, (char*)map + done, (size_t)st.st_size - done);
+            if (n <= 0) {
+                munmap(map, (size_t)st.st_size);
+                map = MAP_FAILED;
+            } else {
+                done += (size_t)n;
+            }
+        }
+    } else {
+        map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+    base = (const unsigned char*)map;
+    length = (size_t)st.st_size;
+
+    const ModelHeader* h = (const ModelHeader*)base;
+    uint64_t anchorCount = (uint64_t)h->cascades * h->features;
+    uint64_t splitCount, leafFloats;
+    if (memcmp(h->magic, kModelMagic, sizeof(h->magic)) != 0 || h->version != kModelVersion ||
+        h->parts == 0 ||
+        !product({h->cascades, h->trees, h->splitsPerTree}, splitCount) ||
+        !product({h->cascades, h->trees, (uint64_t)h->splitsPerTree + 1, 2, h->parts}, leafFloats) ||
+        !inside(h->initialShapeOffset, 2 * (uint64_t)h->parts, sizeof(float), length) ||
+        !inside(h->anchorsOffset, anchorCount, sizeof(uint32_t), length) ||
+        !inside(h->deltasOffset, 2 * anchorCount, sizeof(float), length) ||
+        !inside(h->splitsOffset, splitCount, sizeof(FlatSplit), length) ||
+        !inside(h->leavesOffset, leafFloats, sizeof(float), length)) {
+        close();
+        return false;
+    }
+
+    const uint32_t* a = (const uint32_t*)(base + h->anchorsOffset);
+    for (uint64_t i = 0; i < anchorCount; i++)
+        if (a[i] >= h->parts) { close(); return false; }
+    const FlatSplit* s = (const FlatSplit*)(base + h->splitsOffset);
+    for (uint64_t i = 0; i < splitCount; i++)
+        if (s[i].idx1 >= h->features || s[i].idx2 >= h->features) { close(); return false; }
+
+    parts = h->parts;
+    cascades = h->cascades;
+    trees = h->trees;
+    splitsPerTree = h->splitsPerTree;
+    features = h->features;
+    anchors = a;
+    deltas = (const float*)(base + h->deltasOffset);
+    splits = s;
+    leaves = (const float*)(base + h->leavesOffset);
+
+    const float* shape = (const float*)(base + h->initialShapeOffset);
+    initialShape.set_size(2 * parts);
+    for (unsigned long k = 0; k < 2 * parts; k++)
+        initialShape(k) = shape[k];
+    return true;
+}
+
+dlib::full_object_detection FlatShapePredictor::operator()(const dlib::cv_image<dlib::bgr_pixel>& img,
+                                                           const dlib::rectangle& rect) const
+{
+    // the cascade of dlib::shape_predictor::operator() and impl::extract_feature_pixel_values
+    dlib::matrix<float, 0, 1> shape = initialShape;
+    const dlib::point_transform_affine toImage = dlib::impl::unnormalizing_tform(rect);
+    const dlib::rectangle area = dlib::get_rect(img);
+    vector<float> pixels(features);
+    const unsigned long leafSize = 2 * parts;
+
+    for (unsigned long c = 0; c < cascades; c++) {
+        const dlib::matrix<float, 2, 2> tform =
+            dlib::matrix_cast<float>(dlib::impl::find_tform_between_shapes(initialShape, shape).get_m());
+        const uint32_t* anchor = anchors + c * features;
+        const float* delta = deltas + 2 * c * features;
+        for (unsigned long i = 0; i < features; i++) {
+            dlib::vector<float, 2> d(delta[2 * i], delta[2 * i + 1]);
+            dlib::point p = toImage(tform * d + dlib::impl::location(shape, anchor[i]));
+            pixels[i] = area.contains(p) ? dlib::get_pixel_intensity(img[p.y()][p.x()]) : 0;
+        }
+
+        for (unsigned long t = 0; t < trees; t++) {
+            size_t tree = c * trees + t;
+            const FlatSplit* split = splits + tree * splitsPerTree;
+            unsigned long i = 0;
+            while (i < splitsPerTree)
+                i = (pixels[split[i].idx1] - pixels[split[i].idx2] > split[i].thresh) ? 2 * i + 1 : 2 * i + 2;
+            const float* leaf = leaves + (tree * (splitsPerTree + 1) + (i - splitsPerTree)) * leafSize;
+            for (unsigned long k = 0; k < leafSize; k++)
+                shape(k) += leaf[k];
+        }
+    }
+
+    vector<dlib::point> points(parts);
+    for (unsigned long i = 0; i < parts; i++)
+        points[i] = toImage(dlib::impl::location(shape, i));
+    return dlib::full_object_detection(rect, points);
+}
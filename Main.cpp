@@ -4,6 +4,15 @@
 #include "EyeSegmentation.h"
 #include "BIoU.h"
 #include "PupilSegment.h"
+#include "FaceAnalysis.h"
+#include "VideoAnalysis.h"
+#include "SequentialTest.h"
+#include "CropArchive.h"
+#include "TaskPool.h"
+#include "Presets.h"
+#include "ResultView.h"
+#include "Pipeline.h"
+#include "JsonLines.h"
 
 using namespace std;
 using namespace cv;
@@ -26,210 +35,249 @@ bool isVideo(const string& p)
 }
 /**
  * @brief 
- * Displays the detected eye region, superimposes the pupil mask, and prints the BIoU score for visual verification.
- * @param eye The input image patch containing the isolated eye region.
- * @param maskGray The grayscale image mask representing the detected pupil
- * @param biou The Bounding Box IoU score calculated for the detected pupil.
+ * Hands the result of one video frame to the display and the annotated video, if any.
+ * @param fr The analysed frame.
+ * @param view Tile size of the composed row.
+ * @param display The display, nullptr when off.
+ * @param writer The annotated video writer, nullptr when off.
  */
-void showEyeAndMask(const Mat& eye, const Mat& maskGray, double biou)
+static void publishFrame(const FrameResult& fr, const ViewOptions& view, ResultDisplay* display,
+                         AnnotatedWriter* writer)
 {
-    Mat maskResized, maskColor, combined;
-
-    if (maskGray.size() != eye.size()) {
-        resize(maskGray, maskResized, eye.size(), 0, 0, INTER_NEAREST);
-    } else {
-        maskResized = maskGray.clone();
-    }
-
-    cvtColor(maskResized, maskColor, COLOR_GRAY2BGR);
-
-    std::string label = "BIoU = " + std::to_string(biou).substr(0, 6);
-    int font = FONT_HERSHEY_SIMPLEX;
-    double fs = 0.6;
-    int th = 2;
-
-    putText(maskColor, label, Point(10, 25),
-                font, fs, Scalar(0, 255, 0), th);
-
-    hconcat(eye, maskColor, combined);
-
-    imshow("Eye + Mask", combined);
-    waitKey(0);
+    if (!display && !writer) return;
+    Mat row = renderFaceRow(fr.faceFound ? &fr.face : nullptr, "Frame " + to_string(fr.index), view.tile);
+    if (display) display->post(row);
+    if (writer) writer->write(row);
 }
 /**
  * @brief 
  * 
  * @param input 
- * @param display 
+ * @param display The display the eye and its mask are posted to, nullptr when off.
+ * @param pipeline Hough parameters, ellipse fit method and eye quality gate.
  */
-void runEyeMode(const string& input, bool display)
+void runEyeMode(const string& input, ResultDisplay* display, const Pipeline& pipeline)
 {
-    Mat eye = imread(input);
-    if (eye.empty()) {
+    Mat img = imread(input);
+    if (img.empty()) {
         cerr << "Could not read input image.\n";
         return;
     }
 
-    Mat norm = normalizeEyeCrop(eye);
-
-    Mat gray; cvtColor(norm, gray, COLOR_BGR2GRAY);
+    EyeResult eye;
+    if (!pipeline.processEye(img, eye)) {
+        cerr << "Pupil not found (or eye crop rejected by the quality gate).\n";
+        return;
+    }
+    cout << "BIoU = " << eye.biou << endl;
 
-    Mat mask;
-    Point center; int radius;
+    if (display)
+        display->post(renderEyePanel(eye.eye, eye.mask, eye.biou));
+}
+/**
+ * @brief Prints the BIoU of one eye of a face, or why it could not be scored.
+ * @param face Rank of the face by detection score.
+ * @param side "Left" or "Right".
+ * @param eye The scored eye.
+ */
+static void printEyeResult(int face, const string& side, const EyeResult& eye)
+{
+    if (eye.found)
+        cout << "Face " << face << " - " << side << " Eye BIoU = " << eye.biou << endl;
+    else
+        cerr << "Face " << face << " - " << side << " pupil not found.\n";
+}
+/**
+ * @brief Processes an image input stream specifically in face detection when
+ * face parameter is used in the commandline argument and extracts eye and pupil from it.
+ * Every detected face (or the top maxFaces of them) is analysed in parallel and reported separately.
+ * @param input Path to the image file or camera device index to be processed.
+ * @param pipeline Face selection (top maxFaces faces, 0 for all faces) and pupil search options.
+ * @param view Tile size of the displayed rows.
+ * @param display The display every face's row is posted to, nullptr when off.
+ */
+void runFaceMode(const string& input, const Pipeline& pipeline, const ViewOptions& view,
+                 ResultDisplay* display)
+{
 
-    if (!findPupilMask(gray, mask, center, radius)) {
-        cerr << "Pupil not found.\n";
+    vector<FaceResult> faces;
+    if (!pipeline.processImageFile(input, faces)) {
+        cerr << "Face/eye extraction failed.\n";
         return;
     }
 
-    // find contour
-    vector<vector<Point>> contours;
-    findContours(mask, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-    if (contours.empty()) {
-        cerr << "No contour found.\n";
-        return;
+    cout << faces.size() << " face(s) analysed\n";
+    for (const auto& f : faces) {
+        cout << "Face " << f.index << " (detection score " << f.detectionScore << ")\n";
+        printEyeResult(f.index, "Left", f.left);
+        printEyeResult(f.index, "Right", f.right);
     }
-    double biou = computeBIoU(mask, contours[0]);
-    cout << "BIoU = " << biou << endl;
 
     if (display) {
-        showEyeAndMask(norm, mask, biou);
+        vector<Mat> rows;
+        for (const auto& f : faces)
+            rows.push_back(renderFaceRow(&f, "Face " + to_string(f.index), view.tile));
+        Mat all;
+        vconcat(rows, all);
+        display->post(all);
     }
 }
 /**
- * @brief Processes an image input stream specifically in face detection when
- * face parameter is used in the commandline argument and extracts eye and pupil from it
- * @param input Path to the image file or camera device index to be processed.
- * @param display Boolean flag to indicate whether the processing results should be displayed in a window.
+ * @brief Prints the BIoU of both eyes of a video frame, or that no face was found.
+ * @param fr The analysed frame.
  */
-void runFaceMode(const string& input, bool display)
+static void printFrameEyes(const FrameResult& fr)
 {
-    Mat left, right;
-    std::vector<Point> leftPts, rightPts;
-    if (!extractEyesFromFace(input, left, right,leftPts,rightPts)) {
-        cerr << "Face/eye extraction failed.\n";
+    if (!fr.faceFound) {
+        cout << "Frame " << fr.index << ": No face detected\n";
         return;
     }
+    if (fr.face.left.found)
+        cout << "Frame " << fr.index << " - Left Eye BIoU = " << fr.face.left.biou
+             << (fr.face.left.tracked ? " (tracked)" : "") << endl;
+    if (fr.face.right.found)
+        cout << "Frame " << fr.index << " - Right Eye BIoU = " << fr.face.right.biou
+             << (fr.face.right.tracked ? " (tracked)" : "") << endl;
+}
+/**
+ * @brief 
+ * Executes the processing pipeline on a video file, applying analysis to the sampled frames.
+ * Both eyes are scored on every sampled frame.
+ * @param input Path to the video file or the index of the camera device to be used and only .mp4 files
+ * @param pipeline Frame sampling options (strategy, number of frames, stride)
+ * @param seq Sequential test options: when enabled, stops once the confidence interval of the mean frame BIoU clears the threshold.
+ * @param view Tile size of the displayed and recorded rows.
+ * @param display The display each frame's row is posted to without waiting, nullptr when off.
+ * @param writer The annotated video each frame's row is queued to, nullptr when off.
+ */
+void runVideoMode(const string& input, const Pipeline& pipeline, const SequentialOptions& seq,
+                  const ViewOptions& view, ResultDisplay* display, AnnotatedWriter* writer)
+{
+    const VideoOptions& sampling = pipeline.videoOptions();
+    SequentialVerdict verdict(seq);
 
-    // LEFT EYE
-    Mat grayL; cvtColor(left, grayL, COLOR_BGR2GRAY);
-    Mat maskL;
-    Point centerL; int radiusL;
+    cout << "Sampling " << sampleModeName(sampling.sampling) << ", up to " << sampling.maxFrames << " frames\n";
 
-    if (!findPupilMask(grayL, maskL, centerL, radiusL)) {
-        cerr << "Left pupil not found.\n";
+    bool warned = false;
+    bool opened = pipeline.processVideo(input, [&](const FrameResult& fr) {
+        if (!warned && sampling.sampling == SampleMode::Keyframe && fr.sampling != SampleMode::Keyframe) {
+            cerr << "Key frame index unavailable, sampling " << sampleModeName(fr.sampling) << " instead.\n";
+            warned = true;
+        }
+        publishFrame(fr, view, display, writer);
+        printFrameEyes(fr);
+
+        double v = fr.biou();
+        return !(seq.enabled && v >= 0 && verdict.add(v));
+    });
+
+    if (!opened) {
+        cerr << "Cannot open video.\n";
         return;
     }
 
-    vector<vector<Point>> contoursL;
-    findContours(maskL, contoursL, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-    if (contoursL.empty()) {
-        cerr << "No contour for left eye.\n";
-        return;
+    if (seq.enabled) {
+        verdict.finish();
+        cout << "Mean BIoU = " << verdict.mean() << " +/- " << verdict.halfWidth()
+             << " after " << verdict.count() << " frames (stop: " << stopReasonName(verdict.reason()) << ")\n";
+        cout << "Verdict: " << (verdict.mean() > seq.threshold ? "real" : "synthetic") << endl;
     }
+}
 
-    double biouL = computeBIoU(maskL, contoursL[0]);
-    cout << "Left Eye BIoU = " << biouL << endl;
+/**
+ * @brief 
+ * Replays a video file at its frame rate as if it came from a live camera and reports whether
+ * the pipeline keeps up: frames dropped by the drop policy, sustained fps and end to end
+ * latency percentiles. Display and annotated video never wait, so they do not slow the replay.
+ * @param input Path to the video file.
+ * @param pipeline Tracking, detection and pupil search options.
+ * @param paced Replay rate, drop policy and queue depth.
+ * @param seq Sequential test options: when enabled, the replay stops once the verdict is clear.
+ * @param view Tile size of the displayed and recorded rows.
+ * @param display The display, nullptr when off.
+ * @param writer The annotated video writer, nullptr when off.
+ */
+void runPacedMode(const string& input, const Pipeline& pipeline, const PacedOptions& paced,
+                  const SequentialOptions& seq, const ViewOptions& view, ResultDisplay* display,
+                  AnnotatedWriter* writer)
+{
+    SequentialVerdict verdict(seq);
+    PacedStats stats;
 
-    // RIGHT EYE
-    Mat grayR; cvtColor(right, grayR, COLOR_BGR2GRAY);
-    Mat maskR;
-    Point centerR; int radiusR;
+    bool opened = pipeline.processVideoPaced(input, paced, stats, [&](const FrameResult& fr) {
+        publishFrame(fr, view, display, writer);
+        printFrameEyes(fr);
 
-    if (!findPupilMask(grayR, maskR, centerR, radiusR)) {
-        cerr << "Right pupil not found.\n";
-        return;
-    }
+        double v = fr.biou();
+        return !(seq.enabled && v >= 0 && verdict.add(v));
+    });
 
-    vector<vector<Point>> contoursR;
-    findContours(maskR, contoursR, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-    if (contoursR.empty()) {
-        cerr << "No contour for right eye.\n";
+    if (!opened) {
+        cerr << "Cannot open video.\n";
         return;
     }
 
-    double biouR = computeBIoU(maskR, contoursR[0]);
-    cout << "Right Eye BIoU = " << biouR << endl;
-
-    if (display) {
-        showEyeAndMask(left, maskL, biouL);
-        showEyeAndMask(right, maskR, biouR);
+    cout << "Replayed at " << stats.fps << " fps, drop policy " << dropPolicyName(paced.policy) << "\n";
+    cout << "Frames: " << stats.captured << " captured, " << stats.processed << " processed, "
+         << stats.dropped << " dropped (" << 100.0 * stats.dropRate() << "%)\n";
+    cout << "Sustained fps: " << stats.sustainedFps() << "\n";
+    cout << "Latency p50 = " << stats.latencyPercentile(50) << " ms, p99 = "
+         << stats.latencyPercentile(99) << " ms\n";
+
+    if (seq.enabled) {
+        verdict.finish();
+        cout << "Mean BIoU = " << verdict.mean() << " +/- " << verdict.halfWidth()
+             << " after " << verdict.count() << " frames (stop: " << stopReasonName(verdict.reason()) << ")\n";
+        cout << "Verdict: " << (verdict.mean() > seq.threshold ? "real" : "synthetic") << endl;
     }
 }
+
 /**
  * @brief 
- * Executes the processing pipeline on a video file, applying analysis frame-by-frame.
- * @param input Path to the video file or the index of the camera device to be used and only .mp4 files
- * @param maxFrames Maximum number of frames to process before stopping (use 0 or a negative value to process the entire video)
- * @param display Boolean flag to control whether the video output and analysis results should be displayed in real-time.
+ * Reruns the pupil stage on every crop of an archive written by "batchProcess export-crops",
+ * straight from the memory mapped file, and prints the crop and per file scores.
+ * @param input Path to the crop archive.
+ * @param display The display every scored crop is posted to, nullptr when off.
+ * @param pupil Pupil search options (landmark bounds use the stored eye landmarks).
  */
-void runVideoMode(const string& input, int maxFrames, bool display)
+void runCropsMode(const string& input, ResultDisplay* display, const PupilSearchOptions& pupil)
 {
-    VideoCapture cap(input);
-    if (!cap.isOpened()) {
-        cerr << "Cannot open video.\n";
+    CropArchive archive;
+    if (!archive.open(input)) {
+        cerr << "Cannot open crop archive.\n";
         return;
     }
 
-    cout << "Processing first " << maxFrames << " frames\n";
-
-    Mat frame;
-    for (int i = 0; i < maxFrames; i++) {
-
-        if (!cap.read(frame)) break;
-
-        string tempName = "__temp_frame.jpg";
-        imwrite(tempName, frame);
-
-        Mat left, right;
-        std::vector<Point> leftPts, rightPts;
-        if (!extractEyesFromFace(tempName, left, right,leftPts,rightPts)) {
-            cout << "Frame " << i << ": No face detected\n";
+    vector<double> cropBiou;
+    vector<EyeResult> cropEyes;
+    map<string, pair<double, int>> scores;
+    scoreArchive(archive, cropBiou, scores, pupil, nullptr, display ? &cropEyes : nullptr);
+
+    for (size_t i = 0; i < archive.size(); i++) {
+        CropRecord c = archive.crop(i);
+        cout << archive.sources()[c.source].relPath;
+        if (c.frame >= 0) cout << " - Frame " << c.frame;
+        if (c.eye >= 0) cout << (c.eye == 0 ? " - Left" : " - Right") << " Eye";
+        if (cropBiou[i] < 0) {
+            cout << ": pupil not found\n";
             continue;
         }
+        cout << " BIoU = " << cropBiou[i] << endl;
 
-        // LEFT EYE
-        Mat gL; cvtColor(left, gL, COLOR_BGR2GRAY);
-        Mat mL;
-        Point cL; int rL;
-        if (findPupilMask(gL, mL, cL, rL)) {
-            vector<vector<Point>> cnt;
-            findContours(mL, cnt, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-
-            if (!cnt.empty()) {
-                double biouL = computeBIoU(mL, cnt[0]);
-                cout << "Frame " << i << " - Left Eye BIoU = " << biouL << endl;
-
-                if (display) {
-                    showEyeAndMask(left, mL, biouL);
-                }
-            }
-        }
-
-        // RIGHT EYE
-        Mat gR; cvtColor(right, gR, COLOR_BGR2GRAY);
-        Mat mR;
-        Point cR; int rR;
-        if (findPupilMask(gR, mR, cR, rR)) {
-            vector<vector<Point>> cnt2;
-            findContours(mR, cnt2, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE);
-
-            if (!cnt2.empty()) {
-                double biouR = computeBIoU(mR, cnt2[0]);
-                cout << "Frame " << i << " - Right Eye BIoU = " << biouR << endl;
-
-                if (display) {
-                    showEyeAndMask(right, mR, biouR);
-                }
-            }
-        }
+        if (display)
+            display->post(renderEyePanel(c.image, cropEyes[i].mask, cropEyes[i].biou));
     }
+
+    for (const auto& s : scores)
+        cout << s.first << ": BIoU = " << s.second.first
+             << " -> " << (s.second.first > 0.5 ? "real" : "synthetic") << endl;
 }
 
 /**
  * @brief 
  * The core function that runs the command line tool checkPupil which can take one file at a time
- * and process pupil based generated image classification
+ * and process pupil based generated image classification, or with --stdin a stream of images
+ * answered with one JSON line each
  * @param argc 
  * @param argv 
  * @return int 
@@ -237,14 +285,30 @@ void runVideoMode(const string& input, int maxFrames, bool display)
 int main(int argc, char** argv)
 {
     if (argc < 2) {
-        cerr << "Usage: ./checkPupil --eye=\"input_eye.jpg\" | --face=\"input_face.jpg\" | --video=\"input.mp4\" [--display on/off] [--frames numFrames]\n";
+        cerr << "Usage: ./checkPupil --eye=\"input_eye.jpg\" | --face=\"input_face.jpg\" | --video=\"input.mp4\" | --crops=\"crops.bin\" [--preset fast|balanced|accurate] [--display on/off] [--annotated-out=annotated.mp4] [--annotated-fps F] [--frames numFrames] [--sample first|stride|uniform|keyframe] [--stride N] [--track on/off] [--segments K] [--paced on/off] [--fps F] [--drop latest|drop-oldest|drop-newest] [--queue-depth N] [--sequential on/off] [--max-frames N] [--confidence p] [--faces maxFaces] [--detect serial|parallel] [--pyramid-downscale r] [--upsample N] [--landmark-bounds on/off] [--eye-width N] [--detector hough|ransac] [--quality-gate off|frames|eyes|on] [--min-sharpness v] [--eye-min-sharpness v] [--min-luma v] [--max-luma v] [--max-clipped f] [--threads N] [--pin on/off] [--stats on/off]\n"
+                "       ./checkPupil --stdin paths|blobs [--order input|completion] [--in-flight N] [--items face|eye] [--max-blob-mb M] [pipeline options]\n";
         return 1;
     }
 
     string input;
     string mode;
-    bool display = true;
-    int numFrames = 30;
+    ViewOptions view;
+    FaceAnalysisOptions faceOpts;
+    bool printStats = false;
+    VideoOptions videoOpts;
+    SequentialOptions seqOpts;
+    bool pacedMode = false;
+    PacedOptions pacedOpts;
+    bool stdinMode = false;
+    StreamOptions streamOpts;
+
+    // the preset is applied first so that the individual flags override it
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (string(argv[i]) == "--preset" && !applyPreset(argv[i + 1], faceOpts, videoOpts)) {
+            cerr << "Unknown preset.\n";
+            return 1;
+        }
+    }
 
     for (int i = 1; i < argc; ++i) {
         string arg = argv[i];
@@ -261,12 +325,166 @@ int main(int argc, char** argv)
             mode = "video";
             input = arg.substr(8);
         }
+        else if (arg.rfind("--crops=", 0) == 0) {
+            mode = "crops";
+            input = arg.substr(8);
+        }
+        else if (arg == "--stdin" && i + 1 < argc) {
+            stdinMode = true;
+            if (!parseStreamInput(argv[++i], streamOpts.input)) {
+                cerr << "Unknown stdin input, expected paths or blobs.\n";
+                return 1;
+            }
+        }
+        else if (arg == "--order" && i + 1 < argc) {
+            if (!parseStreamOrder(argv[++i], streamOpts.order)) {
+                cerr << "Unknown output order.\n";
+                return 1;
+            }
+        }
+        else if (arg == "--in-flight" && i + 1 < argc) {
+            streamOpts.maxInFlight = (size_t)stoul(argv[++i]);
+        }
+        else if (arg == "--items" && i + 1 < argc) {
+            streamOpts.eyes = (string(argv[++i]) == "eye");
+        }
+        else if (arg == "--max-blob-mb" && i + 1 < argc) {
+            streamOpts.maxBlobBytes = (size_t)stoul(argv[++i]) << 20;
+        }
+        else if (arg == "--preset" && i + 1 < argc) {
+            ++i;
+        }
         else if (arg == "--display" && i + 1 < argc) {
-            display = (string(argv[++i]) == "on");
+            view.display = (string(argv[++i]) == "on");
+        }
+        else if (arg.rfind("--annotated-out=", 0) == 0) {
+            view.annotatedOut = arg.substr(16);
+        }
+        else if (arg == "--annotated-out" && i + 1 < argc) {
+            view.annotatedOut = argv[++i];
+        }
+        else if (arg == "--annotated-fps" && i + 1 < argc) {
+            view.annotatedFps = stod(argv[++i]);
         }
         else if (arg == "--frames" && i + 1 < argc) {
-            numFrames = stoi(argv[++i]);
+            videoOpts.maxFrames = stoi(argv[++i]);
+        }
+        else if (arg == "--sample" && i + 1 < argc) {
+            if (!parseSampleMode(argv[++i], videoOpts.sampling)) {
+                cerr << "Unknown sampling mode.\n";
+                return 1;
+            }
+        }
+        else if (arg == "--stride" && i + 1 < argc) {
+            videoOpts.stride = stoi(argv[++i]);
+        }
+        else if (arg == "--track" && i + 1 < argc) {
+            videoOpts.track = (string(argv[++i]) == "on");
+        }
+        else if (arg == "--segments" && i + 1 < argc) {
+            videoOpts.segments = stoi(argv[++i]);
+        }
+        else if (arg == "--paced" && i + 1 < argc) {
+            pacedMode = (string(argv[++i]) == "on");
+        }
+        else if (arg == "--fps" && i + 1 < argc) {
+            pacedOpts.fps = stod(argv[++i]);
+        }
+        else if (arg == "--drop" && i + 1 < argc) {
+            if (!parseDropPolicy(argv[++i], pacedOpts.policy)) {
+                cerr << "Unknown drop policy.\n";
+                return 1;
+            }
+        }
+        else if (arg == "--queue-depth" && i + 1 < argc) {
+            pacedOpts.queueDepth = stoi(argv[++i]);
+        }
+        else if (arg == "--sequential" && i + 1 < argc) {
+            seqOpts.enabled = (string(argv[++i]) == "on");
+        }
+        else if (arg == "--max-frames" && i + 1 < argc) {
+            seqOpts.maxFrames = stoi(argv[++i]);
+        }
+        else if (arg == "--confidence" && i + 1 < argc) {
+            seqOpts.confidence = stod(argv[++i]);
         }
+        else if (arg == "--faces" && i + 1 < argc) {
+            faceOpts.maxFaces = stoi(argv[++i]);
+        }
+        else if (arg == "--landmark-bounds" && i + 1 < argc) {
+            faceOpts.pupil.landmarkBounds = (string(argv[++i]) == "on");
+        }
+        else if (arg == "--eye-width" && i + 1 < argc) {
+            faceOpts.pupil.canonicalWidth = stoi(argv[++i]);
+        }
+        else if (arg == "--detector" && i + 1 < argc) {
+            if (!parsePupilDetector(argv[++i], faceOpts.pupil.params.detector)) {
+                cerr << "Unknown pupil detector.\n";
+                return 1;
+            }
+        }
+        else if (arg == "--detect" && i + 1 < argc) {
+            faceOpts.detect.parallel = (string(argv[++i]) == "parallel");
+        }
+        else if (arg == "--pyramid-downscale" && i + 1 < argc) {
+            faceOpts.detect.downscale = stod(argv[++i]);
+        }
+        else if (arg == "--upsample" && i + 1 < argc) {
+            faceOpts.detect.upsample = stoi(argv[++i]);
+        }
+        else if (arg == "--quality-gate" && i + 1 < argc) {
+            string v = argv[++i];
+            faceOpts.detect.quality.enabled = (v == "on" || v == "frames");
+            faceOpts.pupil.quality.enabled = (v == "on" || v == "eyes");
+        }
+        else if (arg == "--min-sharpness" && i + 1 < argc) {
+            faceOpts.detect.quality.minSharpness = stod(argv[++i]);
+        }
+        else if (arg == "--eye-min-sharpness" && i + 1 < argc) {
+            faceOpts.pupil.quality.minSharpness = stod(argv[++i]);
+        }
+        else if (arg == "--min-luma" && i + 1 < argc) {
+            faceOpts.detect.quality.minLuma = stod(argv[++i]);
+        }
+        else if (arg == "--max-luma" && i + 1 < argc) {
+            faceOpts.detect.quality.maxLuma = stod(argv[++i]);
+        }
+        else if (arg == "--max-clipped" && i + 1 < argc) {
+            faceOpts.detect.quality.maxClipped = stod(argv[++i]);
+        }
+        else if (arg == "--stats" && i + 1 < argc) {
+            printStats = (string(argv[++i]) == "on");
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            TaskPool::setThreadBudget((unsigned)stoul(argv[++i]));
+        }
+        else if (arg == "--pin" && i + 1 < argc) {
+            TaskPool::setPinning(string(argv[++i]) == "on");
+        }
+    }
+
+    if (seqOpts.enabled && !pacedMode) {
+        // stop as soon as the verdict is clear; visit frames so every prefix covers the clip
+        videoOpts.maxFrames = seqOpts.maxFrames;
+        videoOpts.coarseToFine = true;
+    }
+    // the CLI is a driver over the library: everything below goes through the pipeline
+    const Pipeline pipeline(faceOpts, videoOpts);
+
+    if (stdinMode) {
+        // stdout carries nothing but the result lines; everything else goes to stderr
+        ios::sync_with_stdio(false);
+        printEffectiveConfig(cerr, pipeline.faceOptions(), pipeline.videoOptions());
+        StreamStats stats;
+        bool clean = serveJsonLines(cin, cout, pipeline, streamOpts, stats);
+        cerr << stats.items << " items (" << stats.ok << " ok) in " << stats.seconds << " s, "
+             << stats.itemsPerSecond() << " items/s, " << streamOrderName(streamOpts.order)
+             << " order, at most " << stats.maxInFlight << " in flight\n";
+        if (printStats) {
+            printEllipseFitStats(cerr);
+            printQualityGateStats(cerr);
+        }
+        return clean ? 0 : 1;
     }
 
     if (mode.empty() || input.empty()) {
@@ -274,18 +492,58 @@ int main(int argc, char** argv)
         return 1;
     }
 
-    if (mode == "eye") {
-        runEyeMode(input, display);
+    if (mode != "eye" && mode != "face" && mode != "video" && mode != "crops") {
+        cerr << "Invalid mode.\n";
+        return 1;
     }
-    else if (mode == "face") {
-        runFaceMode(input, display);
+
+    // annotated video: one row per sampled frame, encoded on its own thread
+    AnnotatedWriter writer;
+    if (!view.annotatedOut.empty()) {
+        if (mode != "video") {
+            cerr << "--annotated-out needs --video.\n";
+            return 1;
+        }
+        if (!writer.open(view.annotatedOut, view.annotatedFps, Size(4 * view.tile.width, view.tile.height))) {
+            cerr << "Cannot write " << view.annotatedOut << "\n";
+            return 1;
+        }
     }
-    else if (mode == "video") {
-        runVideoMode(input, numFrames, display);
+
+    printEffectiveConfig(cout, pipeline.faceOptions(), pipeline.videoOptions());
+
+    ResultDisplay display("Eye + Mask");
+    ResultDisplay* shown = view.display ? &display : nullptr;
+    AnnotatedWriter* recorded = writer.isOpen() ? &writer : nullptr;
+    auto work = [&]() {
+        if (mode == "eye")
+            runEyeMode(input, shown, pipeline);
+        else if (mode == "face")
+            runFaceMode(input, pipeline, view, shown);
+        else if (mode == "video" && pacedMode)
+            runPacedMode(input, pipeline, pacedOpts, seqOpts, view, shown, recorded);
+        else if (mode == "video")
+            runVideoMode(input, pipeline, seqOpts, view, shown, recorded);
+        else
+            runCropsMode(input, shown, pipeline.faceOptions().pupil);
+    };
+
+    // the pipeline runs on a worker thread while this one keeps the window responsive;
+    // the last result stays on screen until a key is pressed
+    if (view.display)
+        display.run(work, true);
+    else
+        work();
+
+    if (recorded) {
+        writer.close();
+        cout << "Annotated video: " << writer.writtenCount() << " frames written, "
+             << writer.droppedCount() << " dropped\n";
     }
-    else {
-        cerr << "Invalid mode.\n";
-        return 1;
+
+    if (printStats) {
+        printEllipseFitStats(cout);
+        printQualityGateStats(cout);
     }
 
     return 0;
@@ -0,0 +1,211 @@
+#include <chrono>
+#include <functional>
+#include <map>
+#include <random>
+#include <sstream>
+#include "ParameterSweep.h"
+#include "BIoU.h"
+#include "TaskPool.h"
+
+using namespace cv;
+using namespace std;
+
+typedef std::function<void(PupilParams&, double)> ParamSetter;
+
+static const std::map<string, ParamSetter>& paramSetters()
+{
+    static const std::map<string, ParamSetter> setters = {
+        {"cannyLow",    [](PupilParams& p, double v) { p.cannyLow = (int)v; }},
+        {"cannyHigh",   [](PupilParams& p, double v) { p.cannyHigh = (int)v; }},
+        {"houghMinR",   [](PupilParams& p, double v) { p.houghMinR = (int)v; }},
+        {"houghMaxR",   [](PupilParams& p, double v) { p.houghMaxR = (int)v; }},
+        {"dp",          [](PupilParams& p, double v) { p.dp = v; }},
+        {"minDist",     [](PupilParams& p, double v) { p.minDist = (int)v; }},
+        {"houghParam1", [](PupilParams& p, double v) { p.houghParam1 = (int)v; }},
+        {"houghParam2", [](PupilParams& p, double v) { p.houghParam2 = (int)v; }},
+    };
+    return setters;
+}
+
+bool parseSweepGrid(const string& spec, vector<PupilParams>& sets)
+{
+    sets.assign(1, PupilParams());
+
+    std::stringstream axes(spec);
+    string axis;
+    while (std::getline(axes, axis, ';')) {
+        if (axis.empty()) continue;
+        size_t eq = axis.find('=');
+        if (eq == string::npos) return false;
+
+        auto it = paramSetters().find(axis.substr(0, eq));
+        if (it == paramSetters().end()) {
+            std::cerr << "Unknown sweep parameter " << axis.substr(0, eq) << "\n";
+            return false;
+        }
+
+        vector<double> values;
+        std::stringstream vs(axis.substr(eq + 1));
+        string v;
+        while (std::getline(vs, v, ',')) {
+            try { values.push_back(std::stod(v)); }
+            catch (...) { return false; }
+        }
+        if (values.empty()) return false;
+
+        vector<PupilParams> expanded;
+        for (const auto& base : sets) {
+            for (double value : values) {
+                PupilParams p = base;
+                it->second(p, value);
+                expanded.push_back(p);
+            }
+        }
+        sets.swap(expanded);
+    }
+    return true;
+}
+
+std::vector<PupilParams> randomSweep(int count, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    auto pick = [&](int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(rng); };
+
+    vector<PupilParams> sets;
+    for (int i = 0; i < count; i++) {
+        PupilParams p;
+        p.cannyLow = pick(10, 60);
+        p.cannyHigh = p.cannyLow * pick(2, 4);
+        p.houghMinR = pick(5, 20);
+        p.houghMaxR = pick(60, 160);
+        p.dp = std::uniform_real_distribution<double>(1.0, 2.0)(rng);
+        p.minDist = pick(10, 60);
+        p.houghParam1 = pick(40, 160);
+        p.houghParam2 = pick(15, 50);
+        sets.push_back(p);
+    }
+    return sets;
+}
+
+/**
+ * @brief
+ * Preprocesses a BGR or grayscale eye crop for the pupil stage.
+ */
+static CachedCrop cacheCrop(const CropRecord& r)
+{
+    Mat gray;
+    if (r.image.channels() == 1) gray = r.image;
+    else cvtColor(r.image, gray, COLOR_BGR2GRAY);
+
+    CachedCrop c;
+    preprocessForPupil(gray, c.pre);
+    c.landmarks = r.landmarks;
+    c.source = r.source;
+    c.frame = r.frame;
+    c.face = r.face;
+    return c;
+}
+
+std::vector<CachedCrop> collectCrops(const vector<DatasetFile>& files, const VideoOptions& videoOpts)
+{
+    vector<CachedCrop> crops;
+    for (const CropRecord& r : extractCrops(files, videoOpts))
+        crops.push_back(cacheCrop(r));
+    return crops;
+}
+
+std::vector<CachedCrop> collectCrops(const CropArchive& archive)
+{
+    vector<CachedCrop> crops(archive.size());
+    vector<std::future<void>> tasks;
+    TaskPool& pool = TaskPool::shared();
+    for (size_t i = 0; i < archive.size(); i++)
+        tasks.push_back(pool.submit([&, i]() { crops[i] = cacheCrop(archive.crop(i)); }));
+    pool.waitAll(tasks);
+    return crops;
+}
+
+std::vector<SweepResult> runSweep(const vector<DatasetFile>& files, const vector<CachedCrop>& crops,
+                                  const vector<PupilParams>& sets, bool landmarkBounds)
+{
+    // sets sharing the Canny thresholds share each crop's edge map
+    std::map<std::pair<int, int>, vector<size_t>> byCanny;
+    for (size_t s = 0; s < sets.size(); s++)
+        byCanny[std::make_pair(sets[s].cannyLow, sets[s].cannyHigh)].push_back(s);
+
+    // biou[s][c], -1 when no pupil was found; secs[s][c] time spent on crop c with set s
+    vector<vector<double>> biou(sets.size(), vector<double>(crops.size(), -1.0));
+    vector<vector<double>> secs(sets.size(), vector<double>(crops.size(), 0.0));
+
+    // with landmark bounds an axis the sets sweep keeps its swept values, the landmarks only
+    // replace the axes that are the same in every set (and always give the center region)
+    bool sweptMinR = false, sweptMaxR = false, sweptMinDist = false;
+    for (const PupilParams& p : sets) {
+        sweptMinR |= p.houghMinR != sets[0].houghMinR;
+        sweptMaxR |= p.houghMaxR != sets[0].houghMaxR;
+        sweptMinDist |= p.minDist != sets[0].minDist;
+    }
+    auto effectiveParams = [&](const CachedCrop& crop, const PupilParams& set) {
+        if (!landmarkBounds) return set;
+        PupilParams params = pupilParamsFromLandmarks(crop.landmarks, set);
+        if (sweptMinR) params.houghMinR = set.houghMinR;
+        if (sweptMaxR) params.houghMaxR = set.houghMaxR;
+        if (sweptMinDist) params.minDist = set.minDist;
+        return params;
+    };
+
+    vector<std::future<void>> tasks;
+    TaskPool& pool = TaskPool::shared();
+    for (size_t c = 0; c < crops.size(); c++) {
+        tasks.push_back(pool.submit([&, c]() {
+            const Mat& I = crops[c].pre;
+            for (const auto& group : byCanny) {
+                auto t0 = std::chrono::steady_clock::now();
+                Mat edges;
+                pupilEdgeMap(I, edges, sets[group.second.front()]);
+                double edgeSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+                for (size_t s : group.second) {
+                    auto t1 = std::chrono::steady_clock::now();
+                    PupilMask mask; Point center; int radius;
+                    PupilParams params = effectiveParams(crops[c], sets[s]);
+                    if (findPupilMaskPrepared(I, edges, mask, center, radius, params)) {
+                        vector<vector<Point>> contours;
+                        pupilContours(mask, contours);
+                        if (!contours.empty())
+                            biou[s][c] = computeBIoU(mask, contours[0]);
+                    }
+                    // the shared edge map is charged to every set that uses it
+                    secs[s][c] = edgeSecs +
+                        std::chrono::duration<double>(std::chrono::steady_clock::now() - t1).count();
+                }
+            }
+        }));
+    }
+    pool.waitAll(tasks);
+
+    // files are scored as batchProcess scores them: best eye per face, mean over faces or frames
+    vector<tuple<int, int, int>> groups;
+    for (const CachedCrop& c : crops)
+        groups.push_back(make_tuple(c.source, c.frame, c.face));
+
+    vector<SweepResult> results(sets.size());
+    for (size_t s = 0; s < sets.size(); s++) {
+        SweepResult& r = results[s];
+        r.params = sets[s];
+
+        for (size_t c = 0; c < crops.size(); c++) {
+            r.seconds += secs[s][c];
+            if (biou[s][c] >= 0) r.found++;
+        }
+
+        for (const auto& p : aggregateFileScores(files, groups, biou[s])) {
+            const DatasetFile& f = files[p.first];
+            double score = p.second.first;
+            r.files++;
+            if ((f.type == "real" && score > 0.5) || (f.type == "synthetic" && score < 0.5))
+                r.correct++;
+        }
+    }
+    return results;
+}
@@ -0,0 +1,57 @@
+#include <climits>
+#include "Pipeline.h"
+
+using namespace cv;
+using std::string;
+using std::vector;
+
+Pipeline::Pipeline(const FaceAnalysisOptions& face, const VideoOptions& video)
+    : face(face), video(video)
+{
+    this->video.pupil = face.pupil;
+    this->video.detect = face.detect;
+}
+
+bool Pipeline::processEye(const Mat& eyeImage, EyeResult& eye) const
+{
+    return analyzeEyeCrop(eyeImage, eye, face.pupil);
+}
+
+bool Pipeline::processImage(const Mat& imageBgr, vector<FaceResult>& faces) const
+{
+    return analyzeFaces(imageBgr, faces, face);
+}
+
+bool Pipeline::processImageFile(const string& path, vector<FaceResult>& faces) const
+{
+    return analyzeFaces(path, faces, face);
+}
+
+bool Pipeline::processImageBuffer(const void* data, size_t size, vector<FaceResult>& faces) const
+{
+    faces.clear();
+    if (!data || size == 0 || size > (size_t)INT_MAX) return false;
+    Mat bytes(1, (int)size, CV_8U, const_cast<void*>(data));
+    Mat img = imdecode(bytes, IMREAD_COLOR | IMREAD_IGNORE_ORIENTATION);
+    return processImage(img, faces);
+}
+
+bool Pipeline::processVideo(const string& path, const std::function<bool(const FrameResult&)>& onFrame) const
+{
+    return analyzeVideo(path, video, onFrame);
+}
+
+bool Pipeline::processVideoPaced(const string& path, const PacedOptions& paced, PacedStats& stats,
+                                 const std::function<bool(const FrameResult&)>& onFrame) const
+{
+    return analyzeVideoPaced(path, video, paced, stats, onFrame);
+}
+
+bool Pipeline::Stream::processFrame(const Mat& frameBgr, int index, FrameResult& result)
+{
+    result = FrameResult();
+    result.index = index;
+    if (frameBgr.empty()) return false;
+    analyzer.analyze(frameBgr, result);
+    return result.faceFound;
+}
@@ -0,0 +1,176 @@
+#include <climits>
+#include <memory>
+#include "PipelineC.h"
+#include "Pipeline.h"
+#include "Presets.h"
+#include "TaskPool.h"
+
+using namespace cv;
+using std::vector;
+
+struct if_pipeline
+{
+    Pipeline pipeline;
+};
+
+struct if_stream
+{
+    explicit if_stream(const Pipeline& p) : stream(p) {}
+    Pipeline::Stream stream;
+};
+
+/**
+ * @brief
+ * Copies an eye result into its C form, the pupil center moved to image coordinates.
+ */
+static void toC(const EyeResult& eye, if_eye_result& out)
+{
+    out.found = eye.found ? 1 : 0;
+    out.biou = eye.found ? eye.biou : -1.0;
+    out.center_x = eye.center.x + eye.cropRect.x;
+    out.center_y = eye.center.y + eye.cropRect.y;
+    out.radius = eye.radius;
+    out.crop_x = eye.cropRect.x;
+    out.crop_y = eye.cropRect.y;
+    out.crop_width = eye.cropRect.width;
+    out.crop_height = eye.cropRect.height;
+    out.tracked = eye.tracked ? 1 : 0;
+}
+
+static void toC(const FaceResult& face, if_face_result& out)
+{
+    out.index = face.index;
+    out.detection_score = face.detectionScore;
+    out.x = face.faceBox.x;
+    out.y = face.faceBox.y;
+    out.width = face.faceBox.width;
+    out.height = face.faceBox.height;
+    out.biou = face.biou();
+    toC(face.left, out.left);
+    toC(face.right, out.right);
+}
+
+extern "C" {
+
+void if_config_init(if_config* config)
+{
+    if (!config) return;
+    config->preset = nullptr;
+    config->max_faces = -1;
+    config->landmark_bounds = -1;
+    config->eye_width = -1;
+    config->detect_parallel = -1;
+    config->track = -1;
+    config->quality_gate = -1;
+    config->threads = 0;
+}
+
+if_pipeline* if_pipeline_create(const if_config* config)
+{
+    try {
+        FaceAnalysisOptions face;
+        VideoOptions video;
+        if (config) {
+            if (config->preset && !applyPreset(config->preset, face, video))
+                return nullptr;
+            if (config->max_faces >= 0)       face.maxFaces = config->max_faces;
+            if (config->landmark_bounds >= 0) face.pupil.landmarkBounds = config->landmark_bounds != 0;
+            if (config->eye_width >= 0)       face.pupil.canonicalWidth = config->eye_width;
+            if (config->detect_parallel >= 0) face.detect.parallel = config->detect_parallel != 0;
+            if (config->track >= 0)           video.track = config->track != 0;
+            if (config->quality_gate >= 0) {
+                face.detect.quality.enabled = (config->quality_gate & 1) != 0;
+                face.pupil.quality.enabled = (config->quality_gate & 2) != 0;
+            }
+            if (config->threads > 0 && !TaskPool::initThreadBudget((unsigned)config->threads))
+                return nullptr;
+        }
+        std::unique_ptr<if_pipeline> p(new if_pipeline());
+        p->pipeline = Pipeline(face, video);
+        return p.release();
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void if_pipeline_destroy(if_pipeline* pipeline)
+{
+    delete pipeline;
+}
+
+int if_process_image_buffer(const if_pipeline* pipeline, const void* data, size_t size,
+                            if_face_result* faces, int capacity, int* face_count)
+{
+    if (face_count) *face_count = 0;
+    if (!pipeline || !data || size == 0 || capacity < 0 || (capacity > 0 && !faces))
+        return IF_INVALID_ARGUMENT;
+    try {
+        if (size > (size_t)INT_MAX) return IF_DECODE_FAILED;
+        Mat img = imdecode(Mat(1, (int)size, CV_8U, const_cast<void*>(data)),
+                           IMREAD_COLOR | IMREAD_IGNORE_ORIENTATION);
+        if (img.empty()) return IF_DECODE_FAILED;
+
+        vector<FaceResult> results;
+        if (!pipeline->pipeline.processImage(img, results)) return IF_NO_FACE;
+
+        if (face_count) *face_count = (int)results.size();
+        for (int i = 0; i < capacity && i < (int)results.size(); i++)
+            toC(results[i], faces[i]);
+        return IF_OK;
+    } catch (...) {
+        return IF_INTERNAL_ERROR;
+    }
+}
+
+if_stream* if_stream_create(const if_pipeline* pipeline)
+{
+    if (!pipeline) return nullptr;
+    try {
+        return new if_stream(pipeline->pipeline);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void if_stream_destroy(if_stream* stream)
+{
+    delete stream;
+}
+
+int if_process_frame(const if_pipeline* pipeline, if_stream* stream, const unsigned char* bgr,
+                     int width, int height, size_t stride, int frame_index, if_face_result* face)
+{
+    if (!pipeline || !bgr || width <= 0 || height <= 0 || !face)
+        return IF_INVALID_ARGUMENT;
+    if (stride == 0) stride = (size_t)width * 3;
+    if (stride < (size_t)width * 3) return IF_INVALID_ARGUMENT;
+    try {
+        // wraps the caller's pixels; crops are copied out before this returns
+        Mat frame(height, width, CV_8UC3, const_cast<unsigned char*>(bgr), stride);
+        FrameResult result;
+        if (stream) {
+            stream->stream.processFrame(frame, frame_index, result);
+        } else {
+            Pipeline::Stream once(pipeline->pipeline);
+            once.processFrame(frame, frame_index, result);
+        }
+        toC(result.face, *face);
+        return result.faceFound ? IF_OK : IF_NO_FACE;
+    } catch (...) {
+        return IF_INTERNAL_ERROR;
+    }
+}
+
+const char* if_status_string(int status)
+{
+    switch (status) {
+    case IF_OK:               return "ok";
+    case IF_NO_FACE:          return "no face";
+    case IF_INVALID_ARGUMENT: return "invalid argument";
+    case IF_DECODE_FAILED:    return "decode failed";
+    case IF_INTERNAL_ERROR:   return "internal error";
+    default:                  return "unknown status";
+    }
+}
+
+}
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Prefetcher.h"
+
+using namespace cv;
+using std::string;
+using std::vector;
+
+// Size of each read() call: large enough to keep network storage streaming.
+static const size_t kReadChunk = 4 << 20;
+
+Mat decodeImage(const PrefetchedFile& file, int flags)
+{
+    if (file.bytes.empty())
+        return imread(file.path, flags);
+    return imdecode(file.bytes, flags);
+}
+
+/**
+ * @brief
+ * Reads a whole file with large sequential reads.
+ * @return false if the file could not be opened or read
+ */
+static bool readWhole(const string& path, vector<unsigned char>& bytes)
+{
+    bytes.clear();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+#if defined(__linux__)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#elif defined(__APPLE__)
+    fcntl(fd, F_RDAHEAD, 1);
+#endif
+
+    bytes.resize((size_t)st.st_size);
+    size_t done = 0;
+    while (done < bytes.size()) {
+        ssize_t n = ::read(fd, bytes.data() + done, std::min(kReadChunk, bytes.size() - done));
+        if (n <= 0) break;
+        done += (size_t)n;
+    }
+    ::close(fd);
+    bytes.resize(done);
+    return done == (size_t)st.st_size;
+}
+
+/**
+ * @brief
+ * Pulls up to limit bytes of a file into the page cache without copying them.
+ */
+static void warmFile(const string& path, size_t limit)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        size_t len = std::min((size_t)st.st_size, limit);
+#if defined(__linux__)
+        readahead(fd, 0, len);
+#elif defined(__APPLE__)
+        struct radvisory advice;
+        advice.ra_offset = 0;
+        advice.ra_count = (int)std::min(len, (size_t)INT_MAX);
+        fcntl(fd, F_RDADVISE, &advice);
+#else
+        (void)len;
+#endif
+    }
+    ::close(fd);
+}
+
+Prefetcher::Prefetcher(vector<Request> requests, size_t maxFiles, size_t maxBytes)
+    : requests(std::move(requests)), maxFiles(maxFiles), maxBytes(maxBytes)
+{
+    if (maxFiles > 0)
+        reader = std::thread([this]() { readerLoop(); });
+}
+
+Prefetcher::~Prefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (reader.joinable())
+        reader.join();
+}
+
+void Prefetcher::readerLoop()
+{
+    for (const Request& r : requests) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&]() {
+                return stopping || (ready.size() < maxFiles && (ready.empty() || queuedBytes < maxBytes));
+            });
+            if (stopping) return;
+        }
+
+        PrefetchedFile f;
+        f.path = r.path;
+        if (r.load) {
+            if (!readWhole(r.path, f.bytes))
+                f.bytes.clear();    // the consumer's imread reports the error
+        } else {
+            warmFile(r.path, maxBytes);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            queuedBytes += f.bytes.size();
+            ready.push_back(std::move(f));
+        }
+        cv.notify_all();
+    }
+}
+
+bool Prefetcher::next(PrefetchedFile& file)
+{
+    if (nextOut >= requests.size())
+        return false;
+
+    if (maxFiles == 0) {
+        file.path = requests[nextOut++].path;
+        file.bytes.clear();
+        return true;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [&]() { return !ready.empty(); });
+    stalled += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    file = std::move(ready.front());
+    ready.pop_front();
+    queuedBytes -= file.bytes.size();
+    nextOut++;
+    lock.unlock();
+    cv.notify_all();
+    return true;
+}
@@ -0,0 +1,76 @@
+#include "Presets.h"
+
+using namespace std;
+
+const vector<string>& presetNames()
+{
+    static const vector<string> names = {"fast", "balanced", "accurate"};
+    return names;
+}
+
+bool applyPreset(const string& name, FaceAnalysisOptions& faceOpts, VideoOptions& videoOpts)
+{
+    FaceDetectOptions detect;
+    PupilSearchOptions pupil;
+    videoOpts.sampling = SampleMode::Uniform;
+
+    if (name == "fast") {
+        detect.scale = 0.5;
+        detect.parallel = true;
+        detect.downscale = 0.75;
+        pupil.canonicalWidth = 60;
+        pupil.landmarkBounds = true;
+        pupil.params.dp = 2.0;
+        pupil.params.permissiveFallback = false;
+        pupil.biou = BIoUMethod::OpenCV;
+        videoOpts.maxFrames = 5;
+        videoOpts.track = true;
+    } else if (name == "balanced") {
+        pupil.canonicalWidth = 100;
+        pupil.landmarkBounds = true;
+        videoOpts.maxFrames = 15;
+        videoOpts.track = true;
+    } else if (name == "accurate") {
+        detect.upsample = 1;
+        pupil.params.dp = 1.0;
+        videoOpts.maxFrames = 60;
+        videoOpts.track = false;
+    } else {
+        return false;
+    }
+
+    faceOpts.detect = detect;
+    faceOpts.pupil = pupil;
+    return true;
+}
+
+void printEffectiveConfig(ostream& out, const FaceAnalysisOptions& faceOpts, const VideoOptions& videoOpts)
+{
+    const FaceDetectOptions& d = faceOpts.detect;
+    const PupilSearchOptions& p = faceOpts.pupil;
+    out << "Detection: " << (d.parallel ? "parallel" : "serial")
+        << ", scale " << d.scale << ", upsample " << d.upsample;
+    if (d.parallel)
+        out << ", pyramid downscale " << d.downscale;
+    out << "\n";
+    out << "Pupil search: " << pupilDetectorName(p.params.detector)
+        << ", eye width " << (p.canonicalWidth > 0 ? to_string(p.canonicalWidth) : "native")
+        << ", landmark bounds " << (p.landmarkBounds ? "on" : "off");
+    if (p.params.detector == PupilDetector::Hough)
+        out << ", dp " << p.params.dp;
+    else
+        out << ", " << p.params.ransacIterations << " iterations";
+    out << ", permissive fallback " << (p.params.permissiveFallback ? "on" : "off")
+        << ", ellipse fit " << (p.biou == BIoUMethod::OpenCV ? "opencv" : "custom") << "\n";
+    auto gate = [&](const char* name, const QualityGate& g) {
+        out << name << ": ";
+        if (!g.enabled) { out << "off\n"; return; }
+        out << "sharpness >= " << g.minSharpness << ", luma " << g.minLuma << " - " << g.maxLuma
+            << ", clipped <= " << g.maxClipped << "\n";
+    };
+    gate("Frame quality gate", d.quality);
+    gate("Eye quality gate", p.quality);
+    out << "Video: " << sampleModeName(videoOpts.sampling) << " sampling, "
+        << videoOpts.maxFrames << " frames, track " << (videoOpts.track ? "on" : "off")
+        << ", segments " << videoOpts.segments << "\n";
+}
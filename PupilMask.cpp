@@ -0,0 +1,64 @@
+#include <cmath>
+#include "PupilMask.h"
+
+using namespace cv;
+using std::vector;
+
+Mat PupilMask::full() const
+{
+    Mat out = Mat::zeros(size, CV_8UC1);
+    if (!local.empty())
+        local.copyTo(out(roi));
+    return out;
+}
+
+int PupilMask::area() const
+{
+    return local.empty() ? 0 : countNonZero(local);
+}
+
+PupilMask PupilMask::fromFull(const Mat& mask)
+{
+    PupilMask m;
+    m.size = mask.size();
+    Mat points;
+    findNonZero(mask, points);
+    if (points.empty())
+        return m;
+    m.roi = boundingRect(points);
+    m.local = mask(m.roi).clone();
+    return m;
+}
+
+PupilMask PupilMask::resized(Size newSize) const
+{
+    PupilMask m;
+    m.size = newSize;
+    if (local.empty() || size.area() == 0)
+        return m;
+
+    double fx = (double)newSize.width / size.width;
+    double fy = (double)newSize.height / size.height;
+    int x0 = (int)std::floor(roi.x * fx), y0 = (int)std::floor(roi.y * fy);
+    int x1 = (int)std::ceil(roi.br().x * fx), y1 = (int)std::ceil(roi.br().y * fy);
+    m.roi = Rect(x0, y0, x1 - x0, y1 - y0) & Rect(Point(0, 0), newSize);
+    if (m.roi.area() == 0)
+        return m;
+    resize(local, m.local, m.roi.size(), 0, 0, INTER_NEAREST);
+    return m;
+}
+
+void pupilContours(const PupilMask& mask, vector<vector<Point>>& contours)
+{
+    contours.clear();
+    if (mask.empty())
+        return;
+    findContours(mask.local, contours, RETR_EXTERNAL, CHAIN_APPROX_SIMPLE, mask.roi.tl());
+}
+
+void renderPupilMask(const PupilMask& mask, Mat& bgr)
+{
+    bgr = Mat::zeros(mask.size, CV_8UC3);
+    if (!mask.empty())
+        cvtColor(mask.local, bgr(mask.roi), COLOR_GRAY2BGR);
+}
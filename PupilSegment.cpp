@@ -1,10 +1,29 @@
 #include "PupilSegment.h"
+#include "Ellipse.h"
 
 using namespace cv;
 using std::vector;
 
+bool parsePupilDetector(const std::string &name, PupilDetector &detector)
+{
+    if (name == "hough")       detector = PupilDetector::Hough;
+    else if (name == "ransac") detector = PupilDetector::Ransac;
+    else return false;
+    return true;
+}
+
+const char *pupilDetectorName(PupilDetector detector)
+{
+    switch (detector)
+    {
+    case PupilDetector::Hough:  return "hough";
+    case PupilDetector::Ransac: return "ransac";
+    }
+    return "?";
+}
+
 // Helper: normalize and denoise image similar to CAHT pre-step
-static void preprocessForPupil(const Mat &in, Mat &out)
+void preprocessForPupil(const Mat &in, Mat &out)
 {
     // input: single channel
     Mat tmp;
@@ -20,124 +39,281 @@ static void preprocessForPupil(const Mat &in, Mat &out)
 }
 
 /**
- * @brief 
- * The core function that performs contrast adaptive hough transform
- * to segment the pupil mask from the eye segment
- * pupil being the darkest region in the eye
- * @param eyeGray The input grayscale image patch containing the isolated eye region
- * @param pupilMask Output parameter: The binary mask generated for the detected pupil.
- * @param center Output parameter: The coordinates ($\text{Point}$) of the detected pupil center.
- * @param radius Output parameter: The radius ($\text{int}$) of the detected pupil.
- * @param cannyLow Parameter: The lower threshold value used for the Canny edge detection pre-processing step.
- * @param cannyHigh Parameter: The upper threshold value used for the Canny edge detection pre-processing step.
- * @param houghMinR Parameter: The minimum radius to search for in the Hough transform algorithm.
- * @param houghMaxR Parameter: The maximum radius to search for in the Hough transform algorithm.
- * @param dp Parameter: The inverse ratio of the accumulator resolution to the image resolution (specific to OpenCV's HoughCircles).
- * @param minDist Parameter: The minimum distance required between the centers of detected circles.
- * @param houghParam1 
- * @param houghParam2 
- * @return the status as sucess or failure of segmentation
+ * @brief
+ * Combines the measurements of a candidate: darker inside and stronger edge coverage score
+ * higher, candidates far from the image center are penalized.
  */
-bool findPupilMask(const Mat &eyeGray, Mat &pupilMask, Point &center, int &radius, int cannyLow,
-                   int cannyHigh, int houghMinR, int houghMaxR, double dp, int minDist, int houghParam1,
-                   int houghParam2)
+static double candidateScore(const Mat &I, double meanVal, double edgeCoverage, Point2d center)
 {
-    if (eyeGray.empty() || eyeGray.channels() != 1)
-        return false;
+    // Score: darker inside + more edge coverage preferred
+    double score = (255.0 - meanVal) * 0.6 + edgeCoverage * 255.0 * 0.4;
+    // penalize circles outside central image area (CAHT uses hint weighting)
+    double cx = I.cols / 2.0, cy = I.rows / 2.0;
+    double dist = sqrt((center.x - cx) * (center.x - cx) + (center.y - cy) * (center.y - cy));
+    double distPenalty = std::max(0.0, dist - std::min(I.cols, I.rows) / 4.0);
+    score -= distPenalty * 0.05;
+    return score;
+}
 
-    Mat I;
-    preprocessForPupil(eyeGray, I);
+/**
+ * @brief
+ * Scores a candidate circle: darker inside and stronger edge coverage along the
+ * circumference score higher, circles far from the image center are penalized.
+ * @param I The preprocessed eye image.
+ * @param edges Edge map covering the region of I that starts at edgesOrigin.
+ * @param edgesOrigin Position of edges(0,0) in I.
+ * @param c The candidate circle in I coordinates.
+ * @return the score, negative for invalid candidates
+ */
+static double scoreCircle(const Mat &I, const Mat &edges, Point edgesOrigin, const Vec3f &c)
+{
+    Point cpt(cvRound(c[0]), cvRound(c[1]));
+    int r = cvRound(c[2]);
+    // ignore invalid
+    if (r <= 2)
+        return -1.0;
+    // compute mean intensity inside circle (pupil should be dark)
+    int x0 = std::max(0, cpt.x - r);
+    int y0 = std::max(0, cpt.y - r);
+    int x1 = std::min(I.cols - 1, cpt.x + r);
+    int y1 = std::min(I.rows - 1, cpt.y + r);
+    Rect roi(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+    if (roi.width <= 0 || roi.height <= 0)
+        return -1.0;
+    Mat patch = I(roi);
+    // mask for circle
+    Mat circMask = Mat::zeros(patch.size(), CV_8UC1);
+    circle(circMask, Point(cpt.x - x0, cpt.y - y0), r, Scalar(255), FILLED);
+    Scalar meanInside = mean(patch, circMask);
+    double meanVal = meanInside[0];
 
-    // 1) Generate edge map (similar role as caht's canny -> thin -> accumulation).
-    Mat edges;
+    // edge coverage: how many edge pixels around circle circumference (approx)
+    // sample N points on circumference and check edges
+    int N = std::max(20, r);
+    int edgeCount = 0;
+    for (int k = 0; k < N; k++)
+    {
+        double a = 2.0 * CV_PI * k / N;
+        int sx = cvRound(cpt.x + r * cos(a)) - edgesOrigin.x;
+        int sy = cvRound(cpt.y + r * sin(a)) - edgesOrigin.y;
+        if (sx >= 0 && sx < edges.cols && sy >= 0 && sy < edges.rows)
+        {
+            if (edges.at<uchar>(sy, sx) > 0)
+                edgeCount++;
+        }
+    }
+    double edgeCoverage = double(edgeCount) / double(N);
+
+    return candidateScore(I, meanVal, edgeCoverage, Point2d(cpt.x, cpt.y));
+}
+
+/**
+ * @brief
+ * scoreCircle for an ellipse: mean intensity inside the filled ellipse and edge coverage
+ * of points sampled along its boundary.
+ */
+static double scoreEllipse(const Mat &I, const Mat &edges, Point edgesOrigin, const RotatedRect &e)
+{
+    const double a = e.size.width / 2.0, b = e.size.height / 2.0;
+    if (std::min(a, b) <= 2)
+        return -1.0;
+    Rect roi = e.boundingRect() & Rect(0, 0, I.cols, I.rows);
+    if (roi.width <= 0 || roi.height <= 0)
+        return -1.0;
+    Mat inside = Mat::zeros(roi.size(), CV_8UC1);
+    RotatedRect shifted = e;
+    shifted.center -= Point2f((float)roi.x, (float)roi.y);
+    ellipse(inside, shifted, Scalar(255), FILLED);
+    if (countNonZero(inside) == 0)
+        return -1.0;
+    double meanVal = mean(I(roi), inside)[0];
+
+    const double theta = e.angle * CV_PI / 180.0, ct = cos(theta), st = sin(theta);
+    int N = std::max(20, cvRound((a + b) / 2));
+    int edgeCount = 0;
+    for (int k = 0; k < N; k++)
+    {
+        double t = 2.0 * CV_PI * k / N;
+        double u = a * cos(t), v = b * sin(t);
+        int sx = cvRound(e.center.x + u * ct - v * st) - edgesOrigin.x;
+        int sy = cvRound(e.center.y + u * st + v * ct) - edgesOrigin.y;
+        if (sx >= 0 && sx < edges.cols && sy >= 0 && sy < edges.rows && edges.at<uchar>(sy, sx) > 0)
+            edgeCount++;
+    }
+    return candidateScore(I, meanVal, double(edgeCount) / double(N), Point2d(e.center));
+}
+
+/**
+ * @brief
+ * Canny edge map followed by the streak removing morphological cleanup.
+ */
+void pupilEdgeMap(const Mat &I, Mat &edges, const PupilParams &params)
+{
     // Use Canny; CAHT uses a custom canny implementation, but Canny suffices here.
-    Canny(I, edges, cannyLow, cannyHigh, 3);
+    Canny(I, edges, params.cannyLow, params.cannyHigh, 3);
 
-    // 2) Some morphological cleanups (remove thin streaks similar to remove_streaks)
+    // Some morphological cleanups (remove thin streaks similar to remove_streaks)
     Mat kernel = getStructuringElement(MORPH_ELLIPSE, Size(3, 3));
     morphologyEx(edges, edges, MORPH_CLOSE, kernel);
     morphologyEx(edges, edges, MORPH_OPEN, kernel);
+}
 
-    // 3) Hough circle (OpenCV) to propose pupil candidates (CAHT uses its hough_circle)
-    vector<Vec3f> circles;
-    HoughCircles(I, circles, HOUGH_GRADIENT, dp, minDist, houghParam1, houghParam2, houghMinR, houghMaxR);
+PupilParams pupilParamsFromLandmarks(const vector<Point> &eyeLandmarks, const PupilParams &base)
+{
+    PupilParams params = base;
+    if (eyeLandmarks.size() < 6)
+        return params;
 
-    if (circles.empty())
+    Rect opening = boundingRect(eyeLandmarks);
+    double eyeWidth = opening.width;
+    if (eyeWidth < 10)
+        return params;
+
+    // iris/pupil radius is roughly 0.1 to 0.3 of the eye width
+    params.houghMinR = std::max(3, cvRound(eyeWidth * 0.08));
+    params.houghMaxR = std::max(params.houghMinR + 2, cvRound(eyeWidth * 0.32));
+    params.minDist = std::max(params.houghMinR, cvRound(eyeWidth * 0.25));
+
+    // the center is inside the opening, lids may hide part of the iris vertically
+    int padX = cvRound(eyeWidth * 0.05);
+    int padY = cvRound(eyeWidth * 0.10);
+    params.searchRegion = Rect(opening.x - padX, opening.y - padY,
+                               opening.width + 2 * padX, opening.height + 2 * padY);
+    return params;
+}
+
+/**
+ * @brief
+ * HoughCircles restricted to the circles centered in params.searchRegion; only the region
+ * grown by maxR is searched.
+ */
+static void houghInRegion(const Mat &I, vector<Vec3f> &circles, const PupilParams &params, double dp,
+                          double minDist, double param1, double param2, int minR, int maxR)
+{
+    circles.clear();
+    if (params.searchRegion.area() == 0)
     {
-        // fallback: try a more permissive parameter set
-        HoughCircles(I, circles, HOUGH_GRADIENT, 1.0, minDist / 2, houghParam1 / 2, houghParam2 / 2, houghMinR / 2, houghMaxR * 2);
+        HoughCircles(I, circles, HOUGH_GRADIENT, dp, minDist, param1, param2, minR, maxR);
+        return;
     }
 
-    if (circles.empty())
-        return false;
+    Rect window(params.searchRegion.x - maxR, params.searchRegion.y - maxR,
+                params.searchRegion.width + 2 * maxR, params.searchRegion.height + 2 * maxR);
+    window &= Rect(0, 0, I.cols, I.rows);
+    if (window.width <= 2 * minR || window.height <= 2 * minR)
+        return;
 
-    // 4) choose best candidate: prefer darker region + strong edge coverage (analogous to find_best_circle)
-    double bestScore = -1.0;
-    Vec3f bestC;
-    for (const auto &c : circles)
+    vector<Vec3f> found;
+    HoughCircles(I(window), found, HOUGH_GRADIENT, dp, minDist, param1, param2, minR, maxR);
+    for (auto c : found)
     {
-        Point cpt(cvRound(c[0]), cvRound(c[1]));
-        int r = cvRound(c[2]);
-        // ignore invalid
-        if (r <= 2)
-            continue;
-        // compute mean intensity inside circle (pupil should be dark)
-        int x0 = std::max(0, cpt.x - r);
-        int y0 = std::max(0, cpt.y - r);
-        int x1 = std::min(I.cols - 1, cpt.x + r);
-        int y1 = std::min(I.rows - 1, cpt.y + r);
-        Rect roi(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
-        if (roi.width <= 0 || roi.height <= 0)
-            continue;
-        Mat patch = I(roi);
-        // mask for circle
-        Mat circMask = Mat::zeros(patch.size(), CV_8UC1);
-        circle(circMask, Point(cpt.x - x0, cpt.y - y0), r, Scalar(255), FILLED);
-        Scalar meanInside = mean(patch, circMask);
-        double meanVal = meanInside[0];
-
-        // edge coverage: how many edge pixels around circle circumference (approx)
-        // sample N points on circumference and check edges
-        int N = std::max(20, r);
-        int edgeCount = 0;
-        for (int k = 0; k < N; k++)
-        {
-            double a = 2.0 * CV_PI * k / N;
-            int sx = cvRound(cpt.x + r * cos(a));
-            int sy = cvRound(cpt.y + r * sin(a));
-            if (sx >= 0 && sx < edges.cols && sy >= 0 && sy < edges.rows)
-            {
-                if (edges.at<uchar>(sy, sx) > 0)
-                    edgeCount++;
-            }
-        }
-        double edgeCoverage = double(edgeCount) / double(N);
-
-        // Score: darker inside + more edge coverage preferred
-        double score = (255.0 - meanVal) * 0.6 + edgeCoverage * 255.0 * 0.4;
-        // penalize circles outside central image area (CAHT uses hint weighting)
-        double cx = I.cols / 2.0, cy = I.rows / 2.0;
-        double dist = sqrt((cpt.x - cx) * (cpt.x - cx) + (cpt.y - cy) * (cpt.y - cy));
-        double distPenalty = std::max(0.0, dist - std::min(I.cols, I.rows) / 4.0);
-        score -= distPenalty * 0.05;
+        c[0] += window.x;
+        c[1] += window.y;
+        if (params.searchRegion.contains(Point(cvRound(c[0]), cvRound(c[1]))))
+            circles.push_back(c);
+    }
+}
 
+/**
+ * @brief
+ * Picks the best scoring circle (analogous to CAHT's find_best_circle).
+ * @return false if no candidate has a non negative score
+ */
+static bool pickBestCircle(const Mat &I, const Mat &edges, Point edgesOrigin,
+                           const vector<Vec3f> &circles, Vec3f &bestC, double &bestScore)
+{
+    bestScore = -1.0;
+    for (const auto &c : circles)
+    {
+        double score = scoreCircle(I, edges, edgesOrigin, c);
         if (score > bestScore)
         {
             bestScore = score;
             bestC = c;
         }
     }
+    return bestScore >= 0;
+}
 
-    if (bestScore < 0)
-        return false;
+/**
+ * @brief
+ * Specular highlight handling shared by the pupil masks: the pixels of the shape brighter
+ * than its Otsu threshold, opened, and their small connected components kept in the mask.
+ * @param local The image region around the shape.
+ * @param inside The filled shape, the size of local.
+ * @param offset Position of local in mask.
+ * @param mask The mask being built.
+ */
+static void keepSmallHighlights(const Mat &local, const Mat &inside, Point offset, Mat &mask)
+{
+    // Extract pixel values inside the pupil
+    Mat pupilVals;
+    local.copyTo(pupilVals, inside);
 
-    center = Point(cvRound(bestC[0]), cvRound(bestC[1]));
-    radius = cvRound(bestC[2]);
+    // Threshold to find bright pixels (specular highlights)
+    double t = threshold(pupilVals, pupilVals, 0, 255, THRESH_BINARY | THRESH_OTSU);
+
+    // Highlights are pixels > t
+    Mat highlights = (local > t + 10) & inside;
+
+    // Morphological operations to clean noise
+    morphologyEx(highlights, highlights, MORPH_OPEN,
+                 getStructuringElement(MORPH_ELLIPSE, Size(3, 3)));
 
-    // 5) produce mask (filled circle). Optionally refine mask using local thresholding
-    pupilMask = Mat::zeros(I.size(), CV_8UC1);
-    circle(pupilMask, center, radius, Scalar(255), FILLED);
+    // Connected component analysis
+    Mat labels, stats, centroids;
+    int nCC = connectedComponentsWithStats(highlights, labels, stats, centroids);
 
+    for (int i = 1; i < nCC; i++)
+    { // skip label 0 (background)
+        int area = stats.at<int>(i, CC_STAT_AREA);
+        int left = stats.at<int>(i, CC_STAT_LEFT);
+        int top = stats.at<int>(i, CC_STAT_TOP);
+        int w = stats.at<int>(i, CC_STAT_WIDTH);
+        int h = stats.at<int>(i, CC_STAT_HEIGHT);
+
+        // Heuristic: specular highlights are small
+        // If needed, change max area depending on image resolution.
+        if (area < 300)
+        {
+            // Remove highlight → fill region in the pupil mask
+            for (int yy = top; yy < top + h; yy++)
+            {
+                for (int xx = left; xx < left + w; xx++)
+                {
+                    if (labels.at<int>(yy, xx) == i)
+                    {
+                        mask.at<uchar>(offset.y + yy, offset.x + xx) = 255; // restore
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief
+ * Builds the pupil mask of the chosen circle: filled circle, specular highlight
+ * handling and final morphological clean. Only the circle's box is allocated; the
+ * result is the same as on a crop sized mask.
+ * @return false if the resulting mask is too small to be a pupil
+ */
+static bool buildPupilMask(const Mat &I, Point center, int radius, PupilMask &pupilMask)
+{
+    // the mask never reaches past the circle by more than the 2 px erasures and the 5x5 close
+    const int pad = 4;
+    Rect box = Rect(center.x - radius - pad, center.y - radius - pad,
+                    2 * (radius + pad) + 1, 2 * (radius + pad) + 1) & Rect(0, 0, I.cols, I.rows);
+    pupilMask.size = I.size();
+    pupilMask.roi = box;
+    pupilMask.local.release();
+    if (box.area() == 0)
+        return false;
+    Point o = box.tl();
+
+    // produce mask (filled circle). Optionally refine mask using local thresholding
+    Mat mask = Mat::zeros(box.size(), CV_8UC1);
+    circle(mask, center - o, radius, Scalar(255), FILLED);
     //Specular highlight removal
     {
         // Extract local ROI around pupil
@@ -153,49 +329,7 @@ bool findPupilMask(const Mat &eyeGray, Mat &pupilMask, Point &center, int &radiu
         Mat localPupilMask = Mat::zeros(local.size(), CV_8UC1);
         circle(localPupilMask, Point(radius, radius), radius, Scalar(255), FILLED);
 
-        // Extract pixel values inside the pupil
-        Mat pupilVals;
-        local.copyTo(pupilVals, localPupilMask);
-
-        // Threshold to find bright pixels (specular highlights)
-        double t = threshold(pupilVals, pupilVals, 0, 255, THRESH_BINARY | THRESH_OTSU);
-
-        // Highlights are pixels > t
-        Mat highlights = (local > t + 10) & localPupilMask;
-
-        // Morphological operations to clean noise
-        morphologyEx(highlights, highlights, MORPH_OPEN,
-                     getStructuringElement(MORPH_ELLIPSE, Size(3, 3)));
-
-        // Connected component analysis
-        Mat labels, stats, centroids;
-        int nCC = connectedComponentsWithStats(highlights, labels, stats, centroids);
-
-        for (int i = 1; i < nCC; i++)
-        { // skip label 0 (background)
-            int area = stats.at<int>(i, CC_STAT_AREA);
-            int left = stats.at<int>(i, CC_STAT_LEFT);
-            int top = stats.at<int>(i, CC_STAT_TOP);
-            int w = stats.at<int>(i, CC_STAT_WIDTH);
-            int h = stats.at<int>(i, CC_STAT_HEIGHT);
-
-            // Heuristic: specular highlights are small
-            // If needed, change max area depending on image resolution.
-            if (area < 300)
-            {
-                // Remove highlight → fill region in the pupil mask
-                for (int yy = top; yy < top + h; yy++)
-                {
-                    for (int xx = left; xx < left + w; xx++)
-                    {
-                        if (labels.at<int>(yy, xx) == i)
-                        {
-                            pupilMask.at<uchar>(y0 + yy, x0 + xx) = 255; // restore
-                        }
-                    }
-                }
-            }
-        }
+        keepSmallHighlights(local, localPupilMask, Point(x0 - o.x, y0 - o.y), mask);
     }
     // Create small mask of inside, apply Otsu on that area to separate specular spots
     Rect roi(max(0, center.x - radius), max(0, center.y - radius),
@@ -218,19 +352,518 @@ bool findPupilMask(const Mat &eyeGray, Mat &pupilMask, Point &center, int &radiu
                 if (localMask.at<uchar>(y, x) && local.at<uchar>(y, x) > t + 10)
                 {
                     // erase small region
-                    circle(pupilMask, Point(roi.x + x, roi.y + y), 2, Scalar(0), FILLED);
+                    circle(mask, Point(roi.x + x - o.x, roi.y + y - o.y), 2, Scalar(0), FILLED);
                 }
             }
         }
     }
 
     // final morphological clean
-    morphologyEx(pupilMask, pupilMask, MORPH_OPEN, getStructuringElement(MORPH_ELLIPSE, Size(3, 3)));
-    morphologyEx(pupilMask, pupilMask, MORPH_CLOSE, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
+    morphologyEx(mask, mask, MORPH_OPEN, getStructuringElement(MORPH_ELLIPSE, Size(3, 3)));
+    morphologyEx(mask, mask, MORPH_CLOSE, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
+    pupilMask.local = mask;
 
     // sanity check: ensure mask area is reasonable
-    double area = countNonZero(pupilMask);
+    double area = countNonZero(mask);
     if (area < 10.0)
         return false;
     return true;
 }
+
+/**
+ * @brief
+ * Edge point seen by the Ransac detector, with its unit gradient (dark side to bright side).
+ */
+struct EdgePoint
+{
+    Point2f p;
+    Point2f g;
+};
+
+/**
+ * @brief
+ * Intensity at or below which the given fraction of the pixels of I lie.
+ */
+static int darkLevel(const Mat &I, double fraction)
+{
+    int hist[256] = {};
+    for (int y = 0; y < I.rows; y++)
+    {
+        const uchar *row = I.ptr<uchar>(y);
+        for (int x = 0; x < I.cols; x++)
+            hist[row[x]]++;
+    }
+    const double target = fraction * I.rows * I.cols;
+    double acc = 0;
+    for (int v = 0; v < 256; v++)
+    {
+        acc += hist[v];
+        if (acc >= target)
+            return v;
+    }
+    return 255;
+}
+
+/**
+ * @brief
+ * Edge pixels of window whose dark side, two pixels against the gradient, is at most level:
+ * the boundary of a dark region, seen from outside. Evenly subsampled to maxPoints.
+ * @param stride Output parameter: one candidate in stride was kept.
+ */
+static void darkSideEdgePoints(const Mat &I, const Mat &edges, Rect window, int level, int maxPoints,
+                               vector<EdgePoint> &points, int &stride)
+{
+    Mat dx, dy;
+    Sobel(I(window), dx, CV_16S, 1, 0, 3);
+    Sobel(I(window), dy, CV_16S, 0, 1, 3);
+
+    vector<EdgePoint> all;
+    for (int y = 0; y < window.height; y++)
+    {
+        const uchar *e = edges.ptr<uchar>(window.y + y) + window.x;
+        const short *gx = dx.ptr<short>(y), *gy = dy.ptr<short>(y);
+        for (int x = 0; x < window.width; x++)
+        {
+            if (!e[x])
+                continue;
+            float n = std::sqrt((float)gx[x] * gx[x] + (float)gy[x] * gy[x]);
+            if (n < 1.0f)
+                continue;
+            Point2f g(gx[x] / n, gy[x] / n);
+            Point2f p((float)(window.x + x), (float)(window.y + y));
+            Point q(cvRound(p.x - 2 * g.x), cvRound(p.y - 2 * g.y));
+            if (q.x < 0 || q.y < 0 || q.x >= I.cols || q.y >= I.rows || I.at<uchar>(q) > level)
+                continue;
+            all.push_back({p, g});
+        }
+    }
+
+    stride = std::max(1, ((int)all.size() + maxPoints - 1) / std::max(1, maxPoints));
+    points.clear();
+    for (size_t i = 0; i < all.size(); i += stride)
+        points.push_back(all[i]);
+}
+
+/**
+ * @brief
+ * Whether an edge point lies on the ellipse, within tol pixels (measured along the ray from
+ * the center), with its gradient pointing outwards as on the boundary of a dark pupil.
+ */
+static bool onEllipse(const RotatedRect &e, float ct, float st, const EdgePoint &ep, float tol)
+{
+    float dx = ep.p.x - e.center.x, dy = ep.p.y - e.center.y;
+    if (dx * ep.g.x + dy * ep.g.y <= 0)
+        return false;
+    float u = dx * ct + dy * st, v = -dx * st + dy * ct;
+    float len = std::sqrt(u * u + v * v);
+    float a = e.size.width / 2, b = e.size.height / 2;
+    float r = std::sqrt((u / a) * (u / a) + (v / b) * (v / b));
+    if (len < 1e-3f || r < 1e-3f)
+        return false;
+    return std::abs(r - 1.0f) * len / r <= tol;
+}
+
+/**
+ * @brief
+ * Whether a fitted ellipse can be a pupil: major semi-axis in [minR, maxR], not too flat,
+ * center inside the search region (or the crop).
+ */
+static bool plausibleEllipse(const RotatedRect &e, const PupilParams &params, int minR, int maxR, Size imageSize)
+{
+    float major = std::max(e.size.width, e.size.height) / 2, minor = std::min(e.size.width, e.size.height) / 2;
+    if (!(minor > 0) || major < minR || major > maxR || minor < major * params.ransacMinAxisRatio)
+        return false;
+    Point c(cvRound(e.center.x), cvRound(e.center.y));
+    return params.searchRegion.area() > 0 ? params.searchRegion.contains(c)
+                                          : Rect(Point(0, 0), imageSize).contains(c);
+}
+
+/**
+ * @brief
+ * Number of edge points on an ellipse.
+ */
+static int countInliers(const RotatedRect &e, const vector<EdgePoint> &points, float tol)
+{
+    const float theta = (float)(e.angle * CV_PI / 180.0), ct = std::cos(theta), st = std::sin(theta);
+    int n = 0;
+    for (const EdgePoint &ep : points)
+        if (onEllipse(e, ct, st, ep, tol))
+            n++;
+    return n;
+}
+
+/**
+ * @brief
+ * Bounded RANSAC over the dark side edge points: each iteration fits an ellipse to a seed
+ * point and four points within a pupil diameter of it, and counts its inliers. The few
+ * best supported ellipses are refitted to all their inliers.
+ * @param candidates Output parameter: the refined ellipses.
+ */
+static void ransacEllipses(const Mat &I, const Mat &edges, const PupilParams &params, int minR, int maxR,
+                           vector<RotatedRect> &candidates)
+{
+    candidates.clear();
+    Rect window(0, 0, I.cols, I.rows);
+    if (params.searchRegion.area() > 0)
+        window &= Rect(params.searchRegion.x - maxR, params.searchRegion.y - maxR,
+                       params.searchRegion.width + 2 * maxR, params.searchRegion.height + 2 * maxR);
+    if (window.width <= 2 * minR || window.height <= 2 * minR)
+        return;
+
+    vector<EdgePoint> points;
+    int stride;
+    darkSideEdgePoints(I, edges, window, darkLevel(I(window), params.ransacDarkPercentile),
+                       params.ransacMaxPoints, points, stride);
+    if (points.size() < 5)
+        return;
+
+    struct Hypothesis
+    {
+        RotatedRect e;
+        int inliers;
+    };
+    const int keep = 4;
+    vector<Hypothesis> best;
+
+    const float tol = (float)params.ransacTolerance;
+    const float reach2 = 4.0f * maxR * maxR;
+    CustomEllipseFitter fitter;
+    RNG rng(0x5eed);
+    vector<int> near;
+    near.reserve(points.size());
+    Point2f sample[5];
+
+    for (int it = 0; it < params.ransacIterations; it++)
+    {
+        const EdgePoint &seed = points[rng.uniform(0, (int)points.size())];
+        near.clear();
+        for (int i = 0; i < (int)points.size(); i++)
+        {
+            Point2f d = points[i].p - seed.p;
+            if (d.x * d.x + d.y * d.y <= reach2)
+                near.push_back(i);
+        }
+        if (near.size() < 5)
+            continue;
+        sample[0] = seed.p;
+        for (int k = 1; k < 5; k++)
+            sample[k] = points[near[rng.uniform(0, (int)near.size())]].p;
+
+        RotatedRect e;
+        if (fitter.tryFit(sample, 5, e) != EllipseFitStatus::Ok || !plausibleEllipse(e, params, minR, maxR, I.size()))
+            continue;
+        int inliers = countInliers(e, points, tol);
+
+        // the same pupil is found many times: keep the best fit per center
+        bool merged = false;
+        for (Hypothesis &h : best)
+        {
+            Point2f d = h.e.center - e.center;
+            if (d.x * d.x + d.y * d.y <= 4.0f)
+            {
+                if (inliers > h.inliers)
+                    h = {e, inliers};
+                merged = true;
+                break;
+            }
+        }
+        if (!merged)
+            best.push_back({e, inliers});
+        std::sort(best.begin(), best.end(), [](const Hypothesis &x, const Hypothesis &y) { return x.inliers > y.inliers; });
+        if ((int)best.size() > keep)
+            best.resize(keep);
+    }
+
+    vector<Point2f> support;
+    for (const Hypothesis &h : best)
+    {
+        // inliers stand for stride edge pixels each; compare with the perimeter (Ramanujan)
+        double a = h.e.size.width / 2.0, b = h.e.size.height / 2.0;
+        double perimeter = CV_PI * (3 * (a + b) - std::sqrt((3 * a + b) * (a + 3 * b)));
+        if (h.inliers * stride < params.ransacMinSupport * perimeter)
+            continue;
+
+        const float theta = (float)(h.e.angle * CV_PI / 180.0), ct = std::cos(theta), st = std::sin(theta);
+        support.clear();
+        for (const EdgePoint &ep : points)
+            if (onEllipse(h.e, ct, st, ep, tol))
+                support.push_back(ep.p);
+
+        RotatedRect refined;
+        if (fitter.tryFit(support.data(), (int)support.size(), refined) == EllipseFitStatus::Ok &&
+            plausibleEllipse(refined, params, minR, maxR, I.size()))
+            candidates.push_back(refined);
+        else
+            candidates.push_back(h.e);
+    }
+}
+
+/**
+ * @brief
+ * buildPupilMask for an ellipse: the filled ellipse with the same specular highlight
+ * handling (small opened highlight components, then the pixels brighter than the Otsu
+ * threshold of its inside erased) and the same final clean.
+ * @return false if the resulting mask is too small to be a pupil
+ */
+static bool buildEllipseMask(const Mat &I, const RotatedRect &e, PupilMask &pupilMask)
+{
+    const int pad = 4;
+    Rect eb = e.boundingRect();
+    Rect box = Rect(eb.x - pad, eb.y - pad, eb.width + 2 * pad, eb.height + 2 * pad) & Rect(0, 0, I.cols, I.rows);
+    pupilMask.size = I.size();
+    pupilMask.roi = box;
+    pupilMask.local.release();
+    if (box.area() == 0)
+        return false;
+
+    Mat inside = Mat::zeros(box.size(), CV_8UC1);
+    RotatedRect shifted = e;
+    shifted.center -= Point2f((float)box.x, (float)box.y);
+    ellipse(inside, shifted, Scalar(255), FILLED);
+    Mat mask = inside.clone();
+
+    keepSmallHighlights(I(box), inside, Point(0, 0), mask);
+    if (box.width > 10 && box.height > 10)
+    {
+        Mat local = I(box);
+        Mat localVals;
+        local.copyTo(localVals, inside);
+        double t = threshold(localVals, localVals, 0, 255, THRESH_BINARY | THRESH_OTSU);
+        for (int y = 0; y < local.rows; y++)
+            for (int x = 0; x < local.cols; x++)
+                if (inside.at<uchar>(y, x) && local.at<uchar>(y, x) > t + 10)
+                    circle(mask, Point(x, y), 2, Scalar(0), FILLED);
+    }
+
+    morphologyEx(mask, mask, MORPH_OPEN, getStructuringElement(MORPH_ELLIPSE, Size(3, 3)));
+    morphologyEx(mask, mask, MORPH_CLOSE, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
+    pupilMask.local = mask;
+    return countNonZero(mask) >= 10;
+}
+
+bool findPupilEllipsePrepared(const Mat &I, const Mat &edges, PupilMask &pupilMask, RotatedRect &ellipseBox,
+                              const PupilParams &params, double *score)
+{
+    vector<RotatedRect> candidates;
+    ransacEllipses(I, edges, params, params.houghMinR, params.houghMaxR, candidates);
+    if (candidates.empty() && params.permissiveFallback)
+    {
+        // fallback: the wider radius band of the permissive Hough pass
+        ransacEllipses(I, edges, params, params.houghMinR / 2, params.houghMaxR * 2, candidates);
+    }
+
+    double bestScore = -1.0;
+    for (const RotatedRect &e : candidates)
+    {
+        double s = scoreEllipse(I, edges, Point(0, 0), e);
+        if (s > bestScore)
+        {
+            bestScore = s;
+            ellipseBox = e;
+        }
+    }
+    if (bestScore < 0)
+        return false;
+    if (score)
+        *score = bestScore;
+    return buildEllipseMask(I, ellipseBox, pupilMask);
+}
+
+/**
+ * @brief 
+ * The core function that performs contrast adaptive hough transform
+ * to segment the pupil mask from the eye segment
+ * pupil being the darkest region in the eye
+ * @param eyeGray The input grayscale image patch containing the isolated eye region
+ * @param pupilMask Output parameter: The binary mask generated for the detected pupil.
+ * @param center Output parameter: The coordinates ($\text{Point}$) of the detected pupil center.
+ * @param radius Output parameter: The radius ($\text{int}$) of the detected pupil.
+ * @param cannyLow Parameter: The lower threshold value used for the Canny edge detection pre-processing step.
+ * @param cannyHigh Parameter: The upper threshold value used for the Canny edge detection pre-processing step.
+ * @param houghMinR Parameter: The minimum radius to search for in the Hough transform algorithm.
+ * @param houghMaxR Parameter: The maximum radius to search for in the Hough transform algorithm.
+ * @param dp Parameter: The inverse ratio of the accumulator resolution to the image resolution (specific to OpenCV's HoughCircles).
+ * @param minDist Parameter: The minimum distance required between the centers of detected circles.
+ * @param houghParam1 
+ * @param houghParam2 
+ * @return the status as sucess or failure of segmentation
+ */
+bool findPupilMask(const Mat &eyeGray, Mat &pupilMask, Point &center, int &radius, int cannyLow,
+                   int cannyHigh, int houghMinR, int houghMaxR, double dp, int minDist, int houghParam1,
+                   int houghParam2)
+{
+    PupilParams params;
+    params.cannyLow = cannyLow;
+    params.cannyHigh = cannyHigh;
+    params.houghMinR = houghMinR;
+    params.houghMaxR = houghMaxR;
+    params.dp = dp;
+    params.minDist = minDist;
+    params.houghParam1 = houghParam1;
+    params.houghParam2 = houghParam2;
+    return findPupilMask(eyeGray, pupilMask, center, radius, params);
+}
+
+/**
+ * @brief
+ * findPupilMask with the tuning parameters grouped in a PupilParams.
+ * @param score Optional output: the score of the chosen circle.
+ */
+bool findPupilMask(const Mat &eyeGray, Mat &pupilMask, Point &center, int &radius,
+                   const PupilParams &params, double *score)
+{
+    PupilMask compact;
+    if (!findPupilMask(eyeGray, compact, center, radius, params, score))
+        return false;
+    pupilMask = compact.full();
+    return true;
+}
+
+/**
+ * @brief
+ * findPupilMask producing the compact mask of the pupil's box.
+ */
+bool findPupilMask(const Mat &eyeGray, PupilMask &pupilMask, Point &center, int &radius,
+                   const PupilParams &params, double *score)
+{
+    if (eyeGray.empty() || eyeGray.channels() != 1)
+        return false;
+
+    Mat I;
+    preprocessForPupil(eyeGray, I);
+
+    // 1) Generate edge map (similar role as caht's canny -> thin -> accumulation).
+    // 2) Some morphological cleanups (remove thin streaks similar to remove_streaks)
+    Mat edges;
+    pupilEdgeMap(I, edges, params);
+
+    return findPupilMaskPrepared(I, edges, pupilMask, center, radius, params, score);
+}
+
+/**
+ * @brief
+ * The Hough, candidate selection and mask stages of findPupilMask, starting from an
+ * image already passed through preprocessForPupil and its pupilEdgeMap. Lets callers
+ * that evaluate many parameter sets share the earlier stages.
+ */
+bool findPupilMaskPrepared(const Mat &I, const Mat &edges, PupilMask &pupilMask, Point &center, int &radius,
+                           const PupilParams &params, double *score)
+{
+    if (params.detector == PupilDetector::Ransac)
+    {
+        RotatedRect e;
+        if (!findPupilEllipsePrepared(I, edges, pupilMask, e, params, score))
+            return false;
+        center = Point(cvRound(e.center.x), cvRound(e.center.y));
+        radius = cvRound(std::sqrt((double)e.size.width * e.size.height) / 2);
+        return true;
+    }
+
+    // 3) Hough circle (OpenCV) to propose pupil candidates (CAHT uses its hough_circle)
+    vector<Vec3f> circles;
+    houghInRegion(I, circles, params, params.dp, params.minDist, params.houghParam1, params.houghParam2,
+                  params.houghMinR, params.houghMaxR);
+
+    if (circles.empty() && params.permissiveFallback)
+    {
+        // fallback: try a more permissive parameter set
+        houghInRegion(I, circles, params, 1.0, params.minDist / 2, params.houghParam1 / 2,
+                      params.houghParam2 / 2, params.houghMinR / 2, params.houghMaxR * 2);
+    }
+
+    if (circles.empty())
+        return false;
+
+    // 4) choose best candidate: prefer darker region + strong edge coverage (analogous to find_best_circle)
+    double bestScore;
+    Vec3f bestC;
+    if (!pickBestCircle(I, edges, Point(0, 0), circles, bestC, bestScore))
+        return false;
+
+    center = Point(cvRound(bestC[0]), cvRound(bestC[1]));
+    radius = cvRound(bestC[2]);
+    if (score)
+        *score = bestScore;
+
+    // 5) produce mask (filled circle) and handle specular highlights
+    return buildPupilMask(I, center, radius, pupilMask);
+}
+
+/**
+ * @brief
+ * Video variant of findPupilMask that starts from the pupil found in the previous frame.
+ * Edges and Hough circles are only computed in a small window around the previous center
+ * and within a narrow radius band, both kept inside houghMinR..houghMaxR and searchRegion
+ * like the full search; the full search of findPupilMask runs only when no
+ * candidate is found there or its score drops below trackAccept times the previous score.
+ * @param prior The previous pupil, center mapped into this crop's coordinates.
+ * @param tracked Optional output: true if the narrow search was accepted.
+ */
+bool findPupilMaskTracked(const Mat &eyeGray, PupilMask &pupilMask, Point &center, int &radius,
+                          const PupilTrack &prior, const PupilParams &params, double *score, bool *tracked)
+{
+    if (tracked)
+        *tracked = false;
+    if (eyeGray.empty() || eyeGray.channels() != 1)
+        return false;
+    if (!prior.valid || prior.radius <= 2 || params.detector == PupilDetector::Ransac)
+        return findPupilMask(eyeGray, pupilMask, center, radius, params, score);
+
+    Mat I;
+    preprocessForPupil(eyeGray, I);
+
+    // the narrow band never leaves the radius range and center region of the full search
+    float r0 = prior.radius;
+    int minR = std::max({3, params.houghMinR, cvFloor(r0 * (1.0 - params.trackBand))});
+    int maxR = std::min(params.houghMaxR, cvCeil(r0 * (1.0 + params.trackBand)));
+    int reach = maxR + std::max(4, cvRound(r0 * params.trackMargin));
+
+    Rect window(cvRound(prior.center.x) - reach, cvRound(prior.center.y) - reach, 2 * reach + 1, 2 * reach + 1);
+    window &= Rect(0, 0, I.cols, I.rows);
+    if (params.searchRegion.area() > 0)
+        window &= Rect(params.searchRegion.x - maxR, params.searchRegion.y - maxR,
+                       params.searchRegion.width + 2 * maxR, params.searchRegion.height + 2 * maxR);
+
+    if (minR <= maxR && window.width > 2 * minR && window.height > 2 * minR)
+    {
+        Mat local = I(window);
+        Mat edges;
+        pupilEdgeMap(local, edges, params);
+
+        vector<Vec3f> circles;
+        HoughCircles(local, circles, HOUGH_GRADIENT, params.dp, params.minDist, params.houghParam1,
+                     params.houghParam2, minR, maxR);
+        for (auto &c : circles)
+        {
+            c[0] += window.x;
+            c[1] += window.y;
+        }
+        if (params.searchRegion.area() > 0)
+            circles.erase(std::remove_if(circles.begin(), circles.end(), [&](const Vec3f &c) {
+                              return !params.searchRegion.contains(Point(cvRound(c[0]), cvRound(c[1])));
+                          }), circles.end());
+
+        double bestScore;
+        Vec3f bestC;
+        if (pickBestCircle(I, edges, window.tl(), circles, bestC, bestScore) &&
+            bestScore >= prior.score * params.trackAccept)
+        {
+            center = Point(cvRound(bestC[0]), cvRound(bestC[1]));
+            radius = cvRound(bestC[2]);
+            if (buildPupilMask(I, center, radius, pupilMask))
+            {
+                if (score)
+                    *score = bestScore;
+                if (tracked)
+                    *tracked = true;
+                return true;
+            }
+        }
+    }
+
+    // the pupil moved out of the window or the narrow search lost it: full search on the
+    // same preprocessed crop
+    Mat edges;
+    pupilEdgeMap(I, edges, params);
+    return findPupilMaskPrepared(I, edges, pupilMask, center, radius, params, score);
+}
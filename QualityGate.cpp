@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <atomic>
+#include "QualityGate.h"
+
+using namespace cv;
+
+static std::atomic<uint64_t> verdictCounts[(int)QualityStage::Count][(int)QualityVerdict::Count];
+
+QualityGate eyeQualityGate()
+{
+    QualityGate gate;
+    gate.minSharpness = 5.0;
+    gate.minLuma = 20.0;
+    gate.maxLuma = 235.0;
+    gate.maxClipped = 0.6;
+    return gate;
+}
+
+QualityStats measureQuality(const Mat& image, int maxSide)
+{
+    QualityStats stats;
+    if (image.empty()) return stats;
+
+    // shrink first: the color conversion then runs on the small copy only
+    Mat small = image;
+    int side = std::max(image.cols, image.rows);
+    if (maxSide > 0 && side > maxSide) {
+        double f = (double)maxSide / side;
+        resize(image, small, Size(std::max(1, cvRound(image.cols * f)), std::max(1, cvRound(image.rows * f))),
+               0, 0, INTER_AREA);
+    }
+    Mat gray = small;
+    if (small.channels() == 3) cvtColor(small, gray, COLOR_BGR2GRAY);
+    if (gray.depth() != CV_8U) gray.convertTo(gray, CV_8U);
+
+    Mat lap;
+    Laplacian(gray, lap, CV_16S);
+    Scalar mean, stddev;
+    meanStdDev(lap, mean, stddev);
+    stats.sharpness = stddev[0] * stddev[0];
+
+    stats.luma = cv::mean(gray)[0];
+    double n = (double)gray.total();
+    stats.clipped = (countNonZero(gray <= 5) + countNonZero(gray >= 250)) / n;
+    return stats;
+}
+
+QualityVerdict checkQuality(const Mat& image, const QualityGate& gate, QualityStage stage)
+{
+    if (!gate.enabled) return QualityVerdict::Pass;
+
+    QualityStats s = measureQuality(image, gate.maxSide);
+    QualityVerdict v = QualityVerdict::Pass;
+    if (s.luma < gate.minLuma)                 v = QualityVerdict::Dark;
+    else if (s.luma > gate.maxLuma)            v = QualityVerdict::Bright;
+    else if (s.clipped > gate.maxClipped)      v = QualityVerdict::Clipped;
+    else if (s.sharpness < gate.minSharpness)  v = QualityVerdict::Blurry;
+
+    verdictCounts[(int)stage][(int)v].fetch_add(1, std::memory_order_relaxed);
+    return v;
+}
+
+QualityGateStats qualityGateStats()
+{
+    QualityGateStats stats;
+    for (int s = 0; s < (int)QualityStage::Count; s++)
+        for (int v = 0; v < (int)QualityVerdict::Count; v++)
+            stats.byVerdict[s][v] = verdictCounts[s][v].load(std::memory_order_relaxed);
+    return stats;
+}
+
+void printQualityGateStats(std::ostream& out)
+{
+    QualityGateStats stats = qualityGateStats();
+    const char* names[(int)QualityStage::Count] = {"FRAME GATE", "EYE GATE"};
+    for (int s = 0; s < (int)QualityStage::Count; s++) {
+        uint64_t total = 0;
+        for (uint64_t n : stats.byVerdict[s]) total += n;
+        if (total == 0) continue;
+
+        out << names[s] << " : " << total << " checked\n";
+        for (int v = 0; v < (int)QualityVerdict::Count; v++)
+            if (v == (int)QualityVerdict::Pass || stats.byVerdict[s][v] > 0)
+                out << "  " << qualityVerdictName((QualityVerdict)v) << ": " << stats.byVerdict[s][v] << "\n";
+    }
+}
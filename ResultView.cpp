@@ -0,0 +1,165 @@
+#include <chrono>
+#include <exception>
+#include "ResultView.h"
+
+using namespace cv;
+using std::string;
+
+Mat renderEyePanel(const Mat& eye, const PupilMask& mask, double biou, Size tile)
+{
+    Mat bgr, maskColor, combined;
+    if (eye.channels() == 1) cvtColor(eye, bgr, COLOR_GRAY2BGR);
+    else bgr = eye;
+
+    renderPupilMask(mask.size != bgr.size() ? mask.resized(bgr.size()) : mask, maskColor);
+    if (tile.area() > 0) {
+        resize(bgr, bgr, tile, 0, 0, INTER_AREA);
+        resize(maskColor, maskColor, tile, 0, 0, INTER_NEAREST);
+    }
+
+    string label = "BIoU = " + std::to_string(biou).substr(0, 6);
+    putText(maskColor, label, Point(10, 25), FONT_HERSHEY_SIMPLEX, 0.6, Scalar(0, 255, 0), 2);
+
+    hconcat(bgr, maskColor, combined);
+    return combined;
+}
+
+Mat renderFaceRow(const FaceResult* face, const string& caption, Size tile)
+{
+    Mat row(tile.height, 4 * tile.width, CV_8UC3, Scalar(0, 0, 0));
+    if (face) {
+        int x = 0;
+        for (const EyeResult* eye : {&face->left, &face->right}) {
+            Rect dst(x, 0, 2 * tile.width, tile.height);
+            if (eye->found)
+                renderEyePanel(eye->eye, eye->mask, eye->biou, tile).copyTo(row(dst));
+            else
+                putText(row, "pupil not found", Point(x + 10, tile.height / 2), FONT_HERSHEY_SIMPLEX, 0.5,
+                        Scalar(0, 0, 255), 1);
+            x += 2 * tile.width;
+        }
+    } else {
+        putText(row, "no face", Point(10, tile.height / 2), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 0, 255), 1);
+    }
+    putText(row, caption, Point(10, tile.height - 10), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 255, 0), 1);
+    return row;
+}
+
+void ResultDisplay::post(const Mat& image)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        latest = image;
+        fresh = true;
+        posted++;
+    }
+    cv.notify_all();
+}
+
+void ResultDisplay::run(const std::function<void()>& work, bool holdAtEnd)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        done = false;
+    }
+    // an exception must not escape the thread (std::terminate): it is rethrown here instead
+    std::exception_ptr error;
+    std::thread worker([&]() {
+        try {
+            work();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            done = true;
+        }
+        cv.notify_all();
+    });
+
+    bool finished = false;
+    while (!finished) {
+        Mat image;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait_for(lock, std::chrono::milliseconds(30), [&]() { return fresh || done; });
+            if (fresh) {
+                image = latest;
+                fresh = false;
+            }
+            finished = done && !fresh;
+        }
+        if (!image.empty()) {
+            imshow(window, image);
+            shown++;
+        }
+        if (shown > 0)
+            waitKey(1);     // lets HighGUI process its events and repaint
+    }
+    worker.join();
+    if (error)
+        std::rethrow_exception(error);
+
+    if (holdAtEnd && shown > 0)
+        waitKey(0);
+}
+
+AnnotatedWriter::~AnnotatedWriter()
+{
+    close();
+}
+
+bool AnnotatedWriter::open(const string& path, double fps, Size frameSize, size_t capacity)
+{
+    close();
+    if (!writer.open(path, VideoWriter::fourcc('m', 'p', '4', 'v'), fps, frameSize))
+        return false;
+    this->capacity = capacity > 0 ? capacity : 1;
+    closing = false;
+    written = dropped = 0;
+    thread = std::thread([this]() { writerLoop(); });
+    return true;
+}
+
+bool AnnotatedWriter::write(const Mat& frame)
+{
+    if (!isOpen()) return false;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (queue.size() >= capacity) {
+            dropped++;
+            return false;
+        }
+        queue.push_back(frame);
+    }
+    cv.notify_all();
+    return true;
+}
+
+void AnnotatedWriter::writerLoop()
+{
+    for (;;) {
+        Mat frame;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&]() { return closing || !queue.empty(); });
+            if (queue.empty()) return;      // closing and drained
+            frame = std::move(queue.front());
+            queue.pop_front();
+        }
+        writer.write(frame);
+        written++;
+    }
+}
+
+void AnnotatedWriter::close()
+{
+    if (!isOpen()) return;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        closing = true;
+    }
+    cv.notify_all();
+    thread.join();
+    writer.release();
+}
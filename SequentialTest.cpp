@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <cmath>
+#include "SequentialTest.h"
+
+const char* stopReasonName(StopReason reason)
+{
+    switch (reason) {
+    case StopReason::None:               return "none";
+    case StopReason::ConfidentReal:      return "confident-real";
+    case StopReason::ConfidentSynthetic: return "confident-synthetic";
+    case StopReason::FrameCap:           return "frame-cap";
+    case StopReason::EndOfStream:        return "end-of-stream";
+    }
+    return "?";
+}
+
+/**
+ * @brief
+ * Two sided standard normal quantile: the z with P(|Z| > z) = 1 - confidence, by bisection.
+ */
+static double normalQuantile(double confidence)
+{
+    double tail = (1.0 - confidence) / 2.0;
+    double lo = 0.0, hi = 10.0;
+    for (int i = 0; i < 100; i++) {
+        double mid = 0.5 * (lo + hi);
+        if (0.5 * std::erfc(mid / std::sqrt(2.0)) > tail)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return 0.5 * (lo + hi);
+}
+
+SequentialVerdict::SequentialVerdict(const SequentialOptions& opts)
+    : opts(opts), z(normalQuantile(std::min(std::max(opts.confidence, 0.5), 0.999999)))
+{
+}
+
+double SequentialVerdict::halfWidth() const
+{
+    if (n < 2) return INFINITY;
+    double sd = std::max(std::sqrt(m2 / (n - 1)), opts.minStdDev);
+    return z * sd / std::sqrt((double)n);
+}
+
+bool SequentialVerdict::add(double biou)
+{
+    if (why != StopReason::None) return true;
+
+    n++;
+    double d = biou - m;
+    m += d / n;
+    m2 += d * (biou - m);
+
+    if (n >= opts.minFrames) {
+        double h = halfWidth();
+        if (m - h > opts.threshold)
+            why = StopReason::ConfidentReal;
+        else if (m + h < opts.threshold)
+            why = StopReason::ConfidentSynthetic;
+    }
+    if (why == StopReason::None && opts.maxFrames > 0 && n >= opts.maxFrames)
+        why = StopReason::FrameCap;
+
+    return why != StopReason::None;
+}
+
+void SequentialVerdict::finish()
+{
+    if (why == StopReason::None)
+        why = StopReason::EndOfStream;
+}
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <opencv2/opencv.hpp>
+#include "Sharding.h"
+
+using namespace std;
+namespace fs = std::__fs::filesystem;
+
+/**
+ * @brief
+ * Lists the files under root/{real,synthetic}/{eye,face,video}, sorted by relative path
+ * so that every process sees the same order whatever the directory iteration order.
+ * @param root The dataset root folder.
+ * @return the discovered files
+ */
+vector<DatasetFile> discoverDataset(const string& root)
+{
+    vector<DatasetFile> files;
+    for (string type : {"real", "synthetic"}) {
+        for (string mode : {"eye", "face", "video"}) {
+            string inDir = root + "/" + type + "/" + mode;
+            if (!fs::exists(inDir)) continue;
+
+            for (auto& f : fs::directory_iterator(inDir)) {
+                if (!fs::is_regular_file(f.path())) continue;
+                DatasetFile d;
+                d.path = f.path().string();
+                d.relPath = type + "/" + mode + "/" + f.path().filename().string();
+                d.type = type;
+                d.mode = mode;
+                files.push_back(d);
+            }
+        }
+    }
+    sort(files.begin(), files.end(),
+         [](const DatasetFile& a, const DatasetFile& b) { return a.relPath < b.relPath; });
+    return files;
+}
+
+uint64_t stableHash(const string& s)
+{
+    uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+bool parseShard(const string& spec, int& index, int& count)
+{
+    size_t slash = spec.find('/');
+    if (slash == string::npos) return false;
+    try {
+        index = stoi(spec.substr(0, slash));
+        count = stoi(spec.substr(slash + 1));
+    } catch (...) {
+        return false;
+    }
+    return count > 0 && index >= 0 && index < count;
+}
+
+vector<DatasetFile> selectShard(const vector<DatasetFile>& files, int index, int count)
+{
+    vector<DatasetFile> out;
+    for (const auto& f : files)
+        if (stableHash(f.relPath) % (uint64_t)count == (uint64_t)index)
+            out.push_back(f);
+    return out;
+}
+
+/**
+ * @brief
+ * Cost based sharding: files are assigned, heaviest first, to the least loaded shard
+ * (longest processing time first). Files missing from the manifest cost the mean manifest
+ * cost. Every process computes the same assignment from the same manifest.
+ * @param files The discovered files.
+ * @param costs Relative path -> cost, as loaded by loadManifest.
+ * @param index The shard to keep.
+ * @param count The number of shards.
+ * @return the files of shard index, in relative path order
+ */
+vector<DatasetFile> selectShardByCost(const vector<DatasetFile>& files, const map<string, double>& costs,
+                                      int index, int count)
+{
+    double meanCost = 1.0;
+    if (!costs.empty()) {
+        double sum = 0;
+        for (const auto& c : costs) sum += c.second;
+        meanCost = sum / costs.size();
+    }
+
+    vector<pair<double, size_t>> order;
+    for (size_t i = 0; i < files.size(); i++) {
+        auto it = costs.find(files[i].relPath);
+        order.emplace_back(it != costs.end() ? it->second : meanCost, i);
+    }
+    // heaviest first; ties broken by relative path (files are already sorted by it)
+    stable_sort(order.begin(), order.end(),
+                [](const pair<double, size_t>& a, const pair<double, size_t>& b) { return a.first > b.first; });
+
+    vector<double> load(count, 0.0);
+    vector<char> mine(files.size(), 0);
+    for (const auto& o : order) {
+        int target = (int)(min_element(load.begin(), load.end()) - load.begin());
+        load[target] += o.first;
+        if (target == index) mine[o.second] = 1;
+    }
+
+    vector<DatasetFile> out;
+    for (size_t i = 0; i < files.size(); i++)
+        if (mine[i]) out.push_back(files[i]);
+    return out;
+}
+
+/**
+ * @brief
+ * Writes a cost manifest (RelPath,Bytes,Frames,Cost) for every file of the dataset.
+ * @param root The dataset root folder.
+ * @param outPath The manifest csv to write.
+ * @param byLength Cost is the number of frames (1 for images) instead of the file size.
+ * @return false if the manifest could not be written
+ */
+bool writeManifest(const string& root, const string& outPath, bool byLength)
+{
+    ofstream out(outPath);
+    if (!out) return false;
+    out << "RelPath,Bytes,Frames,Cost\n";
+
+    for (const auto& f : discoverDataset(root)) {
+        uintmax_t bytes = fs::file_size(f.path);
+        long frames = 1;
+        if (f.mode == "video") {
+            cv::VideoCapture cap(f.path);
+            if (cap.isOpened())
+                frames = max(1L, (long)cap.get(cv::CAP_PROP_FRAME_COUNT));
+        }
+        double cost = byLength ? (double)frames : (double)bytes;
+        out << f.relPath << "," << bytes << "," << frames << "," << cost << "\n";
+    }
+    return (bool)out;
+}
+
+/**
+ * @brief
+ * Splits a csv line on commas (the result files never quote their fields).
+ */
+static vector<string> splitCsv(const string& line)
+{
+    vector<string> cells;
+    stringstream ss(line);
+    string cell;
+    while (getline(ss, cell, ','))
+        cells.push_back(cell);
+    if (!line.empty() && line.back() == ',')
+        cells.push_back("");
+    return cells;
+}
+
+static int columnOf(const vector<string>& header, const string& name)
+{
+    auto it = find(header.begin(), header.end(), name);
+    return it == header.end() ? -1 : (int)(it - header.begin());
+}
+
+bool loadManifest(const string& path, map<string, double>& costs)
+{
+    ifstream in(path);
+    string line;
+    if (!in || !getline(in, line)) return false;
+
+    vector<string> header = splitCsv(line);
+    int relCol = columnOf(header, "RelPath");
+    int costCol = columnOf(header, "Cost");
+    if (relCol < 0 || costCol < 0) return false;
+
+    while (getline(in, line)) {
+        vector<string> cells = splitCsv(line);
+        if ((int)cells.size() <= max(relCol, costCol)) continue;
+        costs[cells[relCol]] = atof(cells[costCol].c_str());
+    }
+    return true;
+}
+
+/**
+ * @brief
+ * Combines per shard result csv files into one and recomputes the global accuracy.
+ * Rows are keyed by Type, Mode and Filename; a row seen in a later file replaces an earlier one,
+ * so re-running a failed shard and merging again is safe.
+ * @param inputs The shard csv files.
+ * @param outPath The merged csv to write.
+ * @param total Output parameter: number of distinct files.
+ * @param correct Output parameter: number of correctly classified files.
+ * @return false if an input could not be read, its header differs from the first input's
+ * (shards of different runs or versions), or the output could not be written
+ */
+bool mergeResults(const vector<string>& inputs, const string& outPath, int& total, int& correct)
+{
+    string headerLine;
+    map<string, pair<string, bool>> rows;   // key -> (line, correct)
+
+    for (const auto& path : inputs) {
+        ifstream in(path);
+        string line;
+        if (!in || !getline(in, line)) {
+            cerr << "Cannot read " << path << "\n";
+            return false;
+        }
+        if (headerLine.empty()) headerLine = line;
+        else if (line != headerLine) {
+            cerr << path << " has a different header than " << inputs[0] << "\n";
+            return false;
+        }
+
+        vector<string> header = splitCsv(line);
+        int nameCol = columnOf(header, "Filename");
+        int typeCol = columnOf(header, "Type");
+        int modeCol = columnOf(header, "Mode");
+        int biouCol = columnOf(header, "BIoU");
+        if (nameCol < 0 || typeCol < 0 || biouCol < 0) {
+            cerr << path << " lacks the Filename, Type or BIoU column\n";
+            return false;
+        }
+
+        while (getline(in, line)) {
+            vector<string> cells = splitCsv(line);
+            if ((int)cells.size() < (int)header.size()) continue;
+
+            const string& type = cells[typeCol];
+            double biou = atof(cells[biouCol].c_str());
+            bool isCorrect = (type == "real" && biou > 0.5) || (type == "synthetic" && biou < 0.5);
+
+            string key = type + "/" + (modeCol >= 0 ? cells[modeCol] : "") + "/" + cells[nameCol];
+            rows[key] = make_pair(line, isCorrect);
+        }
+    }
+
+    ofstream out(outPath);
+    if (!out) return false;
+    out << headerLine << "\n";
+
+    total = correct = 0;
+    for (const auto& r : rows) {
+        out << r.second.first << "\n";
+        total++;
+        if (r.second.second) correct++;
+    }
+    return (bool)out;
+}
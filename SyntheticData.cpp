@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <cmath>
+#include "SyntheticData.h"
+
+using namespace cv;
+using std::string;
+using std::vector;
+
+static const Scalar kSclera(215, 220, 225);
+static const Scalar kPupil(15, 15, 18);
+static const Scalar kHighlight(250, 250, 250);
+static const Scalar kLashes(30, 30, 35);
+
+vector<Point> SyntheticEye::landmarks() const
+{
+    // points of the opening ellipse a third of the way in from each corner
+    const float a = openingAxes.width, b = openingAxes.height;
+    const float dy = b * std::sqrt(8.0f / 9.0f);
+    const float upper = std::max(openingCenter.y - dy, std::min(lidY, openingCenter.y));
+    return {
+        Point(cvRound(openingCenter.x - a), cvRound(openingCenter.y)),
+        Point(cvRound(openingCenter.x - a / 3), cvRound(upper)),
+        Point(cvRound(openingCenter.x + a / 3), cvRound(upper)),
+        Point(cvRound(openingCenter.x + a), cvRound(openingCenter.y)),
+        Point(cvRound(openingCenter.x + a / 3), cvRound(openingCenter.y + dy)),
+        Point(cvRound(openingCenter.x - a / 3), cvRound(openingCenter.y + dy)),
+    };
+}
+
+SyntheticEye SyntheticEye::scaled(Size to) const
+{
+    const float sx = (float)to.width / size.width, sy = (float)to.height / size.height;
+    const float s = std::sqrt(sx * sy);     // lengths: circles stay circles
+    auto map = [&](Point2f p) { return Point2f(p.x * sx, p.y * sy); };
+
+    SyntheticEye out = *this;
+    out.size = to;
+    out.center = map(center);
+    out.radius = radius * s;
+    out.irisRadius = irisRadius * s;
+    out.openingCenter = map(openingCenter);
+    out.openingAxes = Size2f(openingAxes.width * sx, openingAxes.height * sy);
+    out.lidY = lidY * sy;
+    for (Point2f& h : out.highlights)
+        h = map(h);
+    out.highlightRadius = highlightRadius * s;
+    return out;
+}
+
+SyntheticEye randomSyntheticEye(Size size, RNG& rng, const SyntheticOptions& opts)
+{
+    const float w = (float)size.width, h = (float)size.height;
+    SyntheticEye eye;
+    eye.size = size;
+    eye.openingCenter = Point2f(w * (0.5f + rng.uniform(-0.03f, 0.03f)), h * (0.5f + rng.uniform(-0.03f, 0.03f)));
+    eye.openingAxes = Size2f(w * rng.uniform(0.40f, 0.46f), h * rng.uniform(0.30f, 0.40f));
+    eye.irisRadius = eye.openingAxes.height * rng.uniform(0.85f, 1.0f);
+    eye.radius = eye.irisRadius * rng.uniform(0.30f, 0.50f);
+
+    const float reach = std::max(0.0f, eye.openingAxes.width - eye.irisRadius);
+    eye.center = Point2f(eye.openingCenter.x + rng.uniform(-0.35f, 0.35f) * reach,
+                         eye.openingCenter.y + rng.uniform(-0.15f, 0.15f) * eye.openingAxes.height);
+    eye.lidY = eye.center.y - eye.radius + rng.uniform(0.0f, (float)std::max(0.0, opts.eyelid)) * 2 * eye.radius;
+
+    eye.highlightRadius = eye.radius * rng.uniform(0.12f, 0.2f);
+    for (int i = 0; i < opts.highlights; i++) {
+        float angle = rng.uniform(0.0f, (float)(2 * CV_PI));
+        float dist = eye.radius * rng.uniform(0.3f, 0.7f);
+        eye.highlights.push_back(eye.center + Point2f(dist * std::cos(angle), dist * std::sin(angle)));
+    }
+
+    eye.skin = Scalar(rng.uniform(90, 150), rng.uniform(120, 170), rng.uniform(160, 215));
+    eye.iris = Scalar(rng.uniform(30, 90), rng.uniform(50, 110), rng.uniform(60, 140));
+    eye.noise = opts.noise;
+    return eye;
+}
+
+/**
+ * @brief
+ * Filled anti-aliased circle with sub-pixel center and radius.
+ */
+static void fillCircle(Mat& img, Point2f center, float radius, const Scalar& color)
+{
+    const int shift = 4, one = 1 << shift;
+    circle(img, Point(cvRound(center.x * one), cvRound(center.y * one)), cvRound(radius * one),
+           color, FILLED, LINE_AA, shift);
+}
+
+/**
+ * @brief
+ * Adds zero mean Gaussian noise, saturating to 8 bits.
+ */
+static void addNoise(Mat& img, double sigma, RNG& rng)
+{
+    if (sigma <= 0) return;
+    Mat noise(img.size(), CV_32FC(img.channels()));
+    rng.fill(noise, RNG::NORMAL, Scalar::all(0), Scalar::all(sigma));
+    Mat f;
+    img.convertTo(f, noise.type());
+    f += noise;
+    f.convertTo(img, img.type());
+}
+
+Mat renderSyntheticEye(const SyntheticEye& eye, RNG& rng)
+{
+    Mat img(eye.size, CV_8UC3, eye.skin);
+
+    Mat opening = Mat::zeros(eye.size, CV_8U);
+    ellipse(opening, RotatedRect(eye.openingCenter, Size2f(2 * eye.openingAxes.width, 2 * eye.openingAxes.height), 0),
+            Scalar(255), FILLED);
+
+    Mat layer(eye.size, CV_8UC3, kSclera);
+    fillCircle(layer, eye.center, eye.irisRadius, eye.iris);
+    fillCircle(layer, eye.center, eye.radius, kPupil);
+    for (const Point2f& h : eye.highlights)
+        fillCircle(layer, h, eye.highlightRadius, kHighlight);
+
+    // the upper lid hides every row of the opening above lidY
+    Mat visible = opening.clone();
+    int lidRow = std::min(std::max(0, (int)std::ceil(eye.lidY)), eye.size.height);
+    visible.rowRange(0, lidRow).setTo(0);
+    layer.copyTo(img, visible);
+
+    Mat lashes = Mat::zeros(eye.size, CV_8U);
+    int thickness = std::max(1, eye.size.width / 60);
+    line(lashes, Point(0, lidRow), Point(eye.size.width - 1, lidRow), Scalar(255), thickness);
+    img.setTo(kLashes, lashes & opening);
+
+    GaussianBlur(img, img, Size(0, 0), std::max(0.5, eye.size.width / 320.0));
+    addNoise(img, eye.noise, rng);
+    return img;
+}
+
+Size syntheticFaceEyeSize(Size canvas)
+{
+    return Size(std::max(16, cvRound(canvas.width * 0.2)), std::max(10, cvRound(canvas.width * 0.12)));
+}
+
+Mat renderSyntheticFace(Size size, const SyntheticEye& left, const SyntheticEye& right,
+                        Rect& leftRect, Rect& rightRect, RNG& rng)
+{
+    Mat img(size, CV_8UC3, left.skin * 0.5);
+    ellipse(img, RotatedRect(Point2f(size.width * 0.5f, size.height * 0.5f),
+                             Size2f(size.width * 0.7f, size.height * 0.9f), 0),
+            left.skin, FILLED, LINE_AA);
+    addNoise(img, left.noise, rng);
+
+    SyntheticEye r = right;
+    r.skin = left.skin;
+    leftRect = Rect(Point(cvRound(size.width * 0.34 - left.size.width / 2.0),
+                          cvRound(size.height * 0.42 - left.size.height / 2.0)), left.size);
+    rightRect = Rect(Point(cvRound(size.width * 0.66 - r.size.width / 2.0),
+                           cvRound(size.height * 0.42 - r.size.height / 2.0)), r.size);
+
+    const Rect canvas(Point(0, 0), size);
+    for (auto eye : {std::make_pair(&left, &leftRect), std::make_pair((const SyntheticEye*)&r, &rightRect)}) {
+        Rect dst = *eye.second & canvas;
+        if (dst.empty()) continue;
+        Mat crop = renderSyntheticEye(*eye.first, rng);
+        crop(dst - eye.second->tl()).copyTo(img(dst));
+    }
+    return img;
+}
+
+bool writeSyntheticVideo(const string& path, Size size, int frames, double fps, RNG& rng,
+                         const SyntheticOptions& opts, vector<SyntheticTruth>& truth)
+{
+    VideoWriter writer(path, VideoWriter::fourcc('m', 'p', '4', 'v'), fps, size);
+    if (!writer.isOpened()) return false;
+
+    const Size eyeSize = syntheticFaceEyeSize(size);
+    const SyntheticEye baseLeft = randomSyntheticEye(eyeSize, rng, opts);
+    const SyntheticEye baseRight = randomSyntheticEye(eyeSize, rng, opts);
+
+    for (int f = 0; f < frames; f++) {
+        const double t = f / fps;
+        const double blinkPhase = std::fmod(t, 3.0);       // a 0.2 s blink every 3 s
+        const double closed = blinkPhase < 0.2 ? 1.0 - std::abs(blinkPhase - 0.1) / 0.1 : 0.0;
+
+        SyntheticEye eyes[2] = {baseLeft, baseRight};
+        for (SyntheticEye& e : eyes) {
+            // both eyes look the same way; the pupil dilates slowly
+            Point2f gaze(float(0.25 * (e.openingAxes.width - e.irisRadius) * std::sin(2 * CV_PI * 0.3 * t)),
+                         float(0.1 * e.openingAxes.height * std::sin(2 * CV_PI * 0.45 * t)));
+            e.center += gaze;
+            for (Point2f& h : e.highlights)
+                h += gaze;
+            e.lidY += gaze.y;
+            e.radius *= float(1.0 + 0.1 * std::sin(2 * CV_PI * 0.2 * t));
+            e.radius = std::min(e.radius, e.irisRadius * 0.9f);
+            float bottom = e.openingCenter.y + e.openingAxes.height;
+            e.lidY += float(closed * std::max(0.0f, bottom - e.lidY));
+        }
+
+        Rect rects[2];
+        Mat frame = renderSyntheticFace(size, eyes[0], eyes[1], rects[0], rects[1], rng);
+        writer.write(frame);
+
+        const char* names[2] = {"left", "right"};
+        for (int i = 0; i < 2; i++) {
+            SyntheticTruth row;
+            row.file = path;
+            row.frame = f;
+            row.eye = names[i];
+            row.center = eyes[i].center + Point2f(rects[i].tl());
+            row.radius = eyes[i].radius;
+            row.lidY = eyes[i].lidY + rects[i].y;
+            truth.push_back(row);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <opencv2/core.hpp>
+#include "TaskPool.h"
+#include "Affinity.h"
+
+static std::mutex sharedMtx;
+static std::unique_ptr<TaskPool> sharedPool;
+static unsigned sharedBudget = 0;
+static bool sharedPin = false;
+
+// the pool and node of a worker thread, the node a submitting thread asked for
+static thread_local const TaskPool* tlsPool = nullptr;
+static thread_local int tlsNode = -1;
+static thread_local int tlsScopeNode = -1;
+
+TaskPool::TaskPool(unsigned threads, bool pin)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    const CpuTopology& topo = cpuTopology();
+    this->pin = pin && affinitySupported();
+    // no more queues than workers: a queue without workers would only ever be stolen from
+    int nodes = this->pin ? std::min(topo.nodeCount(), (int)threads) : 1;
+    queues.resize(nodes);
+
+    // workers are spread over the nodes round robin, then over the CPUs of each node
+    for (unsigned i = 0; i < threads; i++) {
+        int node = (int)(i % nodes);
+        int cpu = -1;
+        if (this->pin) {
+            const std::vector<int>& cpus = topo.nodes[node];
+            cpu = cpus[(i / nodes) % cpus.size()];
+        }
+        workers.emplace_back([this, node, cpu]() { workerLoop(node, cpu); });
+    }
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto& t : workers)
+        t.join();
+}
+
+/**
+ * @brief
+ * Queue of a task being submitted: the worker's own node, the node of a NodeScope, or the
+ * next node in turn. Called with the lock held.
+ */
+int TaskPool::submitNode()
+{
+    const int nodes = (int)queues.size();
+    if (nodes == 1) return 0;
+    if (tlsPool == this && tlsNode >= 0) return tlsNode;
+    if (tlsScopeNode >= 0) return tlsScopeNode % nodes;
+    return (int)(nextNode++ % (unsigned)nodes);
+}
+
+/**
+ * @brief
+ * Takes the oldest task of the preferred node's queue, else of the next non empty queue.
+ * Called with the lock held.
+ * @param node Preferred queue, -1 for none.
+ * @return false if every queue is empty
+ */
+bool TaskPool::popTask(int node, std::function<void()>& task)
+{
+    const int nodes = (int)queues.size();
+    const int first = node >= 0 ? node : 0;
+    for (int k = 0; k < nodes; k++) {
+        auto& q = queues[(first + k) % nodes];
+        if (q.empty()) continue;
+        task = std::move(q.front());
+        q.pop_front();
+        if (k > 0 && node >= 0)
+            stolen.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief
+ * Pops one queued task and runs it on the calling thread.
+ * @return false if the queue was empty
+ */
+bool TaskPool::runOne()
+{
+    std::function<void()> task;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        int node = tlsPool == this ? tlsNode : tlsScopeNode;
+        if (!popTask(node >= 0 ? node % (int)queues.size() : -1, task))
+            return false;
+    }
+    task();
+    return true;
+}
+
+void TaskPool::workerLoop(int node, int cpu)
+{
+    if (cpu >= 0)
+        pinCurrentThread(cpu);
+    tlsPool = this;
+    tlsNode = queues.size() > 1 ? node : -1;
+
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            while (!popTask(node, task)) {
+                if (stopping)
+                    return;
+                cv.wait(lock);
+            }
+        }
+        task();
+    }
+}
+
+int TaskPool::currentNode()
+{
+    return tlsNode;
+}
+
+TaskPool::NodeScope::NodeScope(int node) : previous(tlsScopeNode)
+{
+    tlsScopeNode = node;
+}
+
+TaskPool::NodeScope::~NodeScope()
+{
+    tlsScopeNode = previous;
+}
+
+TaskPool& TaskPool::shared()
+{
+    std::lock_guard<std::mutex> lock(sharedMtx);
+    if (!sharedPool) {
+        cv::setNumThreads(1);
+        sharedPool.reset(new TaskPool(sharedBudget, sharedPin));
+    }
+    return *sharedPool;
+}
+
+void TaskPool::setThreadBudget(unsigned threads)
+{
+    std::unique_ptr<TaskPool> old;
+    {
+        std::lock_guard<std::mutex> lock(sharedMtx);
+        sharedBudget = threads;
+        old = std::move(sharedPool);
+    }
+    // joined outside the lock: finishing workers may still call shared()
+}
+
+bool TaskPool::initThreadBudget(unsigned threads)
+{
+    std::lock_guard<std::mutex> lock(sharedMtx);
+    if (sharedPool) {
+        unsigned wanted = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+        return sharedPool->size() == wanted;
+    }
+    sharedBudget = threads;
+    return true;
+}
+
+void TaskPool::setPinning(bool pin)
+{
+    std::unique_ptr<TaskPool> old;
+    {
+        std::lock_guard<std::mutex> lock(sharedMtx);
+        sharedPin = pin;
+        old = std::move(sharedPool);
+    }
+}
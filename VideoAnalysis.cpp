@@ -0,0 +1,573 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "VideoAnalysis.h"
+#include "FaceSegmentation.h"
+#include "TaskPool.h"
+
+using namespace cv;
+using std::string;
+using std::vector;
+
+// A seek makes the decoder restart from the previous key frame, so short forward
+// jumps are cheaper done with grab(), which decodes but never converts to BGR.
+static const int kMaxGrabDistance = 30;
+
+// Each segment opens the file and seeks once; below this many sampled frames per segment
+// that overhead outweighs the parallel decoding.
+static const int kMinSegmentFrames = 4;
+
+// A segment decodes at most this many frames ahead of the caller before it pauses; it
+// resumes once the caller has taken half of them.
+static const size_t kSegmentBuffer = 8;
+
+bool parseSampleMode(const string& name, SampleMode& mode)
+{
+    if (name == "first")         mode = SampleMode::First;
+    else if (name == "stride")   mode = SampleMode::Stride;
+    else if (name == "uniform")  mode = SampleMode::Uniform;
+    else if (name == "keyframe") mode = SampleMode::Keyframe;
+    else return false;
+    return true;
+}
+
+const char* sampleModeName(SampleMode mode)
+{
+    switch (mode) {
+    case SampleMode::First:    return "first";
+    case SampleMode::Stride:   return "stride";
+    case SampleMode::Uniform:  return "uniform";
+    case SampleMode::Keyframe: return "keyframe";
+    }
+    return "?";
+}
+
+/**
+ * @brief
+ * Picks count evenly spaced entries of [0, n): the middle of each of count equal slices.
+ * @param n Number of candidates.
+ * @param count Number of entries wanted.
+ * @return increasing, duplicate free positions
+ */
+static vector<int> spreadEvenly(int n, int count)
+{
+    vector<int> out;
+    if (n <= 0 || count <= 0) return out;
+    for (int i = 0; i < count; i++) {
+        int t = (int)((i + 0.5) * n / count);
+        if (out.empty() || t != out.back())
+            out.push_back(t);
+    }
+    return out;
+}
+
+/**
+ * @brief
+ * Reorders planned frames so that any prefix of the plan is spread over the whole clip
+ * (0, 1/2, 1/4, 3/4, ... of the plan, by bit reversed rank). Used when the analysis may
+ * stop early, at the price of backward seeks.
+ * @param targets The increasing frame plan, reordered in place.
+ */
+static void coarseToFineOrder(vector<int>& targets)
+{
+    int bits = 0;
+    while ((size_t(1) << bits) < targets.size()) bits++;
+
+    vector<std::pair<unsigned, int>> keyed;
+    for (size_t i = 0; i < targets.size(); i++) {
+        unsigned rev = 0;
+        for (int b = 0; b < bits; b++)
+            if (i & (size_t(1) << b)) rev |= 1u << (bits - 1 - b);
+        keyed.emplace_back(rev, targets[i]);
+    }
+    std::sort(keyed.begin(), keyed.end());
+
+    for (size_t i = 0; i < keyed.size(); i++)
+        targets[i] = keyed[i].second;
+}
+
+/**
+ * @brief
+ * Lists the key frames of a video. The file is opened a second time in raw mode,
+ * where grab() only demuxes packets, so building the index costs no decoding.
+ * @param path Path of the video file.
+ * @return frame numbers of the key frames, empty if the backend cannot report them
+ */
+static vector<int> keyframeIndex(const string& path)
+{
+    vector<int> keys;
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6)
+    VideoCapture raw(path, CAP_FFMPEG, {CAP_PROP_FORMAT, -1});
+    if (!raw.isOpened()) return keys;
+
+    for (int i = 0; raw.grab(); i++) {
+        if (raw.get(CAP_PROP_LRF_HAS_KEY_FRAME) != 0)
+            keys.push_back(i);
+    }
+#else
+    (void)path;
+#endif
+    return keys;
+}
+
+FrameSampler::FrameSampler(VideoCapture& cap, const string& path, const VideoOptions& opts)
+    : cap(cap), opts(opts)
+{
+    if (this->opts.sampling == SampleMode::Keyframe) {
+        vector<int> keys = keyframeIndex(path);
+        if (keys.empty()) {
+            // reported to the caller through FrameResult::sampling
+            this->opts.sampling = SampleMode::Uniform;
+        } else if (opts.maxFrames > 0 && (int)keys.size() > opts.maxFrames) {
+            for (int i : spreadEvenly((int)keys.size(), opts.maxFrames))
+                targets.push_back(keys[i]);
+        } else {
+            targets = keys;
+        }
+    }
+
+    if (this->opts.sampling == SampleMode::Uniform) {
+        int count = (int)cap.get(CAP_PROP_FRAME_COUNT);
+        if (count <= 0 || opts.maxFrames <= 0) {
+            // unknown length or no frame limit: plain sequential decoding
+            this->opts.sampling = SampleMode::First;
+        } else {
+            targets = spreadEvenly(count, opts.maxFrames);
+        }
+    }
+
+    if (opts.coarseToFine && !targets.empty())
+        coarseToFineOrder(targets);
+
+    if (this->opts.stride < 1)
+        this->opts.stride = 1;
+}
+
+FrameSampler::FrameSampler(VideoCapture& cap, const vector<int>& frames)
+    : cap(cap), targets(frames)
+{
+    opts.sampling = SampleMode::Uniform;
+}
+
+bool FrameSampler::plan(vector<int>& frames) const
+{
+    frames.clear();
+    if (opts.sampling == SampleMode::Uniform || opts.sampling == SampleMode::Keyframe) {
+        frames = targets;
+        std::sort(frames.begin(), frames.end());
+        return true;
+    }
+
+    int count = (int)cap.get(CAP_PROP_FRAME_COUNT);
+    if (count <= 0) return false;
+    int step = opts.sampling == SampleMode::Stride ? opts.stride : 1;
+    for (int k = 0; k * step < count && (opts.maxFrames <= 0 || k < opts.maxFrames); k++)
+        frames.push_back(k * step);
+    return true;
+}
+
+/**
+ * @brief
+ * Moves the capture so that the next grab() returns frame target.
+ * @param target Frame number to reach.
+ * @return false if the stream ended before the target
+ */
+bool FrameSampler::seekTo(int target)
+{
+    if (target < position || target - position > kMaxGrabDistance) {
+        if (!cap.set(CAP_PROP_POS_FRAMES, target))
+            return false;
+        position = target;
+        return true;
+    }
+    while (position < target) {
+        if (!cap.grab()) return false;
+        position++;
+    }
+    return true;
+}
+
+bool FrameSampler::next(Mat& frame, int& index)
+{
+    switch (opts.sampling) {
+    case SampleMode::First:
+    case SampleMode::Stride:
+        if (opts.maxFrames > 0 && produced >= opts.maxFrames)
+            return false;
+        if (opts.sampling == SampleMode::Stride && produced > 0) {
+            for (int k = 1; k < opts.stride; k++) {
+                if (!cap.grab()) return false;
+                position++;
+            }
+        }
+        break;
+
+    case SampleMode::Uniform:
+    case SampleMode::Keyframe:
+        if (nextTarget >= targets.size())
+            return false;
+        if (!seekTo(targets[nextTarget++]))
+            return false;
+        break;
+    }
+
+    if (!cap.read(frame))
+        return false;
+
+    index = position++;
+    produced++;
+    return true;
+}
+
+double FrameResult::biou() const
+{
+    double sum = 0;
+    int n = 0;
+    if (face.left.found)  { sum += face.left.biou;  n++; }
+    if (face.right.found) { sum += face.right.biou; n++; }
+    return n ? sum / n : -1.0;
+}
+
+void FrameAnalyzer::analyze(const Mat& frame, FrameResult& result)
+{
+    if (lastIndex < 0 || std::abs(result.index - lastIndex) > opts.trackMaxGap)
+        leftTrack = rightTrack = PupilTrack();
+    lastIndex = result.index;
+
+    result.face = FaceResult();
+    vector<DetectedFace> dets = detectFaces(frame, 1, opts.detect);
+    result.faceFound = !dets.empty() &&
+                       analyzeFace(frame, dets[0].box, result.face,
+                                   opts.track ? &leftTrack : nullptr,
+                                   opts.track ? &rightTrack : nullptr,
+                                   opts.pupil);
+    if (result.faceFound)
+        result.face.detectionScore = dets[0].score;
+
+    leftTrack = result.face.left.track();
+    rightTrack = result.face.right.track();
+}
+
+/**
+ * @brief
+ * Analyses the frames a sampler produces, in the order it produces them.
+ * @param sampler The frames to analyse.
+ * @param sampling Sampling reported in the frame results.
+ * @param opts Tracking and pupil search options.
+ * @param onFrame Called for every frame; returning false stops the analysis.
+ */
+static void analyzeFrames(FrameSampler& sampler, SampleMode sampling, const VideoOptions& opts,
+                          const std::function<bool(const FrameResult&)>& onFrame)
+{
+    FrameAnalyzer analyzer(opts);
+    Mat frame;
+    FrameResult result;
+    while (sampler.next(frame, result.index)) {
+        analyzer.analyze(frame, result);
+        result.sampling = sampling;
+        if (!onFrame(result))
+            break;
+    }
+}
+
+namespace {
+
+/**
+ * @brief
+ * One time segment of analyzeVideo: its own capture, sampler and tracks, which only the
+ * thread producing it touches, and the frame results the caller has not taken yet.
+ */
+struct VideoSegment
+{
+    vector<int> frames;
+    VideoCapture cap;
+    std::unique_ptr<FrameSampler> sampler;
+    std::unique_ptr<FrameAnalyzer> analyzer;
+
+    // guarded by the mutex of the analysis
+    enum State { Idle, Queued, Producing } state = Idle;
+    bool finished = false;
+    std::exception_ptr error;           // thrown while producing, rethrown to the caller
+    std::deque<FrameResult> buffer;
+};
+
+}
+
+/**
+ * @brief
+ * Samples a video and analyses both eyes of every sampled frame. With opts.track the
+ * pupil search of each eye starts from where it was found in the previous sampled frame.
+ * With opts.segments > 1 the planned frames are split into that many consecutive segments,
+ * each decoded by its own capture on its own task; tracking restarts at each segment start.
+ * A segment runs at most kSegmentBuffer frames ahead of the caller, and a false from
+ * onFrame stops every segment.
+ * @param path Path of the video file.
+ * @param opts Sampling options.
+ * @param onFrame Called in frame order for every sampled frame; returning false stops the analysis.
+ * @return false if the video could not be opened
+ */
+bool analyzeVideo(const string& path, const VideoOptions& opts,
+                  const std::function<bool(const FrameResult&)>& onFrame)
+{
+    VideoCapture cap(path);
+    if (!cap.isOpened()) return false;
+
+    FrameSampler sampler(cap, path, opts);
+
+    // coarse to fine visits are not in frame order, so they cannot be cut into segments
+    vector<int> frames;
+    int segments = 1;
+    if (opts.segments > 1 && !opts.coarseToFine && sampler.plan(frames))
+        segments = std::min(opts.segments, (int)frames.size() / kMinSegmentFrames);
+    if (segments <= 1) {
+        analyzeFrames(sampler, sampler.sampling(), opts, onFrame);
+        return true;
+    }
+    cap.release();
+
+    // segments decode ahead of the caller into buffers of kSegmentBuffer frames. A segment
+    // whose buffer is full gives its worker back and is queued again once the caller has
+    // drained half of it, so no task ever waits for the caller. The caller sees the frames in order.
+    vector<VideoSegment> segs(segments);
+    for (int s = 0; s < segments; s++)
+        segs[s].frames.assign(frames.begin() + frames.size() * s / segments,
+                              frames.begin() + frames.size() * (s + 1) / segments);
+    const SampleMode sampling = sampler.sampling();
+    std::mutex mtx;
+    std::condition_variable changed;
+    bool stop = false;
+
+    // decodes frames of segment s until its buffer is full, it ends or the analysis stops;
+    // whoever calls it has moved the segment to Producing
+    auto produce = [&](int s) {
+        VideoSegment& seg = segs[s];
+        bool finished = false;
+        std::exception_ptr error;
+        try {
+            if (!seg.sampler) {
+                seg.cap.open(path);
+                seg.sampler.reset(new FrameSampler(seg.cap, seg.frames));
+                seg.analyzer.reset(new FrameAnalyzer(opts));
+            }
+            Mat frame;
+            finished = !seg.cap.isOpened();
+            while (!finished) {
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    if (stop || seg.buffer.size() >= kSegmentBuffer) break;
+                }
+                FrameResult result;
+                if (!seg.sampler->next(frame, result.index)) {
+                    finished = true;
+                    break;
+                }
+                seg.analyzer->analyze(frame, result);
+                result.sampling = sampling;
+                std::lock_guard<std::mutex> lock(mtx);
+                seg.buffer.push_back(std::move(result));
+                changed.notify_all();
+            }
+        } catch (...) {
+            error = std::current_exception();
+            finished = true;
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        seg.finished = finished;
+        seg.error = error;
+        seg.state = VideoSegment::Idle;
+        changed.notify_all();
+    };
+
+    // only this thread queues; a task that finds its segment taken over does nothing
+    TaskPool& pool = TaskPool::shared();
+    std::deque<std::future<void>> tasks;
+    auto ready = [](const std::future<void>& f) {
+        return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    };
+    auto queue = [&](int s) {
+        tasks.erase(std::remove_if(tasks.begin(), tasks.end(), ready), tasks.end());
+        tasks.push_back(pool.submit([&, s]() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (segs[s].state != VideoSegment::Queued) return;
+                segs[s].state = VideoSegment::Producing;
+            }
+            produce(s);
+        }));
+    };
+    for (int s = 0; s < segments; s++) {
+        segs[s].state = VideoSegment::Queued;
+        queue(s);
+    }
+
+    try {
+        bool stopped = false;
+        for (int s = 0; s < segments && !stopped; s++) {
+            VideoSegment& seg = segs[s];
+            for (;;) {
+                FrameResult result;
+                bool requeue = false, runHere = false;
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    changed.wait(lock, [&]() {
+                        return !seg.buffer.empty() || seg.finished || seg.state != VideoSegment::Producing;
+                    });
+                    if (!seg.buffer.empty()) {
+                        result = std::move(seg.buffer.front());
+                        seg.buffer.pop_front();
+                        // a segment paused on its full buffer resumes once half of it is drained,
+                        // so that each run decodes several frames
+                        if (!seg.finished && seg.state == VideoSegment::Idle &&
+                            seg.buffer.size() <= kSegmentBuffer / 2) {
+                            seg.state = VideoSegment::Queued;
+                            requeue = true;
+                        }
+                    } else if (seg.finished) {
+                        if (seg.error) std::rethrow_exception(seg.error);
+                        break;
+                    } else {
+                        // no worker has picked it up: decode it here rather than wait
+                        seg.state = VideoSegment::Producing;
+                        runHere = true;
+                    }
+                }
+                if (requeue) queue(s);
+                if (runHere) {
+                    produce(s);
+                    continue;
+                }
+                if (!onFrame(result)) {
+                    stopped = true;
+                    break;
+                }
+            }
+        }
+    } catch (...) {
+        // the segment tasks refer to the locals above: they must finish first
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        try {
+            pool.waitAll(tasks);
+        } catch (...) {
+        }
+        throw;
+    }
+
+    // segments still queued after a stop return at once
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+    }
+    pool.waitAll(tasks);
+    return true;
+}
+
+bool parseDropPolicy(const string& name, DropPolicy& policy)
+{
+    if (name == "latest")           policy = DropPolicy::Latest;
+    else if (name == "drop-oldest") policy = DropPolicy::DropOldest;
+    else if (name == "drop-newest") policy = DropPolicy::DropNewest;
+    else return false;
+    return true;
+}
+
+const char* dropPolicyName(DropPolicy policy)
+{
+    switch (policy) {
+    case DropPolicy::Latest:     return "latest";
+    case DropPolicy::DropOldest: return "drop-oldest";
+    case DropPolicy::DropNewest: return "drop-newest";
+    }
+    return "?";
+}
+
+double PacedStats::latencyPercentile(double p) const
+{
+    if (latencyMs.empty()) return 0.0;
+    vector<double> sorted = latencyMs;
+    std::sort(sorted.begin(), sorted.end());
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+bool analyzeVideoPaced(const string& path, const VideoOptions& opts, const PacedOptions& paced,
+                       PacedStats& stats, const std::function<bool(const FrameResult&)>& onFrame)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    VideoCapture cap(path);
+    if (!cap.isOpened()) return false;
+
+    stats = PacedStats();
+    stats.fps = paced.fps > 0 ? paced.fps : cap.get(CAP_PROP_FPS);
+    if (!(stats.fps > 0)) stats.fps = 30.0;
+    const size_t depth = paced.policy == DropPolicy::Latest ? 1 : (size_t)std::max(1, paced.queueDepth);
+
+    struct Pending { Mat frame; int index; Clock::time_point due; };
+    std::deque<Pending> waiting;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool ended = false, stop = false;
+
+    const Clock::time_point start = Clock::now();
+    const auto period = std::chrono::duration<double>(1.0 / stats.fps);
+
+    // the "camera": frame i is handed over at start + i / fps, never earlier, never held back
+    std::thread camera([&]() {
+        Mat frame;
+        for (int i = 0; cap.read(frame); i++) {
+            Clock::time_point due = start + std::chrono::duration_cast<Clock::duration>(period * i);
+            std::this_thread::sleep_until(due);
+
+            std::lock_guard<std::mutex> lock(mtx);
+            if (stop) break;
+            stats.captured++;
+            if (waiting.size() >= depth) {
+                stats.dropped++;
+                if (paced.policy == DropPolicy::DropNewest) continue;
+                waiting.pop_front();
+            }
+            waiting.push_back({frame.clone(), i, due});
+            cv.notify_one();
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        ended = true;
+        cv.notify_one();
+    });
+
+    FrameAnalyzer analyzer(opts);
+    FrameResult result;
+    for (;;) {
+        Pending next;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&]() { return ended || !waiting.empty(); });
+            if (waiting.empty()) break;
+            next = std::move(waiting.front());
+            waiting.pop_front();
+        }
+
+        result.index = next.index;
+        analyzer.analyze(next.frame, result);
+        stats.processed++;
+        stats.latencyMs.push_back(std::chrono::duration<double, std::milli>(Clock::now() - next.due).count());
+
+        if (!onFrame(result)) {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+            break;
+        }
+    }
+    camera.join();
+    stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+
+/**
+ * @brief
+ * CPUs of each NUMA node of the host. On Linux read from /sys/devices/system/node; elsewhere
+ * (or when sysfs has no node directory) a single node holding every CPU.
+ */
+struct CpuTopology
+{
+    std::vector<std::vector<int>> nodes;    // CPU ids of each node, nodes in id order
+
+    int nodeCount() const { return (int)nodes.size(); }
+
+    /**
+     * @brief
+     * One line per node, "node 0: 0-15,32-47".
+     */
+    std::string describe() const;
+};
+
+/**
+ * @brief
+ * The topology of this host, read once.
+ */
+const CpuTopology& cpuTopology();
+
+/**
+ * @brief
+ * Parses a sysfs CPU list ("0-3,8,10-11").
+ * @return false if the text is not a CPU list
+ */
+bool parseCpuList(const std::string& text, std::vector<int>& cpus);
+
+/**
+ * @brief
+ * Restricts the calling thread to one CPU.
+ * @return false if the platform has no thread affinity (macOS) or the call failed
+ */
+bool pinCurrentThread(int cpu);
+
+/**
+ * @brief
+ * Whether pinCurrentThread can work on this platform.
+ */
+bool affinitySupported();
@@ -1,5 +1,18 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
 #include <opencv2/opencv.hpp>
+#include "EllipseFitStatus.h"
+#include "PupilMask.h"
  
+/**
+ * @brief
+ * How the ellipse compared with the mask is fitted.
+ * Custom  the project's direct least squares fitter, OpenCV's fitEllipse when it fails.
+ * OpenCV  fitEllipse only: cheaper, no custom fitter statistics.
+ */
+enum class BIoUMethod { Custom, OpenCV };
+
 /**
  * @brief 
  * Computes the Bounding Box Intersection over Union metric between a detected circular mask and the ground truth eye contour landmarks.
@@ -8,3 +21,39 @@
  * @return the value of the BIou Score 
  */
 double computeBIoU(const cv::Mat& mask, const std::vector<cv::Point>& contour);
+
+/**
+ * @brief
+ * computeBIoU on a compact mask; only the pupil box and the ellipse box are rasterized.
+ * @param mask The compact pupil mask.
+ * @param contour A vector of points defining the ground truth contour, in crop coordinates
+ * @param method How the ellipse is fitted.
+ * @return the value of the BIou Score
+ */
+double computeBIoU(const PupilMask& mask, const std::vector<cv::Point>& contour,
+                   BIoUMethod method = BIoUMethod::Custom);
+
+/**
+ * @brief
+ * Process wide counts of the ellipse fits made by computeBIoU, by outcome of the custom
+ * fitter, and of the fitEllipse fallbacks (invalid: the fallback gave no usable ellipse
+ * either and the score is 0).
+ */
+struct EllipseFitStats
+{
+    uint64_t byStatus[(int)EllipseFitStatus::Count] = {};
+    uint64_t fallbacks = 0;
+    uint64_t fallbackInvalid = 0;
+};
+
+/**
+ * @brief
+ * Snapshot of the counters; they are updated with relaxed atomics from every thread.
+ */
+EllipseFitStats ellipseFitStats();
+
+/**
+ * @brief
+ * Writes the non zero counters, one per line.
+ */
+void printEllipseFitStats(std::ostream& out);
@@ -0,0 +1,128 @@
+#pragma once
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "Sharding.h"
+#include "VideoAnalysis.h"
+
+/**
+ * @brief
+ * One eye crop as fed to the pupil stage, with where it came from.
+ */
+struct CropRecord
+{
+    cv::Mat image;                      // BGR (or grayscale) eye crop
+    std::vector<cv::Point> landmarks;   // eye landmarks in crop coordinates (empty for eye images)
+    cv::Rect cropRect;                  // crop rectangle in the source image or frame
+    int source = 0;                     // index of the source file
+    int frame = -1;                     // video frame index, -1 for images
+    int face = 0;                       // rank of the face by detection score
+    int eye = -1;                       // 0 left, 1 right, -1 for eye images
+};
+
+/**
+ * @brief
+ * Runs the face level stages (detection, landmarks, eye cropping; normalizeEyeCrop for
+ * eye images) once per file, in parallel, and returns every eye crop in file order.
+ * Face images export every face, as batchProcess scores every face; video frames use the
+ * best face only, as the frame analysis does.
+ * @param files The dataset files.
+ * @param videoOpts Sampling of the video frames whose eyes are extracted.
+ * @return the crops; source is the index in files
+ */
+std::vector<CropRecord> extractCrops(const std::vector<DatasetFile>& files, const VideoOptions& videoOpts);
+
+/**
+ * @brief
+ * Writes crops into a packed archive: a fixed header, a fixed size index entry per crop,
+ * then the raw pixel planes (64 byte aligned, no per crop encoding), the landmarks and
+ * the source table. Integers are stored in host byte order.
+ * @param path The archive to write.
+ * @param sources Relative path ("<type>/<mode>/<filename>") of every source file.
+ * @param crops The crops, referencing sources by index.
+ * @param gray Store grayscale planes instead of BGR.
+ * @return false if the archive could not be written
+ */
+bool writeCropArchive(const std::string& path, const std::vector<std::string>& sources,
+                      const std::vector<CropRecord>& crops, bool gray);
+
+/**
+ * @brief
+ * Read only, memory mapped view of an archive written by writeCropArchive.
+ * Crop images point straight into the mapping; they stay valid while the archive is open
+ * and must not be written to.
+ */
+class CropArchive
+{
+public:
+    CropArchive() = default;
+    ~CropArchive();
+
+    CropArchive(const CropArchive&) = delete;
+    CropArchive& operator=(const CropArchive&) = delete;
+
+    /**
+     * @brief
+     * Maps the archive and validates its header and index.
+     * @return false if the file is missing, truncated or not a crop archive
+     */
+    bool open(const std::string& path);
+    void close();
+
+    size_t size() const { return count; }
+
+    /**
+     * @brief
+     * The crop i without copying its pixels.
+     */
+    CropRecord crop(size_t i) const;
+
+    /**
+     * @brief
+     * The source files, rebuilt from their relative paths (path is the relative path).
+     */
+    const std::vector<DatasetFile>& sources() const { return files; }
+
+private:
+    const unsigned char* base = nullptr;
+    size_t length = 0;
+    size_t count = 0;
+    const void* index = nullptr;
+    std::vector<DatasetFile> files;
+};
+
+/**
+ * @brief
+ * Aggregates crop scores into file scores the way the file pipeline does: a face scores its
+ * best eye, a video frame the mean of its eyes, and a file the mean over its faces or frames.
+ * @param sources The source files (their mode tells videos apart).
+ * @param groups (source, frame, face) of every crop.
+ * @param cropBiou BIoU of every crop, -1 where no pupil was found.
+ * @return source index -> (BIoU, number of scored faces or frames); sources without a scored crop are absent
+ */
+std::map<int, std::pair<double, int>> aggregateFileScores(const std::vector<DatasetFile>& sources,
+                                                          const std::vector<std::tuple<int, int, int>>& groups,
+                                                          const std::vector<double>& cropBiou);
+
+/**
+ * @brief
+ * Scores every crop of an archive in parallel (scoreEye) and aggregates them per source file
+ * the way the file pipeline does: a face scores its best eye, a video frame the mean of its
+ * eyes, and a file the mean over its faces or frames.
+ * @param archive The opened archive.
+ * @param cropBiou Output parameter: BIoU of every crop, -1 where no pupil was found.
+ * @param scores Output parameter: relative path -> (BIoU, number of scored faces or frames).
+ * @param pupil Pupil search options (landmark bounds use the stored landmarks), see scoreEye.
+ * @param onlySources Relative paths of the sources to score, nullptr for all; the crops of
+ * the other sources are skipped (BIoU -1) and their files get no score.
+ * @param cropEyes Optional output: the full result (mask included) of every crop, for
+ * callers that show them.
+ */
+void scoreArchive(const CropArchive& archive, std::vector<double>& cropBiou,
+                  std::map<std::string, std::pair<double, int>>& scores,
+                  const PupilSearchOptions& pupil = PupilSearchOptions(),
+                  const std::set<std::string>* onlySources = nullptr,
+                  std::vector<EyeResult>* cropEyes = nullptr);
@@ -0,0 +1,29 @@
+#pragma once
+
+/**
+ * Outcome of CustomEllipseFitter::tryFit. Every failure class is reported as a status
+ * instead of an exception or a stderr message, so degenerate contours stay cheap.
+ */
+enum class EllipseFitStatus {
+    Ok,
+    TooFewPoints,       // fewer than 5 contour points
+    SingularS22,        // linear part of the scatter matrix not invertible
+    SingularC3,         // reduced constraint matrix not invertible
+    EigenFailed,        // eigen decomposition of the reduced system failed
+    NoEllipse,          // no eigenvector describes an ellipse
+    DegenerateConic,    // the conic has no finite center or non positive axes
+    Count
+};
+
+inline const char* ellipseFitStatusName(EllipseFitStatus s) {
+    switch (s) {
+    case EllipseFitStatus::Ok:              return "ok";
+    case EllipseFitStatus::TooFewPoints:    return "too-few-points";
+    case EllipseFitStatus::SingularS22:     return "singular-S22";
+    case EllipseFitStatus::SingularC3:      return "singular-C3";
+    case EllipseFitStatus::EigenFailed:     return "eigen-failed";
+    case EllipseFitStatus::NoEllipse:       return "no-ellipse";
+    case EllipseFitStatus::DegenerateConic: return "degenerate-conic";
+    default:                                return "?";
+    }
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "BIoU.h"
+#include "FaceSegmentation.h"
+#include "PupilSegment.h"
+#include "QualityGate.h"
+
+/**
+ * @brief
+ * Pupil segmentation and BIoU result of a single eye crop.
+ */
+struct EyeResult
+{
+    bool found = false;                 // pupil segmented and a contour extracted
+    double biou = -1.0;
+    cv::Mat eye;                        // BGR eye crop
+    PupilMask mask;                     // pupil mask of the eye crop, pupil box only
+    cv::Rect cropRect;                  // location of the crop in the source image
+    std::vector<cv::Point> landmarks;   // eye landmarks in crop coordinates
+    cv::Point center;                   // pupil center in crop coordinates
+    int radius = 0;
+    double score = 0.0;                 // score of the chosen circle
+    bool tracked = false;               // found by the narrow search around the previous frame's pupil
+
+    /**
+     * @brief
+     * The pupil as a track for the next frame, in source image coordinates.
+     */
+    PupilTrack track() const;
+};
+
+/**
+ * @brief
+ * Both eyes of one detected face.
+ */
+struct FaceResult
+{
+    int index = 0;                      // rank of the face by detection score
+    double detectionScore = 0.0;
+    cv::Rect faceBox;
+    EyeResult left, right;
+
+    /**
+     * @brief
+     * The face level score: the better of the two eyes, -1 if neither eye was segmented.
+     */
+    double biou() const;
+};
+
+/**
+ * @brief
+ * Options controlling how the pupil of each eye crop is searched.
+ */
+struct PupilSearchOptions
+{
+    bool landmarkBounds = false;        // derive the radius range and center region from the eye landmarks
+    int canonicalWidth = 0;             // resample each eye so that it is this many pixels wide, 0 = native
+    PupilParams params;                 // Hough and fallback parameters (radius range replaced by landmarkBounds)
+    BIoUMethod biou = BIoUMethod::Custom;
+    QualityGate quality = eyeQualityGate(); // crops failing it are not searched
+};
+
+/**
+ * @brief
+ * Options controlling which faces of an image are analysed.
+ */
+struct FaceAnalysisOptions
+{
+    int maxFaces = 0;                   // top-K faces by detection score, 0 = every face
+    FaceDetectOptions detect;
+    PupilSearchOptions pupil;
+};
+
+/**
+ * @brief
+ * Segments the pupil of an eye crop and scores it with BIoU.
+ * Fills the found, mask, center, radius, score and biou fields of the result.
+ * @param eye The eye result whose eye crop (BGR or grayscale; and crop rectangle when tracking) is already set.
+ * @param prior Optional pupil of the previous video frame in source image coordinates;
+ * when valid the search starts around it (findPupilMaskTracked).
+ * @param opts With landmarkBounds the radius range and center region come from the eye landmarks
+ * (pupilParamsFromLandmarks) instead of the fixed defaults. With canonicalWidth the crop is
+ * resampled so that the eye (landmark extent, or the crop without landmarks) has that width
+ * before the search, which bounds the cost per eye whatever the source resolution; center,
+ * radius and mask are mapped back to the crop, BIoU is measured at the canonical size.
+ * With opts.quality enabled, crops failing the eye quality gate are not searched.
+ * @return true if a pupil contour was found and scored
+ */
+bool scoreEye(EyeResult& eye, const PupilTrack* prior = nullptr,
+              const PupilSearchOptions& opts = PupilSearchOptions());
+
+/**
+ * @brief
+ * Segments the pupil of a standalone eye crop (eye input, no landmarks): the crop is padded
+ * to a square with normalizeEyeCrop, searched with opts.params and scored with opts.biou.
+ * @param eyeImage The eye crop, BGR or grayscale.
+ * @param eye Output parameter: eye is the padded crop, the other fields as for scoreEye.
+ * @param opts Hough parameters, ellipse fit method and eye quality gate.
+ * @return false if the crop fails the quality gate or no pupil contour was found
+ */
+bool analyzeEyeCrop(const cv::Mat& eyeImage, EyeResult& eye,
+                    const PupilSearchOptions& opts = PupilSearchOptions());
+
+/**
+ * @brief
+ * Predicts the landmarks of one detected face, crops both eyes and segments both pupils.
+ * @param imageBgr The image the face was detected in.
+ * @param box The face box.
+ * @param face Output parameter: the face result (index and detection score are left untouched).
+ * @param leftPrior Optional previous left pupil, see scoreEye.
+ * @param rightPrior Optional previous right pupil, see scoreEye.
+ * @param pupil Pupil search options, see scoreEye.
+ * @return false if the eyes could not be cropped
+ */
+bool analyzeFace(const cv::Mat& imageBgr, const cv::Rect& box, FaceResult& face,
+                 const PupilTrack* leftPrior = nullptr, const PupilTrack* rightPrior = nullptr,
+                 const PupilSearchOptions& pupil = PupilSearchOptions());
+
+/**
+ * @brief
+ * Detects every face of an image and, for each of them in parallel, predicts the
+ * landmarks, crops both eyes and segments both pupils.
+ * @param imageBgr The input image.
+ * @param faces Output parameter: one result per face, ordered by detection score.
+ * @param opts Face selection options.
+ * @return false if no face was detected
+ */
+bool analyzeFaces(const cv::Mat& imageBgr, std::vector<FaceResult>& faces,
+                  const FaceAnalysisOptions& opts = FaceAnalysisOptions());
+
+/**
+ * @brief
+ * Loads an image file and runs analyzeFaces on it.
+ * @param imagePath Path of the image file.
+ * @param faces Output parameter: one result per face, ordered by detection score.
+ * @param opts Face selection options.
+ * @return false if the image could not be read or no face was detected
+ */
+bool analyzeFaces(const std::string& imagePath, std::vector<FaceResult>& faces,
+                  const FaceAnalysisOptions& opts = FaceAnalysisOptions());
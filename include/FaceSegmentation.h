@@ -1,9 +1,69 @@
+#pragma once
 #include <string>
+#include <vector>
 #include <opencv2/opencv.hpp>
+#include "QualityGate.h"
 
 using namespace cv;
 using namespace std;
 
+/**
+ * @brief
+ * A face returned by the frontal face detector together with its detection confidence.
+ */
+struct DetectedFace
+{
+    Rect box;
+    double score = 0.0;
+};
+
+/**
+ * @brief
+ * Eye crops of one face and the eye landmarks expressed in crop coordinates.
+ */
+struct EyePair
+{
+    Mat left, right;
+    vector<Point> leftLandmarks, rightLandmarks;
+    Rect leftRect, rightRect;   // location of each crop in the source image
+};
+
+/**
+ * @brief
+ * Options of the face detector. The serial mode is dlib's detector as is: its pyramid
+ * levels are scanned one after the other and shrink by 5/6. The parallel mode builds the
+ * pyramid itself with the given downscale factor and scans every level, large levels cut
+ * into overlapping bands, as separate tasks before merging the detections with NMS.
+ */
+struct FaceDetectOptions
+{
+    bool parallel = false;
+    double downscale = 5.0 / 6.0;       // size ratio between pyramid levels (parallel mode)
+    int upsample = 0;                   // times the image is doubled before scanning, finds smaller faces
+    double scale = 1.0;                 // image scale the detector runs at, below 1 misses small faces but is faster
+    QualityGate quality;                // images failing it are not scanned and yield no face
+};
+
+/**
+ @brief Runs the dlib frontal face detector on a BGR image.
+ @param imageBgr The input image.
+ @param maxFaces Keep only the top-K faces by detection score, 0 keeps every face.
+ @param opts Pyramid scanning options and the frame quality gate.
+ @return detected faces sorted by decreasing detection score, none if the image fails the gate
+ */
+vector<DetectedFace> detectFaces(const Mat& imageBgr, int maxFaces = 0,
+                                 const FaceDetectOptions& opts = FaceDetectOptions());
+
+/**
+ @brief Runs the landmark predictor on one detected face and crops both eyes.
+ Safe to call concurrently for different faces of the same image.
+ @param imageBgr The image the face was detected in.
+ @param face The face box returned by detectFaces.
+ @param eyes Output parameter: crops, crop rectangles and eye landmarks.
+ @return bool Returns true if both eye crops are non empty.
+ */
+bool extractEyesForFace(const Mat& imageBgr, const DetectedFace& face, EyePair& eyes);
+
 /**
  @brief Extracts the left and right eye regions from a detected face image.
   dlib library to extract the left and right eyes Which are further send down for pupil extraction
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "FaceAnalysis.h"
+#include "Pipeline.h"
+
+/**
+ * @brief
+ * How the items of a stream are framed on the input.
+ */
+enum class StreamInput
+{
+    Paths,      // one image path per line, blank lines skipped
+    Blobs       // a header line "<bytes> [id]" followed by that many bytes of encoded image
+};
+
+/**
+ * @brief
+ * Order in which the result lines of a stream are written.
+ */
+enum class StreamOrder
+{
+    Input,      // the order the items were read, a slow item holds back the ones after it
+    Completion  // as soon as each item is done
+};
+
+bool parseStreamInput(const std::string& name, StreamInput& input);
+const char* streamInputName(StreamInput input);
+bool parseStreamOrder(const std::string& name, StreamOrder& order);
+const char* streamOrderName(StreamOrder order);
+
+/**
+ * @brief
+ * Options of serveJsonLines.
+ */
+struct StreamOptions
+{
+    StreamInput input = StreamInput::Paths;
+    StreamOrder order = StreamOrder::Input;
+    bool eyes = false;                  // items are eye crops (processEye) rather than face images
+    size_t maxInFlight = 0;             // items read but not yet written, 0 = twice the pool size
+    size_t maxBlobBytes = 256u << 20;   // larger blobs are skipped and reported
+};
+
+/**
+ * @brief
+ * Counters of a stream.
+ */
+struct StreamStats
+{
+    uint64_t items = 0;                 // result lines written
+    uint64_t ok = 0;                    // items with status "ok"
+    size_t maxInFlight = 0;             // the in-flight bound that was used
+    double seconds = 0.0;
+
+    double itemsPerSecond() const { return seconds > 0 ? items / seconds : 0.0; }
+};
+
+/**
+ * @brief
+ * The results of a face image as a JSON object, field names as in PipelineC.h; pupil
+ * centers are in image coordinates.
+ */
+std::string faceResultsJson(const std::vector<FaceResult>& faces);
+
+/**
+ * @brief
+ * The result of one eye as a JSON object; center in image coordinates (crop coordinates
+ * for a standalone eye crop).
+ */
+std::string eyeResultJson(const EyeResult& eye);
+
+/**
+ * @brief
+ * JSON string literal of s, quotes included.
+ */
+std::string jsonString(const std::string& s);
+
+/**
+ * @brief
+ * Reads items from in until it ends and writes one JSON line per item to out, e.g.
+ * {"seq":0,"path":"a.jpg","status":"ok","ms":41.2,"biou":0.71,"faces":[...]}.
+ * Items are analysed as tasks of the shared pool, at most opts.maxInFlight of them read
+ * ahead of the output, with the models loaded once for the whole stream. Each line is
+ * flushed as it is written so the stream can sit in a pipe. The status of an item is one
+ * of "ok", "no_face", "no_pupil", "decode_failed", "too_large" or "internal_error". A
+ * malformed blob header or a payload cut short ends the stream with a last line whose
+ * status is "bad_header" or "truncated".
+ * @param in Input stream, opened in binary mode for blobs.
+ * @param out Output stream; nothing else may write to it meanwhile.
+ * @param pipeline The analysis applied to every item.
+ * @param opts Framing, output order and bounds.
+ * @param stats Output parameter: counters of the stream.
+ * @return false if the stream was ended by a malformed or truncated blob
+ */
+bool serveJsonLines(std::istream& in, std::ostream& out, const Pipeline& pipeline,
+                    const StreamOptions& opts, StreamStats& stats);
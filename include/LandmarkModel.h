@@ -0,0 +1,71 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <dlib/image_processing/shape_predictor.h>
+#include <dlib/opencv.h>
+
+struct FlatSplit;
+
+/**
+ * @brief
+ * Converts a dlib shape predictor (shape_predictor_68_face_landmarks.dat) into the flat
+ * model read by FlatShapePredictor: a fixed header followed by 64 byte aligned arrays of
+ * the initial shape, the feature pixel anchors and deltas, the tree splits and the leaf
+ * values. Integers and floats are stored in host byte order.
+ * @param datPath The dlib model.
+ * @param flatPath The flat model to write.
+ * @return false if the dlib model cannot be read, its trees are not all of the same
+ * depth, or the flat model cannot be written
+ */
+bool convertLandmarkModel(const std::string& datPath, const std::string& flatPath);
+
+/**
+ * @brief
+ * Read only, memory mapped landmark model written by convertLandmarkModel. Opening it
+ * only validates the header, anchors and splits; the leaf values (nearly all of the file)
+ * are paged in on demand and shared through the page cache by every process that maps
+ * the same file. Predictions are identical to dlib::shape_predictor on the same model.
+ */
+class FlatShapePredictor
+{
+public:
+    FlatShapePredictor() = default;
+    explicit FlatShapePredictor(const std::string& path, bool privateCopy = false) { open(path, privateCopy); }
+    ~FlatShapePredictor();
+
+    FlatShapePredictor(const FlatShapePredictor&) = delete;
+    FlatShapePredictor& operator=(const FlatShapePredictor&) = delete;
+
+    /**
+     * @brief
+     * Maps the model and validates it.
+     * @param privateCopy Read the model into anonymous memory instead of mapping the file.
+     * The pages are then allocated on the NUMA node of the calling thread (first touch),
+     * which is how each node gets a replica of its own.
+     * @return false if the file is missing, truncated or not a flat landmark model
+     */
+    bool open(const std::string& path, bool privateCopy = false);
+    void close();
+
+    bool isOpen() const { return base != nullptr; }
+    unsigned long numParts() const { return parts; }
+
+    /**
+     * @brief
+     * Same as dlib::shape_predictor::operator(): landmarks of the face in rect.
+     * Const and safe to call concurrently.
+     */
+    dlib::full_object_detection operator()(const dlib::cv_image<dlib::bgr_pixel>& img,
+                                           const dlib::rectangle& rect) const;
+
+private:
+    const unsigned char* base = nullptr;
+    size_t length = 0;
+    unsigned long parts = 0, cascades = 0, trees = 0, splitsPerTree = 0, features = 0;
+    dlib::matrix<float, 0, 1> initialShape;
+    const uint32_t* anchors = nullptr;  // [cascades][features]
+    const float* deltas = nullptr;      // [cascades][features][2]
+    const FlatSplit* splits = nullptr;      // [cascades][trees][splitsPerTree]
+    const float* leaves = nullptr;      // [cascades][trees][splitsPerTree + 1][2 * parts]
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "CropArchive.h"
+#include "PupilSegment.h"
+#include "Sharding.h"
+#include "VideoAnalysis.h"
+
+/**
+ * @brief
+ * An eye crop extracted once and reused by every parameter set of a sweep.
+ */
+struct CachedCrop
+{
+    cv::Mat pre;                        // grayscale crop after preprocessForPupil
+    std::vector<cv::Point> landmarks;   // eye landmarks in crop coordinates (empty for eye images)
+    int source = 0;                     // index of the dataset file the crop comes from
+    int frame = -1;                     // video frame index, -1 for images
+    int face = 0;                       // rank of the face by detection score
+};
+
+/**
+ * @brief
+ * Accuracy and throughput of one parameter set over the cached crops.
+ */
+struct SweepResult
+{
+    PupilParams params;
+    int files = 0;                      // files with at least one scored crop
+    int correct = 0;                    // files classified correctly from their score (aggregateFileScores)
+    int found = 0;                      // crops where a pupil was found
+    double seconds = 0.0;               // summed thread time spent on this set
+
+    double accuracy() const { return files ? (double)correct / files : 0.0; }
+};
+
+/**
+ * @brief
+ * Parses a grid specification "name=v1,v2,...;name=v1,..." over the findPupilMask
+ * parameters (cannyLow, cannyHigh, houghMinR, houghMaxR, dp, minDist, houghParam1,
+ * houghParam2) into the cartesian product of the listed values. Unlisted parameters keep
+ * their defaults.
+ * @param spec The grid specification.
+ * @param sets Output parameter: the parameter sets.
+ * @return false if a name or value is invalid
+ */
+bool parseSweepGrid(const std::string& spec, std::vector<PupilParams>& sets);
+
+/**
+ * @brief
+ * Draws count random parameter sets from fixed plausible ranges.
+ * @param count Number of sets.
+ * @param seed Seed of the generator, the same seed gives the same sets.
+ */
+std::vector<PupilParams> randomSweep(int count, unsigned seed);
+
+/**
+ * @brief
+ * Runs face detection and landmarking once per file (eye images are only normalized) and
+ * caches the preprocessed eye crops. Files are processed in parallel.
+ * @param files The dataset files.
+ * @param videoOpts Sampling of the video frames whose eyes are cached.
+ * @return the cached crops
+ */
+std::vector<CachedCrop> collectCrops(const std::vector<DatasetFile>& files, const VideoOptions& videoOpts);
+
+/**
+ * @brief
+ * Preprocesses the crops of an archive written by export-crops; no face level work is redone.
+ * Crop sources index archive.sources().
+ */
+std::vector<CachedCrop> collectCrops(const CropArchive& archive);
+
+/**
+ * @brief
+ * Evaluates every parameter set on every cached crop in parallel. Sets that share the
+ * Canny thresholds share the edge map of each crop; preprocessing is shared by all sets.
+ * Files are scored and classified as batchProcess scores them (aggregateFileScores).
+ * @param files The dataset files the crops reference (for the labels).
+ * @param crops The cached crops.
+ * @param sets The parameter sets.
+ * @param landmarkBounds Search each crop within the center region derived from its landmarks
+ * (pupilParamsFromLandmarks). houghMinR, houghMaxR and minDist are taken from the landmarks
+ * too, except those that differ between sets: a swept axis keeps its swept values.
+ * @return one result per set, in the order of sets
+ */
+std::vector<SweepResult> runSweep(const std::vector<DatasetFile>& files,
+                                  const std::vector<CachedCrop>& crops,
+                                  const std::vector<PupilParams>& sets,
+                                  bool landmarkBounds = false);
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "FaceAnalysis.h"
+#include "VideoAnalysis.h"
+
+/**
+ * @brief
+ * The whole analysis behind one configuration, for embedding. Options are fixed at
+ * construction and every method is const: one Pipeline can be shared by any number of
+ * threads. Nothing is written to disk or to the standard streams; results come back as
+ * structures. Per-video state (pupil tracks) lives in a Stream, one per video.
+ */
+class Pipeline
+{
+public:
+    Pipeline() = default;
+
+    /**
+     * @brief
+     * @param face Face selection, detection, pupil search and quality gate options.
+     * @param video Sampling and tracking options; its pupil and detect fields are taken from face.
+     */
+    Pipeline(const FaceAnalysisOptions& face, const VideoOptions& video);
+
+    const FaceAnalysisOptions& faceOptions() const { return face; }
+    const VideoOptions& videoOptions() const { return video; }
+
+    /**
+     * @brief
+     * Segments the pupil of a standalone eye crop, see analyzeEyeCrop.
+     */
+    bool processEye(const cv::Mat& eyeImage, EyeResult& eye) const;
+
+    /**
+     * @brief
+     * Analyses every selected face of a BGR image, see analyzeFaces.
+     * @return false if the image is empty or no face was analysed
+     */
+    bool processImage(const cv::Mat& imageBgr, std::vector<FaceResult>& faces) const;
+
+    /**
+     * @brief
+     * processImage on an image file read from disk (EXIF orientation ignored, as dlib does).
+     * @return false if the file cannot be decoded or no face was analysed
+     */
+    bool processImageFile(const std::string& path, std::vector<FaceResult>& faces) const;
+
+    /**
+     * @brief
+     * processImage on an encoded image (JPEG, PNG ...) held in memory.
+     * @return false if the bytes cannot be decoded or no face was analysed
+     */
+    bool processImageBuffer(const void* data, size_t size, std::vector<FaceResult>& faces) const;
+
+    /**
+     * @brief
+     * Samples and analyses a video file, see analyzeVideo.
+     */
+    bool processVideo(const std::string& path, const std::function<bool(const FrameResult&)>& onFrame) const;
+
+    /**
+     * @brief
+     * Replays a video file at its frame rate, see analyzeVideoPaced.
+     */
+    bool processVideoPaced(const std::string& path, const PacedOptions& paced, PacedStats& stats,
+                           const std::function<bool(const FrameResult&)>& onFrame) const;
+
+    /**
+     * @brief
+     * Frames pushed one at a time by the caller (a camera, a decoder of its own), with the
+     * pupils of each frame carried over to the next. A stream is used by one thread at a
+     * time; run one stream per video to analyse several in parallel.
+     */
+    class Stream
+    {
+    public:
+        explicit Stream(const Pipeline& pipeline) : analyzer(pipeline.videoOptions()) {}
+
+        /**
+         * @brief
+         * Analyses the best face of a frame.
+         * @param frameBgr The BGR frame.
+         * @param index Frame number; tracks are dropped across gaps above trackMaxGap.
+         * @param result Output parameter: the frame result.
+         * @return true if a face was found and its eyes cropped
+         */
+        bool processFrame(const cv::Mat& frameBgr, int index, FrameResult& result);
+
+    private:
+        FrameAnalyzer analyzer;
+    };
+
+private:
+    FaceAnalysisOptions face;
+    VideoOptions video;
+};
@@ -0,0 +1,94 @@
+#ifndef IMAGEFORENSICS_PIPELINE_C_H
+#define IMAGEFORENSICS_PIPELINE_C_H
+
+#include <stddef.h>
+
+/*
+ * Plain C interface over Pipeline, for services that embed the analysis instead of
+ * running checkPupil / batchProcess. A pipeline is configured once and may be used from
+ * any number of threads at the same time; a stream carries the pupil tracks of one video
+ * and is used by one thread at a time. Nothing is printed or written to disk. Functions
+ * return one of the IF_* status codes and never let a C++ exception escape.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    IF_OK = 0,
+    IF_NO_FACE = 1,                 /* the input was analysed but no face was found */
+    IF_INVALID_ARGUMENT = -1,
+    IF_DECODE_FAILED = -2,          /* the buffer is not an image OpenCV can decode */
+    IF_INTERNAL_ERROR = -3          /* an exception was raised inside the pipeline */
+};
+
+typedef struct if_pipeline if_pipeline;
+typedef struct if_stream if_stream;
+
+/* Fields set to -1 by if_config_init keep the preset's (or the default) value. */
+typedef struct if_config {
+    const char* preset;             /* "fast", "balanced", "accurate", or NULL for the defaults */
+    int max_faces;                  /* top faces by detection score, 0 = every face */
+    int landmark_bounds;            /* 0 / 1 */
+    int eye_width;                  /* canonical eye width in pixels, 0 = native */
+    int detect_parallel;            /* 0 / 1 */
+    int track;                      /* 0 / 1, streams only */
+    int quality_gate;               /* 0 off, 1 frames, 2 eye crops, 3 both */
+    int threads;                    /* process wide thread budget, 0 = leave as is; only
+                                       honoured before the first pipeline starts working */
+} if_config;
+
+typedef struct if_eye_result {
+    int found;                      /* 1 if a pupil was segmented and scored */
+    double biou;                    /* -1 when not found */
+    int center_x, center_y;         /* pupil center in image coordinates */
+    int radius;
+    int crop_x, crop_y, crop_width, crop_height;
+    int tracked;                    /* found by the narrow search around the previous frame's pupil */
+} if_eye_result;
+
+typedef struct if_face_result {
+    int index;                      /* rank by detection score */
+    double detection_score;
+    int x, y, width, height;        /* face box */
+    double biou;                    /* best of the two eyes, -1 if neither was segmented */
+    if_eye_result left, right;
+} if_face_result;
+
+void if_config_init(if_config* config);
+
+/*
+ * NULL config uses the defaults. Returns NULL if the preset is unknown, or if threads asks
+ * for a budget other than that of the thread pool already in use: the pool is shared by
+ * every pipeline of the process and is never rebuilt under them.
+ */
+if_pipeline* if_pipeline_create(const if_config* config);
+void if_pipeline_destroy(if_pipeline* pipeline);
+
+/*
+ * Decodes an encoded image (JPEG, PNG ...) and analyses its faces. Up to capacity results
+ * are written to faces; *face_count receives the number of faces analysed, which may be
+ * larger than capacity.
+ */
+int if_process_image_buffer(const if_pipeline* pipeline, const void* data, size_t size,
+                            if_face_result* faces, int capacity, int* face_count);
+
+if_stream* if_stream_create(const if_pipeline* pipeline);
+void if_stream_destroy(if_stream* stream);
+
+/*
+ * Analyses the best face of one packed 8 bit BGR frame (stride in bytes, 0 = width * 3).
+ * With a stream the pupils found in the previous frames of the stream seed the search;
+ * stream may be NULL to analyse the frame on its own.
+ */
+int if_process_frame(const if_pipeline* pipeline, if_stream* stream, const unsigned char* bgr,
+                     int width, int height, size_t stride, int frame_index, if_face_result* face);
+
+const char* if_status_string(int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
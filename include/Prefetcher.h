@@ -0,0 +1,88 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief
+ * A file handed out by the Prefetcher, in the order the files were given.
+ */
+struct PrefetchedFile
+{
+    std::string path;
+    std::vector<unsigned char> bytes;   // whole file content; empty if it was only warmed or could not be read
+};
+
+/**
+ * @brief
+ * Decodes a prefetched image from memory with imdecode, or reads it from disk with
+ * imread when its content was not prefetched.
+ * @param file The prefetched file.
+ * @param flags imread / imdecode flags.
+ */
+cv::Mat decodeImage(const PrefetchedFile& file, int flags = cv::IMREAD_COLOR);
+
+/**
+ * @brief
+ * Read-ahead stage between the file list and the workers. A background thread stays up
+ * to maxFiles files ahead of the consumer: files to load are read whole with large
+ * sequential reads, files that are opened elsewhere (videos) are only pulled into the
+ * page cache with readahead. Loaded bytes waiting in the queue are capped by maxBytes,
+ * except that one file is always allowed so a file larger than the cap cannot stall it.
+ */
+class Prefetcher
+{
+public:
+    struct Request
+    {
+        std::string path;
+        bool load = true;               // read into memory, otherwise only warm the page cache
+    };
+
+    /**
+     * @brief
+     * Starts the read-ahead thread.
+     * @param requests The files, in the order next() returns them.
+     * @param maxFiles Files read ahead of the consumer, 0 disables prefetching.
+     * @param maxBytes Cap on the loaded bytes waiting in the queue.
+     */
+    Prefetcher(std::vector<Request> requests, size_t maxFiles, size_t maxBytes);
+    ~Prefetcher();
+
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+    /**
+     * @brief
+     * Hands out the next file, waiting for the read-ahead thread if it is behind.
+     * @param file Output parameter: the file and, for loaded files, its content.
+     * @return false once every file was handed out
+     */
+    bool next(PrefetchedFile& file);
+
+    /**
+     * @brief
+     * Seconds the consumer spent waiting for the read-ahead thread.
+     */
+    double stalledSeconds() const { return stalled; }
+
+private:
+    void readerLoop();
+
+    std::vector<Request> requests;
+    size_t maxFiles, maxBytes;
+    size_t nextOut = 0;
+
+    std::deque<PrefetchedFile> ready;
+    size_t queuedBytes = 0;
+    bool stopping = false;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread reader;
+    double stalled = 0.0;
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+#include "FaceAnalysis.h"
+#include "VideoAnalysis.h"
+
+/**
+ * @brief
+ * Names of the speed / accuracy presets accepted by applyPreset, fastest first.
+ * fast      half resolution parallel detection, small canonical eyes, coarse Hough
+ *           accumulator, no permissive fallback, OpenCV ellipse fit, 5 video frames.
+ * balanced  full resolution detection, landmark bounded search on 100 px eyes,
+ *           15 video frames.
+ * accurate  detection on a 2x upsampled image, native resolution eyes with the default
+ *           radius range, fine accumulator, 60 video frames without tracking.
+ */
+const std::vector<std::string>& presetNames();
+
+/**
+ * @brief
+ * Overwrites the detection, pupil search and video sampling options with those of a preset.
+ * Options outside the preset (face count, thread budget, sequential stopping) are kept,
+ * and flags parsed afterwards still override individual preset values.
+ * @param name The preset name given on the command line.
+ * @param faceOpts Face analysis options to update.
+ * @param videoOpts Video options to update; its pupil and detect fields are not touched,
+ * callers copy them from faceOpts after parsing as for the individual flags.
+ * @return false if the name is unknown
+ */
+bool applyPreset(const std::string& name, FaceAnalysisOptions& faceOpts, VideoOptions& videoOpts);
+
+/**
+ * @brief
+ * Prints the effective detection, pupil search and video sampling settings, one per line.
+ */
+void printEffectiveConfig(std::ostream& out, const FaceAnalysisOptions& faceOpts,
+                          const VideoOptions& videoOpts);
@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief
+ * Compact pupil mask: the mask pixels of the pupil's bounding box only, plus where that
+ * box sits in the eye crop. Everything outside roi is background. Segmentation, contour
+ * extraction, BIoU and the writers work on the small mask so the memory traffic per eye
+ * follows the pupil size, not the crop size; full() expands it when a crop sized mask is needed.
+ */
+struct PupilMask
+{
+    cv::Size size;              // size of the eye crop the mask belongs to
+    cv::Rect roi;               // box of local within the crop
+    cv::Mat local;              // CV_8UC1, roi.size(), 0 or 255
+
+    bool empty() const { return local.empty(); }
+
+    /**
+     * @brief
+     * The crop sized mask.
+     */
+    cv::Mat full() const;
+
+    /**
+     * @brief
+     * Number of mask pixels.
+     */
+    int area() const;
+
+    /**
+     * @brief
+     * Wraps a crop sized mask, keeping only the bounding box of its non zero pixels.
+     */
+    static PupilMask fromFull(const cv::Mat& mask);
+
+    /**
+     * @brief
+     * The mask of the same region in a resampled crop (nearest neighbour).
+     * @param newSize Size of the resampled crop.
+     */
+    PupilMask resized(cv::Size newSize) const;
+};
+
+/**
+ * @brief
+ * findContours(RETR_EXTERNAL, CHAIN_APPROX_SIMPLE) on the local mask, points in crop coordinates.
+ */
+void pupilContours(const PupilMask& mask, std::vector<std::vector<cv::Point>>& contours);
+
+/**
+ * @brief
+ * Paints the mask as a BGR image of the crop size (white pupil on black), the panel the
+ * writers put next to the eye.
+ */
+void renderPupilMask(const PupilMask& mask, cv::Mat& bgr);
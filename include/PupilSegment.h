@@ -1,7 +1,89 @@
 #pragma once
+#include <string>
+#include <vector>
 #include <opencv2/opencv.hpp>
+#include "PupilMask.h"
 
 using namespace cv;
+
+/**
+ * @brief
+ * How findPupilMask proposes pupil candidates.
+ * Hough   circles from HoughCircles over the radius band, circular mask.
+ * Ransac  ellipses fitted to random subsets of the dark side edge points, elliptical mask;
+ *         follows pupils seen off-axis and costs a bounded number of small fits.
+ */
+enum class PupilDetector { Hough, Ransac };
+
+/**
+ * @brief
+ * Parses a detector name ("hough", "ransac").
+ * @return false if the name is unknown
+ */
+bool parsePupilDetector(const std::string &name, PupilDetector &detector);
+
+/**
+ * @brief
+ * Name of a detector, as accepted by parsePupilDetector.
+ */
+const char *pupilDetectorName(PupilDetector detector);
+
+/**
+ * @brief
+ * The tuning parameters of findPupilMask, with the same defaults.
+ * The track* fields only apply to findPupilMaskTracked, the ransac* fields to the Ransac detector
+ * (which takes its radius band and center region from the hough* fields and searchRegion).
+ */
+struct PupilParams
+{
+    int cannyLow = 30;
+    int cannyHigh = 90;
+    int houghMinR = 10;
+    int houghMaxR = 120;
+    double dp = 1.2;
+    int minDist = 30;
+    int houghParam1 = 80;
+    int houghParam2 = 30;
+    cv::Rect searchRegion;      // pupil centers must lie inside it, empty = anywhere in the crop
+    bool permissiveFallback = true; // rerun Hough with relaxed parameters when nothing is found
+    PupilDetector detector = PupilDetector::Hough;
+
+    int ransacIterations = 300;         // five point fits per search
+    double ransacTolerance = 1.5;       // inlier distance to the ellipse, in pixels
+    int ransacMaxPoints = 1500;         // edge points kept, evenly subsampled beyond
+    double ransacDarkPercentile = 0.3;  // dark side of an edge point must be this dark (image percentile)
+    double ransacMinSupport = 0.3;      // fraction of the ellipse perimeter covered by inliers
+    double ransacMinAxisRatio = 0.5;    // minor over major axis
+
+    double trackMargin = 0.5;   // search window margin around the previous circle, in previous radii
+    double trackBand = 0.25;    // radius band searched, as a fraction of the previous radius
+    double trackAccept = 0.9;   // minimum score, relative to the previous one, to skip the full search
+};
+
+/**
+ * @brief
+ * Derives the radius range, minDist and center region of the search from the eye landmarks
+ * (in crop coordinates): the pupil radius is a narrow fraction of the corner to corner eye
+ * width and its center lies within the eye opening. The Hough accumulator then only spans
+ * plausible radii around the eye, which also makes the permissive fallback rare.
+ * @param eyeLandmarks The six landmarks of one eye.
+ * @param base Parameters whose other fields are kept.
+ * @return base unchanged if fewer than six landmarks are given
+ */
+PupilParams pupilParamsFromLandmarks(const std::vector<cv::Point> &eyeLandmarks,
+                                     const PupilParams &base = PupilParams());
+
+/**
+ * @brief
+ * Pupil found in the previous video frame, used to narrow the next search.
+ */
+struct PupilTrack
+{
+    bool valid = false;
+    cv::Point2f center;         // in the coordinates of the image being searched
+    float radius = 0.0f;
+    double score = 0.0;         // score of the previous circle
+};
 /**
  * @brief 
  * The core function that performs contrast adaptive hough transform
@@ -34,3 +116,99 @@ bool findPupilMask(const cv::Mat &eyeGray,
                    int minDist = 30,
                    int houghParam1 = 80,
                    int houghParam2 = 30);
+
+/**
+ * @brief
+ * findPupilMask with the tuning parameters grouped in a PupilParams.
+ * @param score Optional output: the score of the chosen circle.
+ */
+bool findPupilMask(const cv::Mat &eyeGray,
+                   cv::Mat &pupilMask,
+                   cv::Point &center,
+                   int &radius,
+                   const PupilParams &params,
+                   double *score = nullptr);
+
+/**
+ * @brief
+ * findPupilMask producing the compact mask of the pupil's box instead of a crop sized one.
+ * @param score Optional output: the score of the chosen circle.
+ */
+bool findPupilMask(const cv::Mat &eyeGray,
+                   PupilMask &pupilMask,
+                   cv::Point &center,
+                   int &radius,
+                   const PupilParams &params,
+                   double *score = nullptr);
+
+/**
+ * @brief
+ * First stage of findPupilMask: 8 bit conversion, CLAHE and median blur.
+ * Depends on none of the tuning parameters.
+ * @param in Single channel eye image.
+ * @param out Output parameter: the preprocessed image.
+ */
+void preprocessForPupil(const cv::Mat &in, cv::Mat &out);
+
+/**
+ * @brief
+ * Second stage of findPupilMask: Canny edges and streak removal.
+ * Depends only on cannyLow and cannyHigh.
+ * @param I Image returned by preprocessForPupil.
+ * @param edges Output parameter: the cleaned edge map.
+ * @param params The tuning parameters.
+ */
+void pupilEdgeMap(const cv::Mat &I, cv::Mat &edges, const PupilParams &params);
+
+/**
+ * @brief
+ * The Hough (or Ransac), candidate selection and mask stages of findPupilMask, starting from an
+ * image already passed through preprocessForPupil and its pupilEdgeMap. Lets callers
+ * that evaluate many parameter sets share the earlier stages.
+ * @param score Optional output: the score of the chosen circle.
+ */
+bool findPupilMaskPrepared(const cv::Mat &I,
+                           const cv::Mat &edges,
+                           PupilMask &pupilMask,
+                           cv::Point &center,
+                           int &radius,
+                           const PupilParams &params,
+                           double *score = nullptr);
+
+/**
+ * @brief
+ * The Ransac detector on a prepared image and its edge map: keeps the edge points whose dark
+ * side (against the gradient) is among the darkest pixels, fits ellipses to random five point
+ * subsets drawn near each other with CustomEllipseFitter, refits the best supported ones to
+ * all their inliers and scores them like the Hough circles (darkness inside, edge coverage
+ * along the boundary, distance from the crop center). The mask is the filled ellipse.
+ * Deterministic: the subsets come from a fixed seed.
+ * @param ellipseBox Output parameter: the chosen ellipse in crop coordinates.
+ * @param score Optional output: the score of the chosen ellipse.
+ */
+bool findPupilEllipsePrepared(const cv::Mat &I,
+                              const cv::Mat &edges,
+                              PupilMask &pupilMask,
+                              cv::RotatedRect &ellipseBox,
+                              const PupilParams &params,
+                              double *score = nullptr);
+
+/**
+ * @brief
+ * Video variant of findPupilMask that starts from the pupil found in the previous frame.
+ * Edges and Hough circles are only computed in a small window around the previous center
+ * and within a narrow radius band, both kept inside houghMinR..houghMaxR and searchRegion
+ * like the full search; the full search of findPupilMask runs only when no
+ * candidate is found there or its score drops below trackAccept times the previous score.
+ * The Ransac detector always runs the full search.
+ * @param prior The previous pupil, center mapped into this crop's coordinates.
+ * @param tracked Optional output: true if the narrow search was accepted.
+ */
+bool findPupilMaskTracked(const cv::Mat &eyeGray,
+                          PupilMask &pupilMask,
+                          cv::Point &center,
+                          int &radius,
+                          const PupilTrack &prior,
+                          const PupilParams &params = PupilParams(),
+                          double *score = nullptr,
+                          bool *tracked = nullptr);
@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <opencv2/opencv.hpp>
+
+/**
+ * Outcome of checkQuality. Images are tested in this order and rejected for the first
+ * reason that applies.
+ */
+enum class QualityVerdict {
+    Pass,
+    Dark,               // mean luminance below minLuma
+    Bright,             // mean luminance above maxLuma
+    Clipped,            // too many pixels at the ends of the histogram
+    Blurry,             // variance of the Laplacian below minSharpness
+    Count
+};
+
+inline const char* qualityVerdictName(QualityVerdict v) {
+    switch (v) {
+    case QualityVerdict::Pass:    return "pass";
+    case QualityVerdict::Dark:    return "dark";
+    case QualityVerdict::Bright:  return "bright";
+    case QualityVerdict::Clipped: return "clipped";
+    case QualityVerdict::Blurry:  return "blurry";
+    default:                      return "?";
+    }
+}
+
+/**
+ * @brief
+ * Where a gate sits in the pipeline; each stage has its own counters.
+ * Frame  whole images and video frames, before the face detector.
+ * Eye    eye crops, before the pupil search.
+ */
+enum class QualityStage { Frame, Eye, Count };
+
+/**
+ * @brief
+ * Thresholds of a quality gate. The statistics are computed on a grayscale copy whose
+ * longest side is at most maxSide pixels, so their cost does not grow with the input and
+ * the sharpness threshold does not depend on its resolution.
+ */
+struct QualityGate
+{
+    bool enabled = false;
+    int maxSide = 160;
+    double minSharpness = 15.0;         // variance of the Laplacian of the downsampled image
+    double minLuma = 30.0;              // mean grey level
+    double maxLuma = 225.0;
+    double maxClipped = 0.5;            // fraction of pixels at or below 5 or at or above 250
+};
+
+/**
+ * @brief
+ * Default gate of eye crops: crops are small and soft and mostly iris and pupil, so they
+ * are allowed to be less sharp and darker than whole frames.
+ */
+QualityGate eyeQualityGate();
+
+/**
+ * @brief
+ * The statistics a gate compares with its thresholds.
+ */
+struct QualityStats
+{
+    double sharpness = 0.0;
+    double luma = 0.0;
+    double clipped = 0.0;
+};
+
+/**
+ * @brief
+ * Computes the statistics of an image (BGR or grayscale) on a copy downsampled to maxSide.
+ */
+QualityStats measureQuality(const cv::Mat& image, int maxSide);
+
+/**
+ * @brief
+ * Measures an image and compares it with the gate, counting the verdict for the stage.
+ * @return QualityVerdict::Pass if the gate is disabled or the image passes
+ */
+QualityVerdict checkQuality(const cv::Mat& image, const QualityGate& gate, QualityStage stage);
+
+/**
+ * @brief
+ * Snapshot of the verdict counters of each stage, updated with relaxed atomics.
+ */
+struct QualityGateStats
+{
+    uint64_t byVerdict[(int)QualityStage::Count][(int)QualityVerdict::Count] = {};
+};
+
+QualityGateStats qualityGateStats();
+
+/**
+ * @brief
+ * Writes, for each stage that checked at least one image, how many passed and how many
+ * were skipped for each reason.
+ */
+void printQualityGateStats(std::ostream& out);
@@ -0,0 +1,139 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "FaceAnalysis.h"
+#include "PupilMask.h"
+
+/**
+ * @brief
+ * How checkPupil shows and records its results.
+ */
+struct ViewOptions
+{
+    bool display = true;                // show the latest result in a window
+    std::string annotatedOut;           // write annotated frames to this video, empty = none
+    double annotatedFps = 10.0;         // frame rate of the annotated video
+    cv::Size tile = cv::Size(200, 120); // size of each eye and mask panel in composed views
+};
+
+/**
+ * @brief
+ * The eye next to its mask, the BIoU printed on the mask.
+ * @param eye BGR or grayscale eye crop.
+ * @param mask Pupil mask of the crop (resampled if its crop size differs).
+ * @param biou Score printed on the mask.
+ * @param tile Size of each of the two panels, empty keeps the crop size.
+ */
+cv::Mat renderEyePanel(const cv::Mat& eye, const PupilMask& mask, double biou, cv::Size tile = cv::Size());
+
+/**
+ * @brief
+ * One row of four tiles, eye and mask of the left then the right eye, with a caption in
+ * the top left corner. Eyes without a pupil get blank tiles; the row always has the same
+ * size, as frames of a video must.
+ * @param face The face, nullptr when no face was found.
+ * @param caption Text drawn on the row.
+ * @param tile Size of each tile.
+ */
+cv::Mat renderFaceRow(const FaceResult* face, const std::string& caption, cv::Size tile);
+
+/**
+ * @brief
+ * Shows the latest posted image in a window without ever blocking the producer: posting
+ * replaces the image waiting to be shown, so a slow window skips images instead of
+ * stalling the pipeline. HighGUI must be driven from the thread that created the window
+ * (the main thread on macOS), so run() moves the work to a background thread and renders
+ * on the calling thread.
+ */
+class ResultDisplay
+{
+public:
+    explicit ResultDisplay(const std::string& window) : window(window) {}
+
+    /**
+     * @brief
+     * Hands an image to the display. Never waits; safe to call from any thread.
+     */
+    void post(const cv::Mat& image);
+
+    /**
+     * @brief
+     * Runs work on a background thread and shows posted images on the calling thread
+     * until it returns. An exception thrown by work is rethrown on the calling thread once
+     * the background thread has been joined.
+     * @param work The pipeline; it posts its results with post().
+     * @param holdAtEnd Keep the last image on screen until a key is pressed.
+     */
+    void run(const std::function<void()>& work, bool holdAtEnd);
+
+    uint64_t postedCount() const { return posted; }
+    uint64_t shownCount() const { return shown; }
+
+private:
+    std::string window;
+    std::mutex mtx;
+    std::condition_variable cv;
+    cv::Mat latest;
+    bool fresh = false;
+    bool done = false;
+    uint64_t posted = 0, shown = 0;
+};
+
+/**
+ * @brief
+ * VideoWriter fed through a bounded queue and a writer thread, so encoding costs the
+ * producer a queue push. When the queue is full the frame is dropped and counted rather
+ * than waited for. Frames must all have the size given to open().
+ */
+class AnnotatedWriter
+{
+public:
+    AnnotatedWriter() = default;
+    ~AnnotatedWriter();
+
+    AnnotatedWriter(const AnnotatedWriter&) = delete;
+    AnnotatedWriter& operator=(const AnnotatedWriter&) = delete;
+
+    /**
+     * @brief
+     * Opens the video (mp4v) and starts the writer thread.
+     * @param capacity Frames the queue holds before frames are dropped.
+     * @return false if the video cannot be opened
+     */
+    bool open(const std::string& path, double fps, cv::Size frameSize, size_t capacity = 64);
+
+    /**
+     * @brief
+     * Queues a frame. Never waits; does nothing if the writer is not open.
+     * @return false if the frame was dropped
+     */
+    bool write(const cv::Mat& frame);
+
+    /**
+     * @brief
+     * Writes the queued frames and closes the video.
+     */
+    void close();
+
+    bool isOpen() const { return thread.joinable(); }
+    uint64_t writtenCount() const { return written; }
+    uint64_t droppedCount() const { return dropped; }
+
+private:
+    void writerLoop();
+
+    cv::VideoWriter writer;
+    size_t capacity = 0;
+    std::deque<cv::Mat> queue;
+    bool closing = false;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread thread;
+    uint64_t written = 0, dropped = 0;
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include <string>
+
+/**
+ * @brief
+ * Why a sequentially tested video stopped being processed.
+ */
+enum class StopReason { None, ConfidentReal, ConfidentSynthetic, FrameCap, EndOfStream };
+
+/**
+ * @brief
+ * Name of a stop reason as written to the console and the csv ("confident-real", ...).
+ */
+const char* stopReasonName(StopReason reason);
+
+/**
+ * @brief
+ * Parameters of the sequential test on the running mean of the frame BIoU scores.
+ */
+struct SequentialOptions
+{
+    bool enabled = false;
+    double threshold = 0.5;     // real if the mean BIoU is above, synthetic below
+    double confidence = 0.99;   // two sided confidence level of the interval
+    int minFrames = 3;          // never decide on fewer scored frames
+    int maxFrames = 60;         // frame cap, the verdict is taken on the mean at this point
+    double minStdDev = 0.05;    // floor on the sample deviation so a few identical scores cannot decide alone
+};
+
+/**
+ * @brief
+ * Running mean and variance (Welford) of frame scores with a normal confidence
+ * interval; the test is decided once the interval lies entirely on one side of the threshold.
+ */
+class SequentialVerdict
+{
+public:
+    explicit SequentialVerdict(const SequentialOptions& opts);
+
+    /**
+     * @brief
+     * Adds the score of one frame.
+     * @param biou The frame BIoU.
+     * @return true once the verdict is decided (confident or frame cap reached)
+     */
+    bool add(double biou);
+
+    /**
+     * @brief
+     * Marks the end of the stream; keeps an earlier reason if the test already stopped.
+     */
+    void finish();
+
+    int count() const { return n; }
+    double mean() const { return m; }
+    double halfWidth() const;   // half width of the confidence interval
+    StopReason reason() const { return why; }
+
+private:
+    SequentialOptions opts;
+    double z;
+    int n = 0;
+    double m = 0.0;
+    double m2 = 0.0;
+    StopReason why = StopReason::None;
+};
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @brief
+ * A file of the dataset, found under <root>/<type>/<mode>.
+ */
+struct DatasetFile
+{
+    std::string path;       // full path as opened by the pipeline
+    std::string relPath;    // "<type>/<mode>/<filename>", identical on every machine
+    std::string type;       // real | synthetic
+    std::string mode;       // eye | face | video
+};
+
+/**
+ * @brief
+ * Lists the files under root/{real,synthetic}/{eye,face,video}, sorted by relative path
+ * so that every process sees the same order whatever the directory iteration order.
+ * @param root The dataset root folder.
+ * @return the discovered files
+ */
+std::vector<DatasetFile> discoverDataset(const std::string& root);
+
+/**
+ * @brief
+ * 64 bit FNV-1a hash. Unlike std::hash it is the same on every platform and build.
+ */
+uint64_t stableHash(const std::string& s);
+
+/**
+ * @brief
+ * Parses a shard specification "i/N" with 0 <= i < N.
+ * @param spec The specification given on the command line.
+ * @param index Output parameter: the shard index i.
+ * @param count Output parameter: the number of shards N.
+ * @return false if the specification is malformed
+ */
+bool parseShard(const std::string& spec, int& index, int& count);
+
+/**
+ * @brief
+ * Keeps the files whose relative path hashes to shard index (hash mod count).
+ */
+std::vector<DatasetFile> selectShard(const std::vector<DatasetFile>& files, int index, int count);
+
+/**
+ * @brief
+ * Cost based sharding: files are assigned, heaviest first, to the least loaded shard
+ * (longest processing time first). Files missing from the manifest cost the mean manifest
+ * cost. Every process computes the same assignment from the same manifest.
+ * @param files The discovered files.
+ * @param costs Relative path -> cost, as loaded by loadManifest.
+ * @param index The shard to keep.
+ * @param count The number of shards.
+ * @return the files of shard index, in relative path order
+ */
+std::vector<DatasetFile> selectShardByCost(const std::vector<DatasetFile>& files,
+                                           const std::map<std::string, double>& costs,
+                                           int index, int count);
+
+/**
+ * @brief
+ * Writes a cost manifest (RelPath,Bytes,Frames,Cost) for every file of the dataset.
+ * @param root The dataset root folder.
+ * @param outPath The manifest csv to write.
+ * @param byLength Cost is the number of frames (1 for images) instead of the file size.
+ * @return false if the manifest could not be written
+ */
+bool writeManifest(const std::string& root, const std::string& outPath, bool byLength);
+
+/**
+ * @brief
+ * Loads the RelPath and Cost columns of a manifest written by writeManifest.
+ * @param path The manifest csv.
+ * @param costs Output parameter: relative path -> cost.
+ * @return false if the file could not be read or lacks the columns
+ */
+bool loadManifest(const std::string& path, std::map<std::string, double>& costs);
+
+/**
+ * @brief
+ * Combines per shard result csv files into one and recomputes the global accuracy.
+ * Rows are keyed by Type, Mode and Filename; a row seen in a later file replaces an earlier one,
+ * so re-running a failed shard and merging again is safe.
+ * @param inputs The shard csv files.
+ * @param outPath The merged csv to write.
+ * @param total Output parameter: number of distinct files.
+ * @param correct Output parameter: number of correctly classified files.
+ * @return false if an input could not be read, its header differs from the first input's
+ * (shards of different runs or versions), or the output could not be written
+ */
+bool mergeResults(const std::vector<std::string>& inputs, const std::string& outPath,
+                  int& total, int& correct);
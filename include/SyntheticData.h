@@ -0,0 +1,118 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief
+ * Appearance options shared by every rendered eye.
+ */
+struct SyntheticOptions
+{
+    int highlights = 1;                 // specular reflections drawn next to the pupil
+    double noise = 6.0;                 // standard deviation of the Gaussian sensor noise, in grey levels
+    double eyelid = 0.25;               // largest fraction of the pupil diameter hidden by the upper lid
+};
+
+/**
+ * @brief
+ * One rendered eye and its ground truth, in the coordinates of the eye crop.
+ */
+struct SyntheticEye
+{
+    cv::Size size;
+    cv::Point2f center;                 // pupil center
+    float radius = 0;                   // pupil radius
+    float irisRadius = 0;
+    cv::Point2f openingCenter;          // eye opening: an ellipse between the two corners
+    cv::Size2f openingAxes;
+    float lidY = 0;                     // rows above it are covered by the upper lid
+    std::vector<cv::Point2f> highlights;
+    float highlightRadius = 0;
+    cv::Scalar skin, iris;
+    double noise = 0;
+
+    /**
+     * @brief
+     * The six eye landmarks in dlib's order (outer corner, two upper lid points, inner
+     * corner, two lower lid points), as extractEyesForFace returns them.
+     */
+    std::vector<cv::Point> landmarks() const;
+
+    /**
+     * @brief
+     * The same eye rendered at another crop size: every position and length is scaled.
+     */
+    SyntheticEye scaled(cv::Size to) const;
+};
+
+/**
+ * @brief
+ * Draws the geometry and colours of a random eye. The random numbers are drawn in the
+ * same order whatever the size, so the same seed gives the same eye at every resolution.
+ * @param size Size of the eye crop.
+ * @param rng Random generator.
+ * @param opts Appearance options.
+ */
+SyntheticEye randomSyntheticEye(cv::Size size, cv::RNG& rng, const SyntheticOptions& opts = SyntheticOptions());
+
+/**
+ * @brief
+ * Renders an eye crop: skin, the eye opening with sclera, iris and pupil, specular
+ * highlights, the upper lid with its lash line, a slight blur and Gaussian noise.
+ * @param eye The eye to render.
+ * @param rng Random generator of the noise.
+ * @return the BGR eye crop
+ */
+cv::Mat renderSyntheticEye(const SyntheticEye& eye, cv::RNG& rng);
+
+/**
+ * @brief
+ * Renders a face sized canvas with two eyes at known positions. The canvas is not a
+ * realistic face and the face detector is not expected to find one; it measures what
+ * the detector and the crop stages cost at a given resolution.
+ * @param size Size of the canvas.
+ * @param left Left eye, its size is the size of the crop pasted into the canvas.
+ * @param right Right eye.
+ * @param leftRect Output parameter: location of the left eye crop in the canvas.
+ * @param rightRect Output parameter: location of the right eye crop in the canvas.
+ * @param rng Random generator of the noise.
+ */
+cv::Mat renderSyntheticFace(cv::Size size, const SyntheticEye& left, const SyntheticEye& right,
+                            cv::Rect& leftRect, cv::Rect& rightRect, cv::RNG& rng);
+
+/**
+ * @brief
+ * Size of the eye crops of a face canvas.
+ */
+cv::Size syntheticFaceEyeSize(cv::Size canvas);
+
+/**
+ * @brief
+ * Ground truth of one rendered eye, one row of the generator's ground_truth.csv.
+ */
+struct SyntheticTruth
+{
+    std::string file;
+    int frame = 0;                      // video frame, 0 for images
+    std::string eye;                    // "crop" for eye crops, "left" / "right" in faces and videos
+    cv::Point2f center;                 // in the coordinates of the written image
+    float radius = 0;
+    float lidY = 0;
+};
+
+/**
+ * @brief
+ * Writes a video of a face canvas whose pupils wander inside the eyes and that blinks
+ * every few seconds.
+ * @param path Output video (mp4v).
+ * @param size Frame size.
+ * @param frames Number of frames.
+ * @param fps Frame rate.
+ * @param rng Random generator of the eyes and the noise.
+ * @param opts Appearance options.
+ * @param truth Output parameter: two rows per frame are appended, file set to path.
+ * @return false if the video could not be opened for writing
+ */
+bool writeSyntheticVideo(const std::string& path, cv::Size size, int frames, double fps, cv::RNG& rng,
+                         const SyntheticOptions& opts, std::vector<SyntheticTruth>& truth);
@@ -0,0 +1,193 @@
+#pragma once
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief
+ * Fixed size pool of worker threads shared by the face, eye and video stages.
+ * A task may submit further tasks and wait for them through wait(), which runs
+ * queued work on the waiting thread instead of blocking, so nested parallelism
+ * (files -> faces -> eyes) never starves the pool.
+ *
+ * A pinned pool spreads its workers over the NUMA nodes of the host, pins each one to a
+ * CPU and keeps one queue per node. Tasks submitted by a worker go to the queue of its
+ * node, so everything a file spawns stays on the node that started it; a worker whose
+ * queue is empty takes work from the other nodes rather than idle.
+ */
+class TaskPool
+{
+public:
+    /**
+     * @brief
+     * Starts the worker threads.
+     * @param threads Number of workers, 0 uses the hardware concurrency.
+     * @param pin Pin the workers to CPUs, node by node, with one queue per node.
+     */
+    explicit TaskPool(unsigned threads = 0, bool pin = false);
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    /**
+     * @brief
+     * Queues a callable and returns the future of its result.
+     * @param f Callable taking no arguments.
+     * @return future holding the value returned by f (or the exception it threw)
+     */
+    template <typename F>
+    auto submit(F&& f) -> std::future<decltype(f())>
+    {
+        using R = decltype(f());
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        std::future<R> fut = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            queues[submitNode()].emplace_back([task]() { (*task)(); });
+        }
+        cv.notify_one();
+        return fut;
+    }
+
+    /**
+     * @brief
+     * Waits for a future produced by submit(), executing other queued tasks on
+     * the calling thread while the result is not ready.
+     * @param fut The future to wait for.
+     * @return the value held by the future
+     */
+    template <typename T>
+    T wait(std::future<T>& fut)
+    {
+        while (fut.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (!runOne()) {
+                fut.wait();
+                break;
+            }
+        }
+        return fut.get();
+    }
+
+    /**
+     * @brief
+     * Waits for every future of a fan-out, see wait(). A task that throws does not cut the
+     * wait short: its exception (the first one, if several throw) is rethrown only once
+     * all the tasks are done, so none of them outlives the locals it refers to. Futures
+     * already consumed are skipped.
+     * @param futs The futures, a vector or a deque.
+     */
+    template <typename C>
+    void waitAll(C& futs)
+    {
+        std::exception_ptr first;
+        for (auto& fut : futs) {
+            if (!fut.valid()) continue;
+            try {
+                wait(fut);
+            } catch (...) {
+                if (!first) first = std::current_exception();
+            }
+        }
+        if (first) std::rethrow_exception(first);
+    }
+
+    /**
+     * @brief
+     * Number of worker threads in the pool.
+     */
+    unsigned size() const { return (unsigned)workers.size(); }
+
+    /**
+     * @brief
+     * Number of queues: the NUMA nodes of a pinned pool, 1 otherwise.
+     */
+    int nodeCount() const { return (int)queues.size(); }
+
+    bool pinned() const { return pin; }
+
+    /**
+     * @brief
+     * Tasks run by a worker of a node other than the one they were queued on.
+     */
+    uint64_t stolenCount() const { return stolen; }
+
+    /**
+     * @brief
+     * Node of the calling thread: that of its pool when it is a pinned worker, -1 otherwise.
+     */
+    static int currentNode();
+
+    /**
+     * @brief
+     * While alive, tasks submitted by the calling thread (not a worker) go to the queue of
+     * one node instead of being spread over the nodes, so the tasks of one file stay together.
+     */
+    class NodeScope
+    {
+    public:
+        explicit NodeScope(int node);
+        ~NodeScope();
+
+    private:
+        int previous;
+    };
+
+    /**
+     * @brief
+     * Process wide pool used by the pipeline stages.
+     */
+    static TaskPool& shared();
+
+    /**
+     * @brief
+     * Sets the thread budget of the process: the shared pool gets that many workers and
+     * OpenCV's own thread pool is reduced to one thread. The stages already run as pool
+     * tasks (files, faces, eyes, segments, pyramid levels), so OpenCV functions starting
+     * their own threads from every worker would only oversubscribe the cores.
+     * The shared pool is rebuilt on its next use; no task may be running.
+     * @param threads Number of workers, 0 uses the hardware concurrency.
+     */
+    static void setThreadBudget(unsigned threads);
+
+    /**
+     * @brief
+     * setThreadBudget for embedders that cannot know whether other threads already use the
+     * shared pool: the budget is only taken while the pool does not exist yet, since
+     * rebuilding it would pull it from under the running tasks.
+     * @param threads Number of workers, 0 uses the hardware concurrency.
+     * @return false if the pool is already running with a different number of workers
+     */
+    static bool initThreadBudget(unsigned threads);
+
+    /**
+     * @brief
+     * Pins the workers of the shared pool, see TaskPool(threads, pin). Has no effect where
+     * threads cannot be pinned (macOS). The shared pool is rebuilt on its next use.
+     */
+    static void setPinning(bool pin);
+
+private:
+    int submitNode();
+    bool popTask(int node, std::function<void()>& task);
+    bool runOne();
+    void workerLoop(int node, int cpu);
+
+    std::vector<std::thread> workers;
+    std::vector<std::deque<std::function<void()>>> queues;     // one per node
+    bool pin = false;
+    unsigned nextNode = 0;
+    std::atomic<uint64_t> stolen{0};
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping = false;
+};
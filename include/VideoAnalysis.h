@@ -0,0 +1,243 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "FaceAnalysis.h"
+
+/**
+ * @brief
+ * Strategies for choosing which frames of a video are scored.
+ * First     the first maxFrames frames.
+ * Stride    every stride-th frame; skipped frames are grabbed but never retrieved.
+ * Uniform   maxFrames frames spread evenly over the whole clip, reached by seeking.
+ * Keyframe  key frames only (at most maxFrames of them, spread over the clip).
+ */
+enum class SampleMode { First, Stride, Uniform, Keyframe };
+
+/**
+ * @brief
+ * Parses a sampling mode name ("first", "stride", "uniform", "keyframe").
+ * @param name The name given on the command line.
+ * @param mode Output parameter: the parsed mode.
+ * @return false if the name is unknown
+ */
+bool parseSampleMode(const std::string& name, SampleMode& mode);
+
+/**
+ * @brief
+ * Name of a sampling mode, as accepted by parseSampleMode.
+ */
+const char* sampleModeName(SampleMode mode);
+
+/**
+ * @brief
+ * Options controlling how a video is sampled and analysed.
+ */
+struct VideoOptions
+{
+    SampleMode sampling = SampleMode::Uniform;
+    int maxFrames = 30;                 // frames to score, 0 = no limit (first/stride)
+    int stride = 10;                    // distance between scored frames in stride mode
+    bool track = true;                  // start each eye's pupil search from the previous sampled frame
+    int trackMaxGap = 15;               // frames between samples beyond which the track is dropped
+    bool coarseToFine = false;          // visit uniform samples so that every prefix spans the whole clip
+    PupilSearchOptions pupil;           // how each eye's pupil is searched
+    int segments = 1;                   // decode this many time segments of the clip in parallel
+    FaceDetectOptions detect;           // how faces are searched in each frame
+};
+
+/**
+ * @brief
+ * Pulls the sampled frames of an opened video one at a time. Frames that are not
+ * sampled are skipped with grab() or a seek, so they never pay for the conversion to BGR.
+ */
+class FrameSampler
+{
+public:
+    /**
+     * @brief
+     * @param cap The opened capture the frames are read from.
+     * @param path Path of the video, used to build the key frame index.
+     * @param opts Sampling options.
+     */
+    FrameSampler(cv::VideoCapture& cap, const std::string& path, const VideoOptions& opts);
+
+    /**
+     * @brief
+     * Sampler visiting exactly the given frames, used for one segment of a segmented decode.
+     * @param cap The opened capture the frames are read from.
+     * @param frames Increasing frame numbers.
+     */
+    FrameSampler(cv::VideoCapture& cap, const std::vector<int>& frames);
+
+    /**
+     * @brief
+     * The frame numbers this sampler visits, in increasing order, when they are known before
+     * decoding. First and stride plans need the frame count reported by the container.
+     * @param frames Output parameter: the planned frame numbers.
+     * @return false if the plan depends on where the stream ends
+     */
+    bool plan(std::vector<int>& frames) const;
+
+    /**
+     * @brief
+     * Decodes the next sampled frame.
+     * @param frame Output parameter: the decoded BGR frame.
+     * @param index Output parameter: the frame number in the video.
+     * @return false once the sampling plan or the stream is exhausted
+     */
+    bool next(cv::Mat& frame, int& index);
+
+    /**
+     * @brief
+     * The sampling in effect: the requested one, or uniform when key frames were asked
+     * for and the backend cannot list them.
+     */
+    SampleMode sampling() const { return opts.sampling; }
+
+private:
+    bool seekTo(int target);
+
+    cv::VideoCapture& cap;
+    VideoOptions opts;
+    std::vector<int> targets;           // planned frame numbers (uniform, keyframe)
+    size_t nextTarget = 0;
+    int position = 0;                   // number of the frame the next grab() returns
+    int produced = 0;
+};
+
+/**
+ * @brief
+ * Result of one sampled video frame: both eyes of the best scoring face.
+ */
+struct FrameResult
+{
+    int index = 0;                      // frame number in the video
+    bool faceFound = false;
+    FaceResult face;
+    SampleMode sampling = SampleMode::First;    // how the frame was chosen (consecutive for paced and pushed frames)
+
+    /**
+     * @brief
+     * Mean BIoU of the eyes that were segmented, -1 if none.
+     */
+    double biou() const;
+};
+
+/**
+ * @brief
+ * Analyses consecutive frames of one video, carrying the pupils of each frame over to the
+ * next one when tracking is enabled. One analyzer per stream; it is not shared between threads.
+ */
+class FrameAnalyzer
+{
+public:
+    explicit FrameAnalyzer(const VideoOptions& opts) : opts(opts) {}
+
+    /**
+     * @brief
+     * Detects the best face of a frame and segments both pupils. The tracks are dropped
+     * when the frame is more than trackMaxGap frames away from the previous one.
+     * @param frame The BGR frame.
+     * @param result In: index, the frame number. Out: the face and eye results.
+     */
+    void analyze(const cv::Mat& frame, FrameResult& result);
+
+private:
+    VideoOptions opts;
+    // pupils of the previous analysed frame, in frame coordinates
+    PupilTrack leftTrack, rightTrack;
+    int lastIndex = -1;
+};
+
+/**
+ * @brief
+ * Samples a video and analyses both eyes of every sampled frame. With opts.track the
+ * pupil search of each eye starts from where it was found in the previous sampled frame.
+ * With opts.segments > 1 the planned frames are split into that many consecutive segments,
+ * each decoded by its own capture on its own task; tracking restarts at each segment start.
+ * A segment runs at most a few frames ahead of the caller, and a false from onFrame stops
+ * every segment.
+ * @param path Path of the video file.
+ * @param opts Sampling options.
+ * @param onFrame Called in frame order for every sampled frame; returning false stops the analysis.
+ * @return false if the video could not be opened
+ */
+bool analyzeVideo(const std::string& path, const VideoOptions& opts,
+                  const std::function<bool(const FrameResult&)>& onFrame);
+
+/**
+ * @brief
+ * What a paced replay does with frames that arrive while the analysis is busy.
+ * Latest      only the newest waiting frame is kept, every older one is dropped.
+ * DropOldest  frames wait in a queue; when it is full the oldest waiting frame is dropped.
+ * DropNewest  frames wait in a queue; when it is full the arriving frame is dropped.
+ */
+enum class DropPolicy { Latest, DropOldest, DropNewest };
+
+/**
+ * @brief
+ * Parses a drop policy name ("latest", "drop-oldest", "drop-newest").
+ * @return false if the name is unknown
+ */
+bool parseDropPolicy(const std::string& name, DropPolicy& policy);
+
+/**
+ * @brief
+ * Name of a drop policy, as accepted by parseDropPolicy.
+ */
+const char* dropPolicyName(DropPolicy policy);
+
+/**
+ * @brief
+ * Options of a paced replay, see analyzeVideoPaced.
+ */
+struct PacedOptions
+{
+    double fps = 0.0;                   // replay rate, 0 = the rate stored in the file
+    DropPolicy policy = DropPolicy::Latest;
+    int queueDepth = 2;                 // frames allowed to wait (drop-oldest, drop-newest)
+};
+
+/**
+ * @brief
+ * Measurements of a paced replay. Latency runs from the moment a frame is due at the
+ * replay rate to the moment its result is delivered.
+ */
+struct PacedStats
+{
+    double fps = 0.0;                   // replay rate used
+    int captured = 0;                   // frames delivered by the replayed "camera"
+    int processed = 0;
+    int dropped = 0;
+    double seconds = 0.0;               // wall time of the replay
+    std::vector<double> latencyMs;      // one entry per processed frame
+
+    double dropRate() const { return captured ? (double)dropped / captured : 0.0; }
+    double sustainedFps() const { return seconds > 0 ? processed / seconds : 0.0; }
+
+    /**
+     * @brief
+     * Latency percentile (nearest rank), 0 if no frame was processed.
+     * @param p Percentile in [0, 100].
+     */
+    double latencyPercentile(double p) const;
+};
+
+/**
+ * @brief
+ * Replays a video file as a stand-in for a live camera: a capture thread decodes every frame
+ * and hands it over when it is due at the replay rate, whether or not the analysis has caught
+ * up; frames the analysis cannot take in time are dropped according to paced.policy. Frames
+ * are analysed one at a time on the calling thread (tracking and pupil search as opts), in
+ * arrival order. Sampling options are ignored.
+ * @param path Path of the video file.
+ * @param opts Tracking, detection and pupil search options.
+ * @param paced Replay rate and drop policy.
+ * @param stats Output parameter: frame counts, latencies and throughput.
+ * @param onFrame Called for every analysed frame; returning false stops the replay.
+ * @return false if the video could not be opened
+ */
+bool analyzeVideoPaced(const std::string& path, const VideoOptions& opts, const PacedOptions& paced,
+                       PacedStats& stats, const std::function<bool(const FrameResult&)>& onFrame);